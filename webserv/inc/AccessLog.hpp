@@ -0,0 +1,80 @@
+#ifndef ACCESSLOG_HPP
+#define ACCESSLOG_HPP
+
+#include <string>
+#include <ctime>
+#include <sys/types.h>
+#include <pthread.h>
+
+#define ACCESS_LOG_BUFFER_SIZE 1048576 // Bytes waiting for the writer, later lines are dropped
+#define ACCESS_LOG_FLUSH_SIZE 65536    // Wake the writer early once this much is waiting
+#define ACCESS_LOG_FLUSH_INTERVAL 1    // Seconds a line may wait before it is written
+
+// The request side of an access log line, copied when handling starts
+// because the Request is gone by the time a CGI response is queued.
+// Strings keep their capacity from one request to the next.
+struct AccessLogEntry {
+	bool active; // Captured and not yet logged
+	std::string method;
+	std::string uri;
+	std::string version;
+	std::string referer;
+	std::string user_agent;
+
+	AccessLogEntry() : active(false) {}
+};
+
+// One log file, or stdout, shared by the server blocks naming it. The
+// event loop formats lines into a buffer; a background thread swaps the
+// buffer out and writes it in batches, so a slow disk or terminal never
+// blocks a request. When the buffer is full lines are dropped and counted.
+class AccessLog {
+private:
+	std::string _path; // Empty for stdout
+	int _fd;           // Writer thread only once started
+	pthread_t _thread;
+	pthread_mutex_t _mutex;
+	pthread_cond_t _wakeup;
+	std::string _pending; // Filled by the event loop, under _mutex
+	std::string _writing; // Being written, writer thread only
+	bool _reopen;
+	bool _stopping;
+	unsigned long _lines;   // Accepted into the buffer
+	unsigned long _dropped; // Lost to a full buffer
+
+	// Event loop thread only
+	std::string _line;
+	time_t _time_cached; // Second the timestamps below were formatted for
+	char _time_local[32]; // 10/Oct/2000:13:55:36 -0700
+	char _time_iso[32];   // 2000-10-10T13:55:36-07:00
+
+public:
+	AccessLog(const std::string& path); // Throws if the file can't be opened
+	~AccessLog(); // Writes out what is still buffered
+
+	void log(const AccessLogEntry& entry, const std::string& remote_addr, int status,
+	         off_t bytes, long long duration_usec, bool json);
+	void reopen(); // The writer closes and reopens the file (after rotation)
+
+	// Getters
+	const std::string& getPath() const;
+	unsigned long getLines();
+	unsigned long getDropped();
+
+private:
+	AccessLog(const AccessLog& other);
+	AccessLog& operator=(const AccessLog& other);
+
+	int _open() const;
+	void _formatTime(time_t now);
+	void _appendCombined(const AccessLogEntry& entry, const std::string& remote_addr,
+	                     int status, off_t bytes);
+	void _appendJson(const AccessLogEntry& entry, const std::string& remote_addr,
+	                 int status, off_t bytes, long long duration_usec);
+	static void _appendEscaped(std::string& out, const std::string& value, bool json);
+	static void* _run(void* log);
+	void _work();
+	void _write(const std::string& data);
+};
+
+#endif // ACCESSLOG_HPP
@@ -0,0 +1,37 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstddef>
+#include <vector>
+
+#define ARENA_BLOCK_SIZE 4096 // Enough for the headers of a typical request
+
+// Bump allocator for state that lives exactly as long as one request.
+// Allocations are never freed one by one: reset() drops all of them at
+// once and keeps the first block, so a connection reuses the same memory
+// request after request. Nothing placed here gets its destructor run.
+class Arena {
+private:
+	std::vector<char*> _blocks;
+	size_t _used;     // Bytes taken from the last block
+	size_t _capacity; // Size of the last block
+
+public:
+	Arena();
+	~Arena();
+
+	void* allocate(size_t size); // Aligned for any type
+	char* copy(const char* data, size_t length); // NUL-terminated copy
+	void reset();
+
+	// Getters
+	size_t getBlockCount() const;
+
+private:
+	Arena(const Arena& other);
+	Arena& operator=(const Arena& other);
+
+	void _grow(size_t size);
+};
+
+#endif // ARENA_HPP
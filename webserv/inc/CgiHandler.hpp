@@ -2,30 +2,102 @@
 #define CGIHANDLER_HPP
 
 #include <string>
+#include <vector>
+#include <ctime>
+#include <sys/types.h>
+#include "Response.hpp"
+
+#define CGI_MAX_HEADER_SIZE 16384
 
 class Request;
-class Response;
 struct LocationConfig;
+struct ServerConfig;
 
+// One CGI request. Either a forked process, whose stdin/stdout pipes the
+// Server registers in the event loop, or a request handed to a FastCGI
+// pool (fastcgi_pass). The request body is streamed out as the peer
+// accepts it and output is handed back to the client as it is produced.
 class CgiHandler {
 private:
 	std::string _cgi_path;
+	std::string _fastcgi_pass; // Socket of the FastCGI pool, empty when forked
 	std::string _script_path;
-	const Request& _request;
+	std::vector<std::string> _env;
+	std::string _protocol; // Request version, decides how output is framed
+	int _client_fd;
+
+	// Request body: in memory or a spooled file (owned, unlinked)
+	std::string _input;
+	size_t _input_offset;
+	std::string _body_file;
+	int _body_fd;
+
+	pid_t _pid;
+	int _stdin_fd;
+	int _stdout_fd;
+	time_t _started_at;
+	long long _received_at; // Monotonic microseconds, FastCGI queueing included
+	bool _exited;
+
+	// Output: headers are buffered until the blank line
+	std::string _header_buffer;
+	bool _headers_done;
+	Response _response;
+	bool _buffer_output; // No Content-Length and no chunking: send at EOF
+	bool _output_paused; // Client is behind, stdout left out of the loop
 
 public:
 	CgiHandler(const std::string& cgi_path, const std::string& script_path,
-	           const Request& request, const LocationConfig* location);
+	           Request& request, const LocationConfig* location,
+	           const ServerConfig& server, int client_fd);
 	~CgiHandler();
 
-	// Execute CGI and return response
-	bool execute(Response& response);
+	bool start(); // fork + execve with non-blocking pipes
+
+	// Returns 1 when the whole body is written, 0 if the pipe is full, -1 on error
+	int writeInput();
+	// FastCGI: next piece of the body (at most max_length), empty at the end
+	bool nextInput(std::string& chunk, size_t max_length);
+	void closeInput();
+
+	// Returns bytes appended to `out`, 0 on EOF, -1 if it would block, -2 on error
+	ssize_t readOutput(std::string& out);
+	void closeOutput();
+
+	// Moves CGI headers out of `data` into the response. Returns 1 once
+	// complete, leaving only body bytes in `data`, 0 for more, -1 if too large.
+	int parseHeaders(std::string& data);
+
+	void kill();
+	void markExited();
+	void setOutputBuffered(bool buffered);
+	void setOutputPaused(bool paused);
+
+	// Getters
+	pid_t getPid() const;
+	int getClientFd() const;
+	void detachClient();
+	int getStdinFd() const;
+	int getStdoutFd() const;
+	time_t getStartedAt() const;
+	long long getReceivedAt() const;
+	bool hasExited() const;
+	bool areHeadersDone() const;
+	const std::string& getProtocol() const;
+	const std::vector<std::string>& getEnv() const;
+	const std::string& getFastCgiPass() const;
+	bool isFastCgi() const;
+	Response& getResponse();
+	bool isOutputBuffered() const;
+	bool isOutputPaused() const;
+	bool isFinished() const; // Output closed and process reaped
 
 private:
-	char** _buildEnv() const;
-	void _freeEnv(char** env) const;
-	std::string _getCgiExtension() const;
+	CgiHandler(const CgiHandler& other);
+	CgiHandler& operator=(const CgiHandler& other);
+
+	void _buildEnv(const Request& request, const ServerConfig& server);
+	bool _fillInput();
 };
 
 #endif // CGIHANDLER_HPP
-
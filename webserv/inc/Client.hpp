@@ -3,42 +3,135 @@
 
 #include <string>
 #include <ctime>
+#include <sys/types.h>
+#include "HttpParser.hpp"
+#include "OutputQueue.hpp"
+#include "TimerWheel.hpp"
+#include "Arena.hpp"
+#include "Request.hpp"
+#include "AccessLog.hpp"
+
+#define CLIENT_BUFFER_KEEP 65536 // Receive buffer capacity a reused Client keeps
+
+class CgiHandler;
+class VirtualHosts;
+class ConfigSnapshot;
+struct DiskJob;
+struct LocationMetrics;
+struct ServerConfig;
 
 class Client {
 private:
 	int _fd;
+	std::string _remote_addr; // Peer IP address, for the access log
 	std::string _buffer;
 	time_t _last_activity;
-	bool _request_complete;
-	size_t _content_length;
-	size_t _body_received;
-	bool _headers_parsed;
+	TimerNode _timer; // Linked into the Server's timer wheel, id is the fd
+	HttpParser _parser; // Resumes over _buffer between reads
+	bool _write_armed; // EVENT_WRITE currently registered in the event loop
+	bool _read_paused; // EVENT_READ dropped while the output queue is backed up
+	bool _close_after_write; // Connection: close, remove once output is sent
+	int _requests_served;
+
+	// Request body being spooled to a temporary file
+	int _spool_fd;
+	std::string _spool_path;
+
+	// Responses not yet written to the socket
+	OutputQueue _output;
+
+	// Parse state of the request being handled, dropped when it completes
+	Arena _arena;
+	Request _request; // Headers live in _arena
+
+	// Read-ahead the current request is parked on, owned by the DiskIoPool
+	DiskJob* _disk_job;
+
+	// Timings of the request in flight, in monotonic microseconds
+	long long _parse_usec; // Parser time so far, over all reads
+	long long _handled_at; // Handling started, 0 once the response is queued
+	long long _queued_at;  // Oldest response still being sent, 0 if none
+	LocationMetrics* _location_metrics; // Owned by the Server's Metrics
+	AccessLogEntry _log_entry; // Request line and headers of the current request
+
+	// CGI producing the current response, owned by the Server
+	CgiHandler* _cgi;
+
+	// Configuration the current request runs on (a reference is held),
+	// the sites on the socket this client connected to, and the one
+	// serving the request (the default until its Host header is read)
+	ConfigSnapshot* _snapshot;
+	const VirtualHosts* _virtual_hosts;
+	const ServerConfig* _server;
+	bool _server_selected; // For the request being parsed, cleared by consume()
 
 public:
 	Client();
 	Client(int fd);
 	~Client();
 
+	void reset(int fd); // Ready for a new connection, keeps allocated memory
+
 	// Getters
 	int getFd() const;
+	const std::string& getRemoteAddress() const;
 	std::string& getBuffer();
 	const std::string& getBuffer() const;
 	time_t getLastActivity() const;
-	bool isRequestComplete() const;
-	size_t getContentLength() const;
-	size_t getBodyReceived() const;
-	bool areHeadersParsed() const;
+	HttpParser& getParser();
+	bool isWriteArmed() const;
+	bool shouldClose() const;
+	int getRequestsServed() const;
+	bool isSpoolingBody() const;
+	bool isReadPaused() const;
+	OutputQueue& getOutput();
+	TimerNode* getTimer();
+	Arena& getArena();
+	Request& getRequest();
+	DiskJob* getDiskJob() const;
+	long long getParseTime() const;
+	long long getHandledAt() const;
+	long long getQueuedAt() const;
+	LocationMetrics* getLocationMetrics() const;
+	AccessLogEntry& getLogEntry();
+	CgiHandler* getCgi() const;
+	ConfigSnapshot* getSnapshot() const;
+	const VirtualHosts* getVirtualHosts() const;
+	const ServerConfig* getServer() const;
+	bool isServerSelected() const;
 
 	// Setters
-	void setRequestComplete(bool complete);
-	void setContentLength(size_t length);
-	void setBodyReceived(size_t received);
-	void setHeadersParsed(bool parsed);
+	void setRemoteAddress(const std::string& address);
+	void setWriteArmed(bool armed);
+	void setReadPaused(bool paused);
+	void setCloseAfterWrite(bool close);
+	void incrementRequestsServed();
+	void setCgi(CgiHandler* cgi);
+	void setSnapshot(ConfigSnapshot* snapshot);
+	void setVirtualHosts(const VirtualHosts* virtual_hosts);
+	void setServer(const ServerConfig* server);
+	void setServerSelected(bool selected);
+	void setDiskJob(DiskJob* job);
+	void setParseTime(long long usec);
+	void setHandledAt(long long usec);
+	void setQueuedAt(long long usec);
+	void setLocationMetrics(LocationMetrics* metrics);
 	void updateActivity();
 
+	// Body spooling: moves buffer bytes into a temp file created in dir
+	bool startBodySpool(const std::string& dir);
+	bool spoolBody(size_t offset, size_t length);
+	std::string releaseBodySpool(); // Caller owns the file afterwards
+	void discardBodySpool();
+
 	// Buffer management
-	void addToBuffer(const std::string& data);
+	void addToBuffer(const char* data, size_t length);
+	void consume(size_t length); // Drop one request's bytes, keep pipelined ones
 	void clearBuffer();
+
+private:
+	Client(const Client& other);
+	Client& operator=(const Client& other);
 };
 
 #endif // CLIENT_HPP
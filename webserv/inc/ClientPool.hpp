@@ -0,0 +1,34 @@
+#ifndef CLIENTPOOL_HPP
+#define CLIENTPOOL_HPP
+
+#include <vector>
+#include <cstddef>
+
+class Client;
+
+// Client objects recycled across connections, so accepting one costs no
+// allocation once the pool has warmed up, and the buffers, parser and
+// arena a Client grew are reused. At most `capacity` are in use at once.
+class ClientPool {
+private:
+	std::vector<Client*> _free;
+	size_t _capacity;
+	size_t _in_use;
+
+public:
+	ClientPool(size_t capacity);
+	~ClientPool(); // Deletes the free clients, the ones in use belong to the caller
+
+	Client* acquire(int fd); // NULL when all are in use
+	void release(Client* client);
+
+	// Getters
+	size_t getCapacity() const;
+	size_t getInUse() const;
+
+private:
+	ClientPool(const ClientPool& other);
+	ClientPool& operator=(const ClientPool& other);
+};
+
+#endif // CLIENTPOOL_HPP
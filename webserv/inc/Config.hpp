@@ -4,35 +4,77 @@
 #include <string>
 #include <vector>
 #include <map>
+#include "LocationTrie.hpp"
+
+class Metrics;
+struct LocationMetrics;
 
 struct LocationConfig {
 	std::string path;
 	std::string root;
 	std::vector<std::string> methods;
+	int allowed_methods;       // METHOD_* bits of methods, set when the config is compiled
 	std::string index;
 	bool autoindex;
 	std::string redirect;
 	std::string upload_path;
 	std::map<std::string, std::string> cgi_extensions; // .php -> /usr/bin/php-cgi
+	std::string fastcgi_pass;  // UNIX socket of a FastCGI responder
+	int fastcgi_connections;   // Connections kept open to fastcgi_pass
+	std::string etag;          // on (strong), weak or off
+	std::string cache_control; // Sent verbatim with static files
+	bool gzip;                 // Compress text responses on the fly
+	bool gzip_static;          // Serve file.gz in place of file when accepted
+	int gzip_comp_level;       // zlib level, 1 (fast) to 9 (small)
+	size_t gzip_min_length;    // Smaller bodies are sent uncompressed
+	bool aio;                  // Open and read files ahead on the disk I/O threads
+	bool metrics;              // Answer GETs with the worker's metrics
+	LocationMetrics* counters; // This worker's counters for path, set by bindMetrics()
 
-	LocationConfig() : autoindex(false) {}
+	LocationConfig() : allowed_methods(0), autoindex(false), fastcgi_connections(8), etag("on"),
+	                   gzip(false), gzip_static(false), gzip_comp_level(6), gzip_min_length(1024),
+	                   aio(false), metrics(false), counters(NULL) {}
 };
 
 struct ServerConfig {
 	int port;
 	std::string host;
-	std::string server_name;
+	std::string server_name;               // First of server_names, passed to CGI
+	std::vector<std::string> server_names; // Host header values this block answers
 	size_t max_body_size;
+	size_t client_body_buffer_size; // Larger bodies are spooled to disk
+	int keepalive_timeout;   // Seconds an idle connection is kept, 0 disables keep-alive
+	int keepalive_requests;  // Requests served per connection before closing it
+	int client_header_timeout; // Seconds between reads while headers arrive
+	int client_body_timeout;   // Seconds between reads while the body arrives
+	int send_timeout;          // Seconds between writes while a response is queued
+	int cgi_timeout;         // Seconds a CGI may run before it is killed
+	size_t file_cache_size;  // Bytes of static files kept in memory, 0 disables
+	size_t file_cache_max_file_size; // Larger files are always sent from disk
+	int file_cache_valid;    // Seconds before a cached file is stat()ed again
+	std::string access_log;  // File, "stdout" or "off"
+	std::string access_log_format; // "combined" or "json"
 	std::map<int, std::string> error_pages;
 	std::vector<LocationConfig> locations;
+	LocationTrie location_trie; // Indices into locations, set when the config is compiled
 
-	ServerConfig() : port(8080), host("0.0.0.0"), max_body_size(1048576) {} // 1MB default
+	ServerConfig() : port(8080), host("0.0.0.0"), max_body_size(1048576), // 1MB default
+	                 client_body_buffer_size(16384),
+	                 keepalive_timeout(75), keepalive_requests(100),
+	                 client_header_timeout(60), client_body_timeout(60), send_timeout(60),
+	                 cgi_timeout(30),
+	                 file_cache_size(16777216), file_cache_max_file_size(262144), // 16MB, 256KB
+	                 file_cache_valid(1), access_log("stdout"), access_log_format("combined") {}
 };
 
 class Config {
 private:
 	std::vector<ServerConfig> _servers;
 	std::string _config_file;
+	std::string _event_backend; // Global: "epoll", "poll" or empty for auto
+	int _workers;               // Global: number of worker processes
+	int _max_connections;       // Global: clients per worker
+	int _aio_threads;           // Global: disk I/O threads per worker
 
 public:
 	Config();
@@ -41,18 +83,26 @@ public:
 
 	// Parsing
 	bool parse();
+	bool load(); // Like parse() without falling back to the defaults
+	void bindMetrics(Metrics& metrics); // Resolves each location's counters once
 
 	// Getters
 	const std::vector<ServerConfig>& getServers() const;
 	const ServerConfig& getServerConfig(size_t index) const;
+	const std::string& getEventBackend() const;
+	int getWorkers() const;
+	int getMaxConnections() const;
+	int getAioThreads() const;
 
 	// Matching
-	const LocationConfig* findLocation(const std::string& uri, const ServerConfig& server) const;
+	static const LocationConfig* findLocation(const std::string& uri, const ServerConfig& server);
 
 private:
 	void _parseServerBlock(const std::string& block, ServerConfig& config);
 	void _parseLocationBlock(const std::string& block, LocationConfig& location);
 	void _parseConfigFile(const std::string& path);
+	void _parseGlobalDirectives(const std::string& content);
+	void _compile();
 	size_t _findClosingBrace(const std::string& str, size_t start) const;
 	std::string _trim(const std::string& str) const;
 	std::vector<std::string> _split(const std::string& str, char delimiter) const;
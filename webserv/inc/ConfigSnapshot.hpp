@@ -0,0 +1,37 @@
+#ifndef CONFIGSNAPSHOT_HPP
+#define CONFIGSNAPSHOT_HPP
+
+#include <string>
+#include <map>
+
+class Config;
+class VirtualHosts;
+
+// One loaded configuration and the Host tables built from it, never
+// modified once built. A reload creates a new snapshot; clients keep a
+// reference to the one their request started on, so in-flight requests
+// finish with the settings they began with.
+class ConfigSnapshot {
+private:
+	Config* _config;
+	std::map<std::string, VirtualHosts*> _listeners; // "host:port" -> sites bound there
+	int _references;
+
+public:
+	explicit ConfigSnapshot(Config* config); // Takes ownership
+	~ConfigSnapshot();
+
+	void retain();
+	bool release(); // True once the last reference is gone
+
+	// Getters
+	const Config& getConfig() const;
+	const std::map<std::string, VirtualHosts*>& getListeners() const;
+	const VirtualHosts* findListener(const std::string& address) const; // NULL if not configured
+
+private:
+	ConfigSnapshot(const ConfigSnapshot& other);
+	ConfigSnapshot& operator=(const ConfigSnapshot& other);
+};
+
+#endif // CONFIGSNAPSHOT_HPP
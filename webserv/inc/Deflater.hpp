@@ -0,0 +1,35 @@
+#ifndef DEFLATER_HPP
+#define DEFLATER_HPP
+
+#include <string>
+#include <zlib.h>
+
+// zlib stream producing an HTTP content coding (RFC 9110 8.4.1): "gzip",
+// or "deflate" which is the zlib format despite its name.
+class Deflater {
+private:
+	z_stream _stream;
+	bool _valid;
+	bool _finished;
+
+public:
+	Deflater(const std::string& encoding, int level);
+	~Deflater();
+
+	// Appends compressed output; finish flushes and ends the stream
+	bool compress(const char* data, size_t length, bool finish, std::string& out);
+
+	// Getters
+	bool isValid() const;
+	bool isFinished() const;
+
+	// Whole buffer at once, for bodies kept in memory
+	static bool compressAll(const std::string& encoding, int level, const std::string& data,
+	                        std::string& out);
+
+private:
+	Deflater(const Deflater& other);
+	Deflater& operator=(const Deflater& other);
+};
+
+#endif // DEFLATER_HPP
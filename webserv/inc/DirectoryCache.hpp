@@ -0,0 +1,68 @@
+#ifndef DIRECTORYCACHE_HPP
+#define DIRECTORYCACHE_HPP
+
+#include <string>
+#include <list>
+#include <map>
+#include <vector>
+#include <ctime>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "DirectoryListing.hpp"
+
+#define DIRECTORY_CACHE_ENTRIES 16     // Snapshots kept, least recently used go first
+#define DIRECTORY_READ_SIZE 65536      // getdents64() buffer
+
+// A directory's entries as of its last scan
+struct CachedDirectory {
+	std::string path;
+	DirectorySnapshot snapshot; // Shared with listings still being sent
+
+	// Identity checked on every lookup
+	dev_t device;
+	ino_t inode;
+	time_t mtime;
+	long mtime_nsec;
+};
+
+// Scans of the directories listed lately, so repeating a listing (or
+// paging through one) doesn't read and stat 200k entries again. Creating,
+// removing or renaming an entry bumps the directory's mtime, which makes
+// the next lookup rescan; a file changing in place is not noticed.
+class DirectoryCache {
+private:
+	typedef std::list<CachedDirectory> EntryList;
+
+	size_t _max_entries;
+	EntryList _entries; // Most recently used first
+	std::map<std::string, EntryList::iterator> _index; // path -> entry
+
+	unsigned long _hits;
+	unsigned long _misses;
+
+public:
+	DirectoryCache(size_t max_entries);
+	~DirectoryCache();
+
+	// The entries of path, which info (a fresh stat()) describes. Scans
+	// again if the directory changed; false if it can't be read.
+	bool lookup(const std::string& path, const struct stat& info, DirectorySnapshot& snapshot);
+
+	// Getters
+	size_t getEntryCount() const;
+	unsigned long getHits() const;
+	unsigned long getMisses() const;
+
+	// Reads a directory without the cache. Names starting with a dot are
+	// left out, as nginx does.
+	static bool scan(const std::string& path, std::vector<DirectoryEntry>& entries);
+
+private:
+	DirectoryCache(const DirectoryCache& other);
+	DirectoryCache& operator=(const DirectoryCache& other);
+
+	bool _isCurrent(const CachedDirectory& entry, const struct stat& info) const;
+	static void _addEntry(int dir_fd, const char* name, std::vector<DirectoryEntry>& entries);
+};
+
+#endif // DIRECTORYCACHE_HPP
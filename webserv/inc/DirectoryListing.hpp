@@ -0,0 +1,99 @@
+#ifndef DIRECTORYLISTING_HPP
+#define DIRECTORYLISTING_HPP
+
+#include <string>
+#include <vector>
+#include <ctime>
+#include <sys/types.h>
+
+#define LISTING_BATCH_ENTRIES 256 // Entries formatted into one chunk
+
+// What a listing shows of one directory entry
+struct DirectoryEntry {
+	std::string name;
+	bool is_dir;
+	off_t size;
+	time_t mtime;
+};
+
+enum ListingSort {
+	SORT_NAME,  // Directories first, then by name
+	SORT_SIZE,
+	SORT_MTIME,
+	SORT_KEYS
+};
+
+// One scan of a directory, never changed once taken. Copies share the
+// scan, so a listing being streamed keeps its entries after the cache
+// replaced them with a newer one. Sort orders are built on first use.
+class DirectorySnapshot {
+private:
+	struct Block {
+		std::vector<DirectoryEntry> entries; // In the order the directory returned them
+		std::vector<unsigned> orders[SORT_KEYS]; // Indices into entries, ascending
+		int references;
+	};
+	Block* _block; // NULL when empty
+
+public:
+	DirectorySnapshot();
+	explicit DirectorySnapshot(std::vector<DirectoryEntry>& entries); // Takes entries' contents
+	DirectorySnapshot(const DirectorySnapshot& other);
+	DirectorySnapshot& operator=(const DirectorySnapshot& other);
+	~DirectorySnapshot();
+
+	// Getters
+	bool isNull() const;
+	size_t getCount() const;
+	const DirectoryEntry& getEntry(unsigned index) const;
+	const std::vector<unsigned>& getOrder(ListingSort sort) const;
+
+private:
+	void _release();
+};
+
+// A page of a directory listing, as the request asked for it
+struct ListingOptions {
+	DirectorySnapshot snapshot;
+	std::string uri; // Directory path as requested (not decoded), ends with '/'
+	ListingSort sort;
+	bool descending;
+	size_t offset;
+	size_t limit; // 0 for all entries from offset on
+	bool json;
+
+	ListingOptions() : sort(SORT_NAME), descending(false), offset(0), limit(0), json(false) {}
+};
+
+// Formats a listing as HTML or JSON a batch at a time, so a directory of
+// any size is sent chunked without the whole body ever being in memory.
+class DirectoryListing {
+private:
+	ListingOptions _options;
+	const std::vector<unsigned>* _order; // Owned by the snapshot
+	size_t _position; // Entries of the page written so far
+	size_t _count;    // Entries on the page
+	bool _started;
+
+public:
+	DirectoryListing(const ListingOptions& options);
+
+	// Appends the next batch, true once the end of the body is written
+	bool next(std::string& out);
+
+	static void appendEncodedUri(std::string& out, const std::string& value);
+
+private:
+	DirectoryListing(const DirectoryListing& other);
+	DirectoryListing& operator=(const DirectoryListing& other);
+
+	void _appendHead(std::string& out) const;
+	void _appendEntry(std::string& out, const DirectoryEntry& entry, bool first) const;
+	void _appendTail(std::string& out) const;
+	void _appendPageLink(std::string& out, size_t offset, const char* label) const;
+	std::string _query(ListingSort sort, bool descending, size_t offset) const;
+	static void _appendHtml(std::string& out, const std::string& value);
+	static void _appendJson(std::string& out, const std::string& value);
+};
+
+#endif // DIRECTORYLISTING_HPP
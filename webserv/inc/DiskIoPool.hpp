@@ -0,0 +1,75 @@
+#ifndef DISKIOPOOL_HPP
+#define DISKIOPOOL_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <pthread.h>
+
+#define AIO_MAX_QUEUE 1024          // Jobs waiting for a thread, more are refused
+#define AIO_PREFETCH_SIZE 1048576   // Bytes read ahead of the response, the rest is hinted
+
+// A static file to bring into the page cache before the event loop
+// touches it. Owned by the pool from submit() until collect().
+struct DiskJob {
+	std::string path;  // File or directory the request resolved to
+	std::string index; // Tried when path is a directory, may be empty
+	int client_fd;
+	long long queued_at; // Monotonic microseconds
+	long long started_at;
+	long long finished_at;
+
+	DiskJob() : client_fd(-1), queued_at(0), started_at(0), finished_at(0) {}
+};
+
+// Threads that stat, open and read files ahead of the event loop, so a
+// cold disk delays only the request that needs it. Finished jobs are
+// announced on a non-blocking eventfd (a pipe outside Linux) for the
+// event loop to collect; the threads never touch server state.
+class DiskIoPool {
+private:
+	std::vector<pthread_t> _threads;
+	pthread_mutex_t _mutex;
+	pthread_cond_t _wakeup;
+	std::deque<DiskJob*> _queue;
+	std::vector<DiskJob*> _done;
+	bool _stopping;
+	int _notify_fds[2]; // Same fd twice with eventfd
+
+	// Metrics, updated under _mutex
+	size_t _running;
+	unsigned long _submitted;
+	unsigned long _completed;
+	unsigned long _rejected;
+	long long _wait_usec_total; // Time jobs spent queued
+	long long _wait_usec_max;
+
+public:
+	DiskIoPool(size_t threads); // Throws if no thread could be started
+	~DiskIoPool(); // Joins the threads, pending jobs are deleted
+
+	bool submit(DiskJob* job); // False when the queue is full
+	void collect(std::vector<DiskJob*>& done); // Call when the notify fd is readable
+
+	// Getters
+	int getNotifyFd() const;
+	size_t getThreadCount() const;
+	size_t getQueueDepth();   // Waiting plus running
+	unsigned long getSubmitted();
+	unsigned long getCompleted();
+	unsigned long getRejected();
+	long long getWaitTotal(); // Microseconds
+	long long getWaitMax();
+
+private:
+	DiskIoPool(const DiskIoPool& other);
+	DiskIoPool& operator=(const DiskIoPool& other);
+
+	static void* _run(void* pool);
+	void _work();
+	static void _prefetch(const DiskJob& job, std::vector<char>& buffer);
+	static void _prefetchFile(const std::string& path, std::vector<char>& buffer);
+	void _stop();
+};
+
+#endif // DISKIOPOOL_HPP
@@ -0,0 +1,33 @@
+#ifndef EPOLLEVENTLOOP_HPP
+#define EPOLLEVENTLOOP_HPP
+
+#include "EventLoop.hpp"
+
+#ifdef __linux__
+
+#include <sys/epoll.h>
+#include <vector>
+
+// Linux backend: edge-triggered epoll, readiness cost is O(active fds)
+class EpollEventLoop : public EventLoop {
+private:
+	int _epoll_fd;
+	std::vector<struct epoll_event> _ready;
+
+public:
+	EpollEventLoop();
+	~EpollEventLoop();
+
+	bool add(int fd, int events);
+	bool modify(int fd, int events);
+	void remove(int fd);
+	int wait(std::vector<IoEvent>& events, int timeout_ms);
+	const char* getName() const;
+
+private:
+	static unsigned int _toEpoll(int events);
+};
+
+#endif // __linux__
+
+#endif // EPOLLEVENTLOOP_HPP
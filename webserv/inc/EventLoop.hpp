@@ -0,0 +1,57 @@
+#ifndef EVENTLOOP_HPP
+#define EVENTLOOP_HPP
+
+#include <string>
+#include <vector>
+#include <sys/uio.h>
+
+// Interest / readiness flags shared by every backend
+#define EVENT_READ  0x1
+#define EVENT_WRITE 0x2
+#define EVENT_ERROR 0x4
+
+// Completions, only reported by backends that have them
+#define EVENT_ACCEPT 0x8  // result: the accepted fd, or -errno
+#define EVENT_DATA   0x10 // data, result: bytes received, 0 at EOF, or -errno
+#define EVENT_SENT   0x20 // result: bytes sent, or -errno
+
+struct IoEvent {
+	int fd;
+	int events;
+	int result;
+	const char* data; // Valid until the next wait()
+
+	IoEvent() : fd(-1), events(0), result(0), data(NULL) {}
+};
+
+// Readiness notification backend used by the Server.
+// Registration changes are O(1); wait() only reports ready fds.
+// Backends may be edge-triggered, so callers must drain fds until EAGAIN.
+class EventLoop {
+public:
+	virtual ~EventLoop();
+
+	virtual bool add(int fd, int events) = 0;
+	virtual bool modify(int fd, int events) = 0;
+	virtual void remove(int fd) = 0;
+
+	// Fills `events` with ready fds, returns their count (-1 on error)
+	virtual int wait(std::vector<IoEvent>& events, int timeout_ms) = 0;
+
+	virtual const char* getName() const = 0;
+
+	// Completion-based I/O, which only io_uring has: the kernel accepts,
+	// receives and sends, and wait() reports the results. Without it these
+	// return false and the caller does the I/O on readiness itself.
+	virtual bool hasCompletions() const;
+	virtual bool addAcceptor(int listen_fd); // EVENT_ACCEPT per connection
+	virtual bool addReceiver(int fd, int events); // EVENT_DATA in place of EVENT_READ
+	// One send per fd at a time; parts only need to outlive the call,
+	// the bytes they point to must stay put until EVENT_SENT
+	virtual bool send(int fd, const struct iovec* parts, int count);
+
+	// "epoll", "uring", "poll" or empty for the best backend available
+	static EventLoop* create(const std::string& backend);
+};
+
+#endif // EVENTLOOP_HPP
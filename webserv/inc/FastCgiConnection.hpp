@@ -0,0 +1,73 @@
+#ifndef FASTCGICONNECTION_HPP
+#define FASTCGICONNECTION_HPP
+
+#include <string>
+#include <sys/types.h>
+
+// FastCGI record types and limits (FastCGI Specification 1.0)
+#define FCGI_VERSION_1 1
+#define FCGI_BEGIN_REQUEST 1
+#define FCGI_ABORT_REQUEST 2
+#define FCGI_END_REQUEST 3
+#define FCGI_PARAMS 4
+#define FCGI_STDIN 5
+#define FCGI_STDOUT 6
+#define FCGI_STDERR 7
+#define FCGI_RESPONDER 1
+#define FCGI_KEEP_CONN 1
+#define FCGI_HEADER_LEN 8
+#define FCGI_MAX_CONTENT 65535
+
+class CgiHandler;
+
+// One connection to a FastCGI responder. It carries a single request at a
+// time (request id 1) and asks the responder to keep it open afterwards,
+// so the pool can hand it the next request without reconnecting.
+class FastCgiConnection {
+private:
+	int _fd;
+	bool _connecting; // Non-blocking connect() still in progress
+	CgiHandler* _request; // Request in flight, NULL when idle
+
+	// Encoded records waiting to be written
+	std::string _output;
+	size_t _output_offset;
+	bool _input_done; // Empty FCGI_STDIN record queued
+
+	// Received bytes, may end with a partial record
+	std::string _input;
+
+public:
+	FastCgiConnection();
+	~FastCgiConnection();
+
+	bool connect(const std::string& path);
+
+	// Queues BEGIN_REQUEST and PARAMS, the body follows as flush() runs
+	void begin(CgiHandler* request);
+	CgiHandler* release(); // Back to idle, returns the finished request
+
+	// Returns 1 once everything is written, 0 if the socket is full, -1 on error
+	int flush();
+
+	// One read(): appends FCGI_STDOUT content to `out`. Returns 1 at
+	// END_REQUEST, 0 after a read, -1 if it would block, -2 on EOF or error.
+	int receive(std::string& out);
+
+	// Getters
+	int getFd() const;
+	CgiHandler* getRequest() const;
+	bool isIdle() const;
+	bool isConnecting() const;
+	bool hasPendingOutput() const;
+
+private:
+	FastCgiConnection(const FastCgiConnection& other);
+	FastCgiConnection& operator=(const FastCgiConnection& other);
+
+	void _appendRecord(int type, const char* data, size_t length);
+	void _appendParam(std::string& params, const std::string& name, const std::string& value);
+	int _parseRecords(std::string& out);
+};
+
+#endif // FASTCGICONNECTION_HPP
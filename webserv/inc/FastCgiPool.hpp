@@ -0,0 +1,48 @@
+#ifndef FASTCGIPOOL_HPP
+#define FASTCGIPOOL_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+
+class CgiHandler;
+class FastCgiConnection;
+
+// Persistent connections to one fastcgi_pass socket. Requests go to an
+// idle connection, a new one is opened while under the limit, otherwise
+// they wait in FIFO order for a connection to free up.
+class FastCgiPool {
+private:
+	std::string _path;
+	size_t _max_connections;
+	std::vector<FastCgiConnection*> _connections;
+	std::deque<CgiHandler*> _pending;
+
+public:
+	FastCgiPool(const std::string& path, size_t max_connections);
+	~FastCgiPool(); // Closes connections, deletes requests still held
+
+	// Idle connection, or a new one if under the limit. Sets `created` so
+	// the caller can register the new fd. NULL if none is available.
+	FastCgiConnection* acquire(bool& created);
+	void remove(FastCgiConnection* connection); // Closes and deletes it
+	FastCgiConnection* find(const CgiHandler* request) const;
+	FastCgiConnection* getConnection(int fd) const;
+
+	// Requests waiting for a connection
+	void enqueue(CgiHandler* request);
+	CgiHandler* dequeue();
+	bool cancel(CgiHandler* request);
+
+	// Getters
+	const std::string& getPath() const;
+	size_t getConnectionCount() const;
+	bool hasPending() const;
+	void getRequests(std::vector<CgiHandler*>& requests) const; // In flight and waiting
+
+private:
+	FastCgiPool(const FastCgiPool& other);
+	FastCgiPool& operator=(const FastCgiPool& other);
+};
+
+#endif // FASTCGIPOOL_HPP
@@ -0,0 +1,80 @@
+#ifndef FILECACHE_HPP
+#define FILECACHE_HPP
+
+#include <string>
+#include <list>
+#include <map>
+#include <ctime>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "SharedBuffer.hpp"
+
+// A regular file held in memory with the headers describing it
+struct CachedFile {
+	std::string key;  // Path the request resolved to (may be a directory)
+	std::string path; // File actually served (the index for directories)
+	SharedBuffer body; // Shared with responses still being sent
+	std::string content_type;
+	std::string last_modified;
+	std::string etag;
+	std::map<std::string, SharedBuffer> encoded; // Compressed bodies by content coding
+
+	// Identity checked on revalidation
+	dev_t device;
+	ino_t inode;
+	time_t mtime;
+	long mtime_nsec;
+	off_t size;
+	time_t validated_at;
+};
+
+// Bounded LRU cache of small static files. Entries are trusted for
+// `revalidate` seconds, then stat()ed again and dropped if the file was
+// replaced or modified.
+class FileCache {
+private:
+	typedef std::list<CachedFile> EntryList;
+
+	size_t _max_size;      // Total body bytes (compressed variants included), 0 disables the cache
+	size_t _max_file_size; // Larger files are left to sendfile()
+	int _revalidate;
+	size_t _size;
+	EntryList _entries; // Most recently used first
+	std::map<std::string, EntryList::iterator> _index; // key -> entry
+
+	unsigned long _hits;
+	unsigned long _misses;
+	unsigned long _evictions;
+
+public:
+	FileCache(size_t max_size, size_t max_file_size, int revalidate);
+	~FileCache();
+
+	// NULL on a miss. The pointer is valid until the next insert/invalidate.
+	const CachedFile* lookup(const std::string& key);
+	// Reads the file if it fits. NULL if it is too large or unreadable.
+	const CachedFile* insert(const std::string& key, const std::string& path,
+	                         const struct stat& info, const std::string& content_type);
+	void invalidate(const std::string& path); // Entries serving or keyed by path
+	// Keeps a compressed variant next to key's body, NULL if it cannot fit
+	const SharedBuffer* addEncoding(const std::string& key, const std::string& encoding,
+	                                const SharedBuffer& body);
+
+	// Getters
+	bool isEnabled() const;
+	bool contains(const std::string& key) const; // No revalidation, counters untouched
+	size_t getSize() const;
+	size_t getEntryCount() const;
+	unsigned long getHits() const;
+	unsigned long getMisses() const;
+	unsigned long getEvictions() const;
+
+private:
+	FileCache(const FileCache& other);
+	FileCache& operator=(const FileCache& other);
+
+	bool _isCurrent(const CachedFile& entry, const struct stat& info) const;
+	void _erase(EntryList::iterator entry);
+};
+
+#endif // FILECACHE_HPP
@@ -0,0 +1,93 @@
+#ifndef HTTPPARSER_HPP
+#define HTTPPARSER_HPP
+
+#include <string>
+#include <vector>
+
+#define MAX_HEADER_SIZE 16384 // Request line + headers
+
+// Location of a token inside the receive buffer (no copy is made)
+struct StrRef {
+	size_t offset;
+	size_t length;
+
+	StrRef() : offset(0), length(0) {}
+};
+
+struct HeaderRef {
+	StrRef name;
+	StrRef value;
+};
+
+// Resumable byte-level HTTP/1.x request parser.
+// parse() continues from where the previous call stopped, so bytes that
+// were already examined are never scanned again. Tokens are recorded as
+// offsets into the Client's buffer, which must not be modified until the
+// message is consumed (appending is fine). Chunked bodies are decoded in
+// place, so the decoded body always directly follows the headers.
+class HttpParser {
+public:
+	enum Result {
+		INCOMPLETE,
+		COMPLETE,
+		ERROR
+	};
+
+private:
+	int _state;
+	size_t _pos;            // Next byte to examine
+	size_t _token_start;
+	size_t _token_end;      // Excludes trailing whitespace of header values
+
+	StrRef _method;
+	StrRef _uri;
+	StrRef _version;
+	std::vector<HeaderRef> _headers;
+	HeaderRef _current;
+
+	size_t _body_offset;
+	size_t _content_length;
+	size_t _body_skipped;   // Body bytes removed from the buffer (spooled)
+	bool _has_content_length;
+	bool _has_transfer_encoding;
+	bool _chunked;
+
+	// Chunked decoding
+	size_t _decoded_end;    // End of the decoded body in the buffer
+	size_t _chunk_remaining;
+	size_t _trailer_bytes;
+	int _error_status;
+
+public:
+	HttpParser();
+	~HttpParser();
+
+	Result parse(std::string& buffer);
+	void reset();
+	void skipBody(size_t length); // Body bytes moved out of the buffer
+
+	// Getters (valid once headers are complete)
+	bool areHeadersComplete() const;
+	const StrRef& getMethod() const;
+	const StrRef& getUri() const;
+	const StrRef& getVersion() const;
+	const std::vector<HeaderRef>& getHeaders() const;
+	size_t getBodyOffset() const;
+	size_t getContentLength() const; // Decoded so far for chunked bodies
+	bool isChunked() const;
+	size_t getBufferedBodyLength(const std::string& buffer) const; // Not yet skipped
+	size_t getMessageLength() const; // Bytes left in the buffer, valid when COMPLETE
+	int getErrorStatus() const;
+
+	// Helpers over the receive buffer
+	static std::string toString(const std::string& buffer, const StrRef& ref);
+	static bool equalsIgnoreCase(const std::string& buffer, const StrRef& ref, const char* lower);
+
+private:
+	Result _fail(int status);
+	bool _onHeaderComplete(const std::string& buffer);
+	int _onHeadersComplete();
+	Result _parseChunked(std::string& buffer);
+};
+
+#endif // HTTPPARSER_HPP
@@ -9,20 +9,28 @@ public:
 	static const int OK = 200;
 	static const int CREATED = 201;
 	static const int NO_CONTENT = 204;
+	static const int PARTIAL_CONTENT = 206;
 	static const int MOVED_PERMANENTLY = 301;
 	static const int FOUND = 302;
+	static const int NOT_MODIFIED = 304;
 	static const int BAD_REQUEST = 400;
 	static const int FORBIDDEN = 403;
 	static const int NOT_FOUND = 404;
 	static const int METHOD_NOT_ALLOWED = 405;
 	static const int REQUEST_TIMEOUT = 408;
 	static const int PAYLOAD_TOO_LARGE = 413;
+	static const int RANGE_NOT_SATISFIABLE = 416;
+	static const int REQUEST_HEADER_FIELDS_TOO_LARGE = 431;
 	static const int INTERNAL_SERVER_ERROR = 500;
 	static const int NOT_IMPLEMENTED = 501;
+	static const int BAD_GATEWAY = 502;
+	static const int GATEWAY_TIMEOUT = 504;
 	static const int HTTP_VERSION_NOT_SUPPORTED = 505;
 
 	// Get status message
 	static std::string getMessage(int code);
+	// "HTTP/1.1 <code> <message>\r\n", formatted once per code
+	static const std::string& getStatusLine(int code);
 };
 
 #endif // HTTPSTATUS_HPP
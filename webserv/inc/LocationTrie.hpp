@@ -0,0 +1,37 @@
+#ifndef LOCATIONTRIE_HPP
+#define LOCATIONTRIE_HPP
+
+#include <string>
+#include <vector>
+
+// Location prefixes compiled into a trie over path segments, so a lookup
+// walks the URI once instead of testing every location. Matches respect
+// segment boundaries: "/img" covers "/img" and "/img/a.png" but not
+// "/images"; "/img/" only covers what is below it. Nodes refer to
+// locations by index, which keeps the trie valid when ServerConfig is copied.
+class LocationTrie {
+private:
+	struct Node {
+		std::string segment;
+		std::vector<size_t> children; // Node indices, sorted by segment
+		int location;     // "/a/b", or -1
+		int dir_location; // "/a/b/", only when more of the path follows
+	};
+	std::vector<Node> _nodes; // _nodes[0] is the root, "/"
+
+public:
+	LocationTrie();
+	~LocationTrie();
+
+	void insert(const std::string& path, int index); // The first location for a path wins
+	void clear();
+
+	// Getters
+	int find(const std::string& uri) const; // Longest match, -1 if none
+
+private:
+	size_t _child(size_t node, const char* segment, size_t length) const; // 0 if absent
+	size_t _addChild(size_t node, const std::string& segment);
+};
+
+#endif // LOCATIONTRIE_HPP
@@ -0,0 +1,102 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <string>
+#include <map>
+
+#define METRICS_MAX_STATUS 600   // Status codes counted individually, 100 to 599
+#define LATENCY_SUB_BITS 2       // 4 buckets per power of two, each at most 25% wide
+#define LATENCY_MIN_SHIFT 2      // First bucket holds everything up to 4us
+#define LATENCY_MAX_SHIFT 26     // Last bounded bucket ends at 2^26us (~67s)
+#define LATENCY_BUCKETS (((LATENCY_MAX_SHIFT - LATENCY_MIN_SHIFT) << LATENCY_SUB_BITS) + 1)
+
+// Durations in log-linear buckets, as HdrHistogram lays them out:
+// finding a value's bucket is a few bit operations, and the relative
+// error stays the same from microseconds to minutes.
+class LatencyHistogram {
+private:
+	unsigned long _buckets[LATENCY_BUCKETS + 1]; // The extra one is +Inf
+	unsigned long _count;
+	unsigned long long _sum_usec;
+
+public:
+	LatencyHistogram();
+
+	void record(long long usec);
+
+	// Appends the _bucket, _sum and _count series, cumulative as Prometheus expects
+	void write(std::string& out, const std::string& name, const std::string& labels) const;
+
+	static size_t bucketOf(unsigned long long usec);
+	static unsigned long long upperBound(size_t bucket); // Inclusive, microseconds
+};
+
+// Counters of one location, found once per config load (Config::bindMetrics)
+struct LocationMetrics {
+	unsigned long requests;
+	unsigned long responses[5]; // By status class, 1xx to 5xx
+
+	LocationMetrics() : requests(0) {
+		for (size_t i = 0; i < 5; ++i) {
+			responses[i] = 0;
+		}
+	}
+};
+
+// Counters of one worker. Only the event loop thread touches them, so
+// nothing is locked or atomic; with several workers each scrape reports
+// the worker that answered it, identified by webserv_worker_pid.
+class Metrics {
+private:
+	unsigned long _responses[METRICS_MAX_STATUS];
+	std::map<std::string, LocationMetrics> _locations; // By location path
+	unsigned long _accepted;
+	unsigned long _refused; // Over max_connections
+	unsigned long long _bytes_in;
+	unsigned long long _bytes_out; // Of closed connections, write() adds the open ones
+	unsigned long _cgi_started;
+	unsigned long _fastcgi_started;
+	unsigned long _client_timeouts; // Connections closed by a timeout
+	unsigned long _cgi_timeouts;    // Requests answered 504 after cgi_timeout
+
+	LatencyHistogram _parse;   // Parser time spent on a request, over all its reads
+	LatencyHistogram _handler; // Request parsed to response head queued (CGI and aio included)
+	LatencyHistogram _send;    // Response queued to the connection's output drained
+	LatencyHistogram _cgi;     // Request handed to CGI until its output ended
+
+public:
+	Metrics();
+
+	// Node addresses stay valid, locations and clients keep the pointer
+	LocationMetrics* getLocation(const std::string& path);
+
+	void countResponse(int status, LocationMetrics* location);
+	void countAccepted();
+	void countRefused();
+	void addBytesIn(size_t bytes);
+	void addBytesOut(unsigned long long bytes);
+	void countCgi(bool fastcgi);
+	void countTimeout(bool cgi);
+
+	void recordParse(long long usec);
+	void recordHandler(long long usec);
+	void recordSend(long long usec);
+	void recordCgi(long long usec);
+
+	// Prometheus text format (version 0.0.4). bytes_out_open is what open
+	// connections wrote so far; gauges owned by others are added by the caller.
+	void write(std::string& out, unsigned long long bytes_out_open) const;
+
+	static void writeHeader(std::string& out, const char* name, const char* type,
+	                        const char* help);
+	static void writeValue(std::string& out, const char* name, const std::string& labels,
+	                       unsigned long long value);
+	static void writeSeconds(std::string& out, const char* name, const std::string& labels,
+	                         unsigned long long usec);
+
+private:
+	Metrics(const Metrics& other);
+	Metrics& operator=(const Metrics& other);
+};
+
+#endif // METRICS_HPP
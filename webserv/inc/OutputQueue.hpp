@@ -0,0 +1,92 @@
+#ifndef OUTPUTQUEUE_HPP
+#define OUTPUTQUEUE_HPP
+
+#include <string>
+#include <deque>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include "SharedBuffer.hpp"
+
+#define OUTPUT_IOV_MAX 64        // Memory segments gathered per writev()
+#define OUTPUT_COALESCE_SIZE 4096 // Smaller appends join the previous segment
+#define DEFLATE_BLOCK_SIZE 65536 // File bytes compressed per pass
+
+class Deflater;
+class DirectoryListing;
+
+// One piece of a connection's pending output
+struct OutputSegment {
+	enum Type {
+		DATA,   // Owned bytes
+		SHARED, // Cached body, not copied
+		FILE,   // Sent with sendfile()
+		DEFLATE, // File compressed into chunks as the socket drains
+		LISTING  // Directory listing formatted into chunks as the socket drains
+	};
+
+	Type type;
+	std::string data;
+	SharedBuffer shared;
+	int fd;
+	bool owns_fd; // Closed once this segment is sent
+	Deflater* deflater;
+	DirectoryListing* listing;
+	off_t offset; // Into data, shared or the file
+	off_t length; // Bytes left
+
+	OutputSegment() : type(DATA), fd(-1), owns_fd(false), deflater(NULL), listing(NULL),
+	                  offset(0), length(0) {}
+};
+
+// Responses waiting to be written to a client, in order. Memory segments
+// are sent together with writev() and advanced by offset, never erased
+// from the front; file segments go out with sendfile().
+class OutputQueue {
+private:
+	std::deque<OutputSegment> _segments;
+	off_t _size; // Bytes left, file contents included
+	unsigned long long _sent; // Written to the socket since the last clear()
+	size_t _sending; // Front segments the kernel is sending from, see gather()
+
+public:
+	OutputQueue();
+	~OutputQueue(); // Closes owned files
+
+	void append(const std::string& data);
+	void append(const char* data, size_t length);
+	void appendOwned(std::string& data); // Takes data's contents, in a segment of its own
+	void appendShared(const SharedBuffer& buffer);
+	void appendFile(int fd, off_t offset, off_t length, bool owns_fd);
+	void appendDeflate(int fd, off_t offset, off_t length, Deflater* deflater); // Owns both
+	void appendListing(DirectoryListing* listing); // Owns it
+	void clear();
+
+	// 1 when everything is sent, 0 if the socket would block, -1 on errors
+	int flush(int socket_fd);
+
+	// For sends the caller hands to the kernel: the memory segments at the
+	// front, 0 if a file comes first (flush() sends those), -1 on errors.
+	// They are left untouched, nothing is added to them, until sent()
+	// reports how much went out.
+	int gather(struct iovec* parts);
+	void sent(size_t length);
+
+	// Getters
+	bool empty() const;
+	bool isSending() const;
+	off_t getSize() const;
+	unsigned long long getSent() const;
+
+private:
+	OutputQueue(const OutputQueue& other);
+	OutputQueue& operator=(const OutputQueue& other);
+
+	int _gather(struct iovec* parts) const;
+	int _sendFile(int socket_fd, OutputSegment& segment);
+	bool _deflate(OutputSegment& segment);
+	void _list(OutputSegment& segment);
+	void _consume(size_t sent);
+	void _pop();
+};
+
+#endif // OUTPUTQUEUE_HPP
@@ -0,0 +1,31 @@
+#ifndef POLLEVENTLOOP_HPP
+#define POLLEVENTLOOP_HPP
+
+#include "EventLoop.hpp"
+#include <sys/poll.h>
+#include <vector>
+
+// Portable fallback: level-triggered poll() over a dense pollfd array.
+// Slots are found through an fd-indexed table and removed by swapping
+// with the last entry, so registration changes never scan the array.
+class PollEventLoop : public EventLoop {
+private:
+	std::vector<struct pollfd> _fds;
+	std::vector<int> _slots; // fd -> index in _fds, -1 if absent
+
+public:
+	PollEventLoop();
+	~PollEventLoop();
+
+	bool add(int fd, int events);
+	bool modify(int fd, int events);
+	void remove(int fd);
+	int wait(std::vector<IoEvent>& events, int timeout_ms);
+	const char* getName() const;
+
+private:
+	int _slotOf(int fd) const;
+	static short _toPoll(int events);
+};
+
+#endif // POLLEVENTLOOP_HPP
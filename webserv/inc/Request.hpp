@@ -2,44 +2,77 @@
 #define REQUEST_HPP
 
 #include <string>
-#include <map>
+#include "Arena.hpp"
+
+class HttpParser;
+
+// Header copied into the request's arena, name lowercased
+struct RequestHeader {
+	const char* name;
+	size_t name_length;
+	const char* value;
+	size_t value_length;
+};
 
 class Request {
 private:
 	std::string _method;
+	int _method_bit; // METHOD_* of _method, 0 if unknown
 	std::string _uri;
+	std::string _path;  // URI without the query string
+	std::string _query;
 	std::string _version;
-	std::map<std::string, std::string> _headers;
+	Arena _own_arena; // Unused when the caller supplies an arena
+	Arena* _arena;
+	RequestHeader* _headers; // In _arena, one entry per distinct name
+	size_t _header_count;
 	std::string _body;
+	std::string _body_file; // Spooled body, unlinked on destruction unless released
+	size_t _body_length;
 	bool _valid;
 	std::string _error_message;
 
 public:
 	Request();
+	explicit Request(Arena& arena); // Must not be reset while the request is alive
 	~Request();
 
+	void reset(); // Ready for the next request, keeps string capacity
+
 	// Parsing
 	bool parse(const std::string& raw_request);
+	void build(const std::string& buffer, const HttpParser& parser); // From a COMPLETE parser
 
 	// Getters
 	const std::string& getMethod() const;
+	int getMethodBit() const;
 	const std::string& getUri() const;
+	const std::string& getPath() const;
+	const std::string& getQuery() const;
 	const std::string& getVersion() const;
-	const std::map<std::string, std::string>& getHeaders() const;
+	size_t getHeaderCount() const;
+	const RequestHeader& getHeaderAt(size_t index) const;
 	const std::string& getBody() const;
+	bool hasBodyFile() const;
+	const std::string& getBodyFile() const;
+	size_t getBodyLength() const;
 	bool isValid() const;
 	const std::string& getErrorMessage() const;
 
+	// Spooled body (takes ownership of the file)
+	void setBodyFile(const std::string& path);
+	std::string releaseBodyFile();
+
 	// Header lookup
 	std::string getHeader(const std::string& key) const;
 	bool hasHeader(const std::string& key) const;
+	const RequestHeader* findHeader(const char* key) const; // NULL if absent, nothing copied
 
 private:
-	void _parseRequestLine(const std::string& line);
-	void _parseHeaders(const std::string& header_section);
-	std::string _toLower(const std::string& str) const;
-	std::string _trim(const std::string& str) const;
+	Request(const Request& other);
+	Request& operator=(const Request& other);
+
+	const RequestHeader* _findHeader(const char* key, size_t length) const; // Case-insensitive
 };
 
 #endif // REQUEST_HPP
-
@@ -2,14 +2,39 @@
 #define RESPONSE_HPP
 
 #include <string>
-#include <map>
+#include <vector>
+#include <utility>
+#include <sys/types.h>
+#include "SharedBuffer.hpp"
+#include "DirectoryListing.hpp"
+
+// Part of a file-backed body: prefix is sent, then length bytes from offset
+struct FileRange {
+	std::string prefix;
+	off_t offset;
+	off_t length;
+};
 
 class Response {
 private:
 	int _status_code;
-	std::string _status_message;
-	std::map<std::string, std::string> _headers;
+	std::string _status_message; // Empty for the standard reason phrase
+	std::vector<std::pair<std::string, std::string> > _headers; // In insertion order
 	std::string _body;
+	SharedBuffer _shared_body; // Cached body, queued without being copied
+
+	// File-backed body, sent with sendfile() instead of being copied
+	std::string _file_path;
+	std::vector<FileRange> _file_ranges;
+	std::string _file_trailer; // Sent after the last range
+	std::string _file_encoding; // Content coding applied while streaming the file
+	int _file_level;
+
+	// Directory listing formatted as the socket drains, sent chunked
+	ListingOptions _listing;
+
+	// Streamed body: Transfer-Encoding: chunked, more chunks follow build()
+	bool _chunked;
 
 public:
 	Response();
@@ -21,17 +46,42 @@ public:
 	void setStatusMessage(const std::string& message);
 	void setHeader(const std::string& key, const std::string& value);
 	void setBody(const std::string& body);
+	void appendBody(const std::string& data);
+	void setSharedBody(const SharedBuffer& body);
+	void setFileBody(const std::string& path, off_t offset, off_t length);
+	void setFileBody(const std::string& path); // Ranges follow with addFileRange
+	void addFileRange(const std::string& prefix, off_t offset, off_t length);
+	void setFileTrailer(const std::string& trailer);
+	void setFileEncoding(const std::string& encoding, int level); // Sent chunked
+	void setListingBody(const ListingOptions& listing); // Sent chunked
+	void setChunked(bool chunked);
+	void swapBody(std::string& other); // Hands the body over without a copy
 
 	// Getters
 	int getStatusCode() const;
-	const std::string& getStatusMessage() const;
+	std::string getStatusMessage() const;
 	const std::string& getBody() const;
+	bool hasSharedBody() const;
+	const SharedBuffer& getSharedBody() const;
+	bool hasHeader(const std::string& key) const;
+	bool hasFileBody() const;
+	const std::string& getFilePath() const;
+	const std::vector<FileRange>& getFileRanges() const;
+	const std::string& getFileTrailer() const;
+	off_t getFileBodyLength() const;
+	const std::string& getFileEncoding() const;
+	int getFileLevel() const;
+	bool hasListingBody() const;
+	const ListingOptions& getListing() const;
+	bool isChunked() const;
 
-	// Build HTTP response
+	// Serialize: status line and headers only, or the whole response
+	void writeHead(std::string& out) const;
 	std::string build() const;
 
-private:
-	std::string _getDefaultStatusMessage(int code) const;
+	// Chunked transfer coding (RFC 9112 7.1)
+	static std::string encodeChunk(const char* data, size_t length);
+	static std::string lastChunk();
 };
 
 #endif // RESPONSE_HPP
@@ -2,25 +2,61 @@
 #define SERVER_HPP
 
 #include <string>
-#include <sys/poll.h>
 #include <vector>
 #include <map>
+#include <ctime>
+#include <sys/types.h>
+#include "Metrics.hpp"
 
 #define LISTEN_CONN 128
 #define BUFFER_SIZE 8192
+#define OUTPUT_HIGH_WATER 1048576 // Stop reading a client with this much output queued
+#define OUTPUT_LOW_WATER 65536     // ...until its queue drains below this
+#define CGI_OUTPUT_HIGH_WATER 262144 // Stop reading a CGI while the client lags this far behind
 
+class CgiHandler;
 class Client;
+class ClientPool;
+class FastCgiConnection;
+class FileCache;
+class DirectoryCache;
+class TimerWheel;
+class VirtualHosts;
+class FastCgiPool;
 class Config;
+class ConfigSnapshot;
+class DiskIoPool;
+class AccessLog;
+struct AccessLogEntry;
+class EventLoop;
 class Request;
 class Response;
+struct CachedFile;
+struct ListingOptions;
+struct LocationConfig;
+struct ServerConfig;
 
 class Server {
 private:
-	Config* _config;
-	int _server_fd;
-	std::vector<struct pollfd> _poll_fds;
+	std::string _config_file;
+	ConfigSnapshot* _snapshot; // Used by new requests, clients may still hold older ones
+	std::map<int, const VirtualHosts*> _listeners; // Listen fd -> sites bound to it in _snapshot
+	EventLoop* _loop;
+	FileCache* _file_cache;
+	DirectoryCache* _directory_cache; // autoindex snapshots
+	DiskIoPool* _disk_pool; // Started by the first aio request
+	TimerWheel* _timers; // Client deadlines, keyed by fd
+	bool _draining; // Listeners closed, exit once clients are done
 	std::map<int, Client*> _clients; // fd -> Client*
-	std::map<int, std::string> _output_buffers; // Output buffers per client fd
+	ClientPool* _client_pool; // Recycles Client objects, caps them at max_connections
+	std::string _head; // Scratch for serializing response heads, keeps its capacity
+	std::map<int, CgiHandler*> _cgi_fds; // CGI pipe fd -> handler
+	std::map<pid_t, CgiHandler*> _cgi_processes; // Owns every running handler
+	std::map<std::string, FastCgiPool*> _fastcgi_pools; // fastcgi_pass socket -> pool
+	std::map<int, FastCgiPool*> _fastcgi_fds; // FastCGI connection fd -> its pool
+	int _signal_pipe[2]; // SIGCHLD self-pipe, read end is in the event loop
+	Metrics _metrics;
+	std::map<std::string, AccessLog*> _access_logs; // By access_log value, NULL if it failed to open
 
 public:
 	Server(const std::string& config_file);
@@ -30,30 +66,127 @@ public:
 
 private:
 	// Socket setup
-	void _setupSocket();
-	void _acceptNewClient();
+	void _setupListeners();
+	int _openListener(const std::string& host, int port);
+	void _closeListeners();
+	void _acceptNewClients(int listen_fd);
+	Client* _addClient(int listen_fd, int client_fd);
 	void _handleClientData(int client_fd);
+	bool _receiveClientData(int client_fd, const char* data, ssize_t length);
 	void _setNonBlocking(int fd);
+	void _installSignalHandlers();
+	void _setupSignalPipe();
+	void _beginDrain();
+	void _reload();
+	void _releaseSnapshot(ConfigSnapshot* snapshot);
 
 	// Request processing
 	void _processClientRequest(int client_fd);
-	void _handleRequest(int client_fd, Request& request);
-	Response _buildResponse(const Request& request);
+	void _selectServer(Client* client);
+	void _handleRequest(int client_fd, Request& request, bool prefetched = false);
+	bool _prepareRequestBody(Client* client);
+	Response _buildResponse(Request& request, const ServerConfig& server_config);
+	Response _serveFile(const Request& request, const LocationConfig& location,
+	                    const std::string& key, const std::string& path, const struct stat& info);
+	Response _serveCachedFile(const Request& request, const LocationConfig& location,
+	                          const CachedFile& file);
+	bool _servePrecompressed(const Request& request, const LocationConfig& location,
+	                         const std::string& path, const std::string& content_type,
+	                         Response& response);
+	Response _sendCachedFile(const Request& request, const LocationConfig& location,
+	                         const CachedFile& file, const std::string& encoding,
+	                         bool precompressed);
+	Response _sendFile(const Request& request, const LocationConfig& location,
+	                   const std::string& path, const struct stat& info,
+	                   const std::string& content_type, const std::string& encoding,
+	                   bool compress);
+	std::string _negotiateEncoding(const Request& request, const LocationConfig& location,
+	                               const std::string& content_type, off_t size);
+	std::string _encodedEtag(const std::string& etag, const std::string& encoding);
+	void _setEncodingHeaders(Response& response, const LocationConfig& location,
+	                         const std::string& content_type, const std::string& encoding);
+	bool _isNotModified(const Request& request, const LocationConfig& location,
+	                    const std::string& etag, time_t mtime);
+	bool _isRangeFresh(const Request& request, const std::string& etag, time_t mtime);
+	bool _setRangeBody(Response& response, const Request& request, const std::string& etag,
+	                   time_t mtime, off_t size, const std::string& content_type,
+	                   const std::string* body, const std::string& path);
+	void _setCacheHeaders(Response& response, const LocationConfig& location,
+	                      const std::string& etag, const std::string& last_modified);
+	Response _serveDirectoryListing(const Request& request, const std::string& path,
+	                                const struct stat& info);
+	void _parseListingQuery(const std::string& query, ListingOptions& listing);
+	Response _handleUpload(Request& request, const LocationConfig& location);
+	Response _handleDelete(const Request& request, const LocationConfig& location);
+	bool _keepAlive(Client* client, const Request& request);
+	void _setConnectionHeaders(Client* client, Response& response);
+
+	// Metrics
+	Response _buildMetricsResponse(const Request& request, const LocationConfig& location);
+	void _countResponse(Client* client, int status, off_t bytes);
+	void _recordDrained(Client* client);
+
+	// Access log
+	void _captureLogEntry(AccessLogEntry& entry, const Request& request);
+	AccessLog* _getAccessLog(const ServerConfig& server_config);
+	void _lookupRemoteAddress(Client* client);
+	void _reopenAccessLogs();
+
+	// Disk I/O threads
+	bool _startPrefetch(Client* client, const Request& request, const LocationConfig* location);
+	void _handleDiskCompletions();
 
 	// CGI handling
-	void _handleCgiRequest(int client_fd, const Request& request);
+	bool _isCgiRequest(const Request& request, const LocationConfig* location,
+	                   std::string& interpreter);
+	void _handleCgiRequest(int client_fd, Request& request, const LocationConfig& location,
+	                       const std::string& interpreter);
+	void _handleCgiEvent(CgiHandler* cgi, int fd);
+	void _readCgiOutput(CgiHandler* cgi);
+	bool _forwardCgiOutput(CgiHandler* cgi, std::string& data);
+	void _finishCgiOutput(CgiHandler* cgi, bool failed);
+	void _abortCgi(CgiHandler* cgi, int status);
+	void _stopCgi(CgiHandler* cgi);
+	void _pauseCgiOutput(CgiHandler* cgi);
+	void _resumeCgiOutput(CgiHandler* cgi);
+	void _closeCgiInput(CgiHandler* cgi);
+	void _closeCgiOutput(CgiHandler* cgi);
+	void _reapCgiProcesses();
+	void _releaseCgi(CgiHandler* cgi);
+
+	// FastCGI
+	FastCgiPool* _getFastCgiPool(const LocationConfig& location);
+	void _dispatchFastCgi(FastCgiPool* pool);
+	void _handleFastCgiEvent(FastCgiPool* pool, int fd, int ready);
+	void _flushFastCgi(FastCgiPool* pool, FastCgiConnection* connection);
+	void _readFastCgi(FastCgiPool* pool, FastCgiConnection* connection);
+	void _updateFastCgiInterest(FastCgiConnection* connection);
+	void _failFastCgi(FastCgiPool* pool, FastCgiConnection* connection);
+	void _closeFastCgi(FastCgiPool* pool, FastCgiConnection* connection);
 
 	// Output handling
 	void _sendToClient(int client_fd, const std::string& data);
+	void _sendResponse(int client_fd, Response& response, int file_fd = -1);
+	void _startOutput(Client* client, bool was_empty);
 	void _flushClientBuffer(int client_fd);
+	int _writeOutput(Client* client);
+	void _finishSend(int client_fd, int result);
+	void _setWriteInterest(Client* client, bool enabled);
+	void _setReadInterest(Client* client, bool enabled);
+	void _resumeReading(Client* client);
+	void _updateClientEvents(Client* client);
 
 	// Client management
 	void _removeClient(int client_fd);
 	void _cleanupTimedOutClients();
+	void _scheduleTimeout(Client* client);
+	void _expireCgi(Client* client, time_t now);
+	int _getTimeout(Client* client);
 
 	// Helper methods
-	std::string _readFile(const std::string& path);
+	bool _isIdle(Client* client);
 	std::string _getContentType(const std::string& path);
+	bool _isCompressible(const std::string& content_type);
 	bool _fileExists(const std::string& path);
 };
 
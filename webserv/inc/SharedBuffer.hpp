@@ -0,0 +1,33 @@
+#ifndef SHAREDBUFFER_HPP
+#define SHAREDBUFFER_HPP
+
+#include <string>
+
+// Immutable bytes with a reference count. Copies share the same storage,
+// so a cached file body can sit in several output queues and outlive its
+// eviction from the cache.
+class SharedBuffer {
+private:
+	struct Block {
+		std::string data;
+		int references;
+	};
+	Block* _block; // NULL when empty
+
+public:
+	SharedBuffer();
+	explicit SharedBuffer(std::string& data); // Takes data's contents
+	SharedBuffer(const SharedBuffer& other);
+	SharedBuffer& operator=(const SharedBuffer& other);
+	~SharedBuffer();
+
+	// Getters
+	bool isNull() const;
+	const std::string& getData() const;
+	size_t getLength() const;
+
+private:
+	void _release();
+};
+
+#endif // SHAREDBUFFER_HPP
@@ -0,0 +1,34 @@
+#ifndef SUPERVISOR_HPP
+#define SUPERVISOR_HPP
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include <ctime>
+
+// Master process for the multi-worker model. Forks one independent
+// Server per worker (each with its own SO_REUSEPORT listener), restarts
+// workers that die and forwards SIGHUP (reload), SIGTERM and SIGQUIT
+// (graceful stop) to all of them.
+class Supervisor {
+private:
+	std::string _config_file;
+	int _worker_count;
+	std::vector<pid_t> _workers;
+	std::vector<time_t> _started_at;
+
+public:
+	Supervisor(const std::string& config_file, int worker_count);
+	~Supervisor();
+
+	int run(); // Returns the process exit status
+
+private:
+	void _installSignalHandlers();
+	void _spawnWorker(size_t slot);
+	void _reapWorkers(bool respawn);
+	void _broadcast(int sig);
+	bool _hasLiveWorkers() const;
+};
+
+#endif // SUPERVISOR_HPP
@@ -0,0 +1,43 @@
+#ifndef TIMERWHEEL_HPP
+#define TIMERWHEEL_HPP
+
+#include <vector>
+#include <ctime>
+
+#define TIMER_WHEEL_SLOTS 1024 // One per second, longer deadlines wrap around
+
+// Intrusive list node, embedded in the object being timed
+struct TimerNode {
+	TimerNode* prev;
+	TimerNode* next;
+	time_t deadline;
+	int id; // Handed back by expire()
+
+	TimerNode() : prev(NULL), next(NULL), deadline(0), id(-1) {}
+	bool isScheduled() const { return prev != NULL; }
+};
+
+// Hashed timer wheel with one second resolution. Scheduling and
+// cancelling are O(1); expire() only visits the slots for the seconds
+// that elapsed since the last call, so connections that are nowhere near
+// their deadline are never looked at.
+class TimerWheel {
+private:
+	std::vector<TimerNode> _slots; // List heads, node i holds deadlines i mod size
+	time_t _current;               // Last second expire() went through
+
+public:
+	TimerWheel();
+	~TimerWheel();
+
+	void schedule(TimerNode* node, time_t deadline); // Reschedules if already set
+	void cancel(TimerNode* node);
+	void expire(time_t now, std::vector<int>& expired); // Unlinks and reports due timers
+
+private:
+	TimerWheel(const TimerWheel& other);
+	TimerWheel& operator=(const TimerWheel& other);
+	void _unlink(TimerNode* node);
+};
+
+#endif // TIMERWHEEL_HPP
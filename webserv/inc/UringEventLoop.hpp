@@ -0,0 +1,137 @@
+#ifndef URINGEVENTLOOP_HPP
+#define URINGEVENTLOOP_HPP
+
+#include "EventLoop.hpp"
+
+#ifdef __linux__
+
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+#include <vector>
+
+#define URING_BUFFER_COUNT 256  // Provided receive buffers, a power of two
+#define URING_BUFFER_SIZE 8192  // Bytes per receive, as BUFFER_SIZE for recv()
+#define URING_SEND_PARTS 64     // iovecs per send
+
+// Linux 5.11+ backend: every fd is watched by a multishot IORING_OP_POLL_ADD.
+// Registration changes are only recorded; wait() turns them into
+// submissions and collects completions in the same io_uring_enter(), so
+// a loop iteration costs one syscall however many fds changed interest,
+// and several changes to one fd cost a single re-arm. Completions arrive
+// per wakeup, which makes it edge-triggered. Talks to the kernel
+// directly, liburing is not required.
+//
+// On 6.0+ it also does the I/O of sockets the server hands it: listeners
+// get a multishot accept, clients a multishot recv into a ring of
+// provided buffers, and their sends are queued with everything else. The
+// whole request/response cycle of a connection then costs no syscall of
+// its own, only its share of the one io_uring_enter() per iteration.
+class UringEventLoop : public EventLoop {
+private:
+	// What a request is, kept in user_data next to the fd
+	enum RequestKind {
+		POLL,
+		ACCEPT,
+		RECEIVE,
+		SEND
+	};
+
+	// A send's arguments, which the kernel reads when it is submitted
+	struct SendState {
+		struct msghdr message;
+		struct iovec parts[URING_SEND_PARTS];
+	};
+
+	struct Registration {
+		unsigned long long user_data; // Of the armed poll or accept, 0 if none
+		unsigned long long receive_data; // Of the armed multishot recv, 0 if none
+		unsigned long long send_data; // Of the send in flight, 0 if none
+		int events;
+		bool registered;
+		bool acceptor; // Accepted by the kernel, no poll
+		bool receiver; // EVENT_READ is served by a multishot recv
+		bool receive_cancelled; // Its recv is ending, the last completion is still due
+		bool dirty; // Listed in _dirty, to be re-armed by wait()
+		int reported; // Index of its readiness event in the events being filled, or -1
+		int first_event; // Index of its first event in the last batch, or -1
+		SendState* send; // Allocated on the first send
+	};
+
+	int _ring_fd;
+	bool _multishot; // Cleared if the kernel rejects IORING_POLL_ADD_MULTI
+	bool _completions; // Multishot accept and recv, provided buffers (6.0+)
+
+	// Submission queue
+	void* _sq_ring;
+	size_t _sq_ring_size;
+	unsigned* _sq_head;
+	unsigned* _sq_tail;
+	unsigned _sq_mask;
+	unsigned* _sq_array;
+	struct io_uring_sqe* _sqes;
+	size_t _sqes_size;
+	unsigned _sq_pending; // Queued but not yet submitted
+
+	// Completion queue, shares _sq_ring when the kernel allows it
+	void* _cq_ring;
+	size_t _cq_ring_size;
+	unsigned* _cq_head;
+	unsigned* _cq_tail;
+	unsigned _cq_mask;
+	struct io_uring_cqe* _cqes;
+
+	// Provided buffers the kernel receives into. Those handed out with a
+	// batch go back at the start of the next wait().
+	struct io_uring_buf_ring* _buffer_ring;
+	char* _buffers;
+	unsigned short _buffer_tail;
+	std::vector<unsigned short> _used_buffers;
+
+	std::vector<Registration> _registrations; // Indexed by fd
+	std::vector<int> _dirty; // Interest changed since the last wait()
+	std::vector<IoEvent>* _batch; // Filled by the last wait()
+	unsigned _sequence; // Makes each request's user_data unique
+
+public:
+	UringEventLoop(); // Throws when io_uring is unavailable
+	~UringEventLoop();
+
+	bool add(int fd, int events);
+	bool modify(int fd, int events);
+	void remove(int fd);
+	int wait(std::vector<IoEvent>& events, int timeout_ms);
+	const char* getName() const;
+
+	bool hasCompletions() const;
+	bool addAcceptor(int listen_fd);
+	bool addReceiver(int fd, int events);
+	bool send(int fd, const struct iovec* parts, int count);
+
+private:
+	UringEventLoop(const UringEventLoop& other);
+	UringEventLoop& operator=(const UringEventLoop& other);
+
+	bool _register(int fd, int events);
+	void _sync(int fd);
+	void _arm(int fd, int events);
+	void _armAccept(int fd);
+	void _armReceive(int fd);
+	void _markDirty(int fd);
+	bool _isRegistered(int fd) const;
+	void _cancel(unsigned long long user_data);
+	void _cancelRequest(unsigned long long user_data);
+	unsigned long long _nextUserData(int fd, RequestKind kind);
+	struct io_uring_sqe* _getSqe();
+	int _enter(unsigned to_submit, unsigned min_complete, int timeout_ms);
+	void _complete(std::vector<IoEvent>& events, const struct io_uring_cqe& cqe);
+	void _report(std::vector<IoEvent>& events, int fd, int ready);
+	void _push(std::vector<IoEvent>& events, int fd, int flags, int result, const char* data);
+	bool _setupBuffers();
+	void _provideBuffer(unsigned short id);
+	void _unmap();
+	static unsigned _toPoll(int events);
+};
+
+#endif // __linux__
+
+#endif // URINGEVENTLOOP_HPP
@@ -3,7 +3,21 @@
 
 #include <string>
 #include <vector>
+#include <utility>
 #include <sstream>
+#include <ctime>
+#include <sys/types.h>
+
+// Request methods as bits, so a location's method list is one mask
+#define METHOD_GET     0x001
+#define METHOD_HEAD    0x002
+#define METHOD_POST    0x004
+#define METHOD_PUT     0x008
+#define METHOD_DELETE  0x010
+#define METHOD_OPTIONS 0x020
+#define METHOD_PATCH   0x040
+#define METHOD_CONNECT 0x080
+#define METHOD_TRACE   0x100
 
 class Utils {
 public:
@@ -13,6 +27,7 @@ public:
 	static std::vector<std::string> split(const std::string& str, char delimiter);
 	static std::string intToString(int value);
 	static int stringToInt(const std::string& str);
+	static void appendNumber(std::string& out, unsigned long long value, int base = 10);
 
 	// File utilities
 	static bool fileExists(const std::string& path);
@@ -24,6 +39,19 @@ public:
 	static std::string getFileExtension(const std::string& path);
 	static std::string joinPath(const std::string& dir, const std::string& file);
 	static std::string normalizePath(const std::string& path);
+
+	// HTTP utilities
+	static std::string httpDate(time_t time); // IMF-fixdate (RFC 9110 5.6.7)
+	static bool parseHttpDate(const std::string& value, time_t& time);
+	static std::string makeEtag(ino_t inode, off_t size, time_t mtime);
+	static bool etagMatches(const std::string& list, const std::string& etag);
+	static bool acceptsEncoding(const std::string& list, const std::string& coding);
+	static int parseRange(const std::string& value, off_t size,
+	                      std::vector<std::pair<off_t, off_t> >& ranges);
+	static int methodBit(const std::string& method); // 0 for unknown methods
+
+	// Time utilities
+	static long long monotonicUsec(); // Microseconds, for measuring intervals
 };
 
 #endif // UTILS_HPP
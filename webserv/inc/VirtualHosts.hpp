@@ -0,0 +1,43 @@
+#ifndef VIRTUALHOSTS_HPP
+#define VIRTUALHOSTS_HPP
+
+#include <string>
+#include <vector>
+
+struct ServerConfig;
+
+// Server blocks sharing one listen socket, selected by the Host header.
+// Names are hashed into buckets (there is no unordered_map in C++98), so
+// finding a site costs the same however many are configured. A request
+// for an unknown name goes to the first block listening there.
+class VirtualHosts {
+private:
+	struct Entry {
+		std::string name; // Lowercase
+		const ServerConfig* server;
+	};
+	std::vector<std::vector<Entry> > _buckets;
+	size_t _count;
+	const ServerConfig* _default;
+	std::string _host; // Address the listen socket is bound to
+	int _port;
+
+public:
+	VirtualHosts(const std::string& host, int port);
+	~VirtualHosts();
+
+	void add(const ServerConfig* server); // The first one added is the default
+
+	// Getters
+	const ServerConfig* find(const char* host, size_t length) const; // Port and case ignored
+	const ServerConfig* getDefault() const;
+	const std::string& getHost() const;
+	int getPort() const;
+
+private:
+	void _insert(const std::string& name, const ServerConfig* server);
+	void _grow();
+	static size_t _hash(const char* data, size_t length);
+};
+
+#endif // VIRTUALHOSTS_HPP
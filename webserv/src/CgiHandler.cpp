@@ -1,47 +1,73 @@
 #include "CgiHandler.hpp"
 #include "Request.hpp"
-#include "Response.hpp"
 #include "Config.hpp"
+#include "Utils.hpp"
 
 #include <unistd.h>
-#include <sys/wait.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <cerrno>
 #include <cstring>
 #include <cstdlib>
+#include <cctype>
 #include <sstream>
 #include <vector>
 
+#define CGI_IO_CHUNK 65536
+
 CgiHandler::CgiHandler(const std::string& cgi_path, const std::string& script_path,
-                       const Request& request, const LocationConfig* location)
-	: _cgi_path(cgi_path), _script_path(script_path), _request(request) {
-	(void)location; // Suppress unused parameter warning
+                       Request& request, const LocationConfig* location,
+                       const ServerConfig& server, int client_fd)
+	: _cgi_path(cgi_path), _script_path(script_path), _protocol(request.getVersion()),
+	  _client_fd(client_fd),
+	  _input_offset(0), _body_fd(-1), _pid(-1), _stdin_fd(-1), _stdout_fd(-1),
+	  _started_at(time(NULL)), _received_at(Utils::monotonicUsec()), _exited(false),
+	  _headers_done(false), _buffer_output(false), _output_paused(false) {
+	if (location)
+		_fastcgi_pass = location->fastcgi_pass;
+	_buildEnv(request, server);
+
+	// The handler outlives the Request, so it takes over the body
+	if (request.hasBodyFile()) {
+		_body_file = request.releaseBodyFile();
+		_body_fd = open(_body_file.c_str(), O_RDONLY | O_CLOEXEC);
+	} else {
+		_input = request.getBody();
+	}
 }
 
-CgiHandler::~CgiHandler() {}
+CgiHandler::~CgiHandler() {
+	closeInput();
+	closeOutput();
+	if (_body_fd != -1)
+		close(_body_fd);
+	if (!_body_file.empty())
+		unlink(_body_file.c_str());
+}
 
-bool CgiHandler::execute(Response& response) {
+bool CgiHandler::start() {
 	int pipe_in[2];
 	int pipe_out[2];
 
-	if (pipe(pipe_in) < 0 || pipe(pipe_out) < 0) {
-		response.setStatus(500);
-		response.setBody("<html><body><h1>500 Internal Server Error</h1></body></html>");
-		response.setHeader("Content-Type", "text/html");
+	if (pipe(pipe_in) < 0) {
+		return false;
+	}
+	if (pipe(pipe_out) < 0) {
+		close(pipe_in[0]);
+		close(pipe_in[1]);
 		return false;
 	}
 
-	pid_t pid = fork();
-	if (pid < 0) {
+	_pid = fork();
+	if (_pid < 0) {
 		close(pipe_in[0]);
 		close(pipe_in[1]);
 		close(pipe_out[0]);
 		close(pipe_out[1]);
-		response.setStatus(500);
-		response.setBody("<html><body><h1>500 Internal Server Error</h1></body></html>");
-		response.setHeader("Content-Type", "text/html");
 		return false;
 	}
 
-	if (pid == 0) {
+	if (_pid == 0) {
 		// Child process
 		close(pipe_in[1]);
 		close(pipe_out[0]);
@@ -52,139 +78,266 @@ bool CgiHandler::execute(Response& response) {
 		close(pipe_in[0]);
 		close(pipe_out[1]);
 
-		char** env = _buildEnv();
+		// Run from the script's directory so relative paths work
+		std::string script = _script_path;
+		size_t slash = script.find_last_of('/');
+		if (slash != std::string::npos) {
+			if (chdir(script.substr(0, slash + 1).c_str()) == 0)
+				script = script.substr(slash + 1);
+		}
+
+		std::vector<char*> env;
+		for (size_t i = 0; i < _env.size(); ++i) {
+			env.push_back(const_cast<char*>(_env[i].c_str()));
+		}
+		env.push_back(NULL);
+
 		char* argv[] = { const_cast<char*>(_cgi_path.c_str()),
-		                 const_cast<char*>(_script_path.c_str()), NULL };
+		                 const_cast<char*>(script.c_str()), NULL };
 
-		execve(_cgi_path.c_str(), argv, env);
+		execve(_cgi_path.c_str(), argv, &env[0]);
 
 		// If execve fails
-		_freeEnv(env);
-		exit(1);
+		_exit(1);
 	}
 
 	// Parent process
 	close(pipe_in[0]);
 	close(pipe_out[1]);
+	_stdin_fd = pipe_in[1];
+	_stdout_fd = pipe_out[0];
 
-	// Write request body to CGI
-	const std::string& body = _request.getBody();
-	if (!body.empty()) {
-		write(pipe_in[1], body.c_str(), body.length());
+	int fds[2] = { _stdin_fd, _stdout_fd };
+	for (int i = 0; i < 2; ++i) {
+		fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL, 0) | O_NONBLOCK);
+		fcntl(fds[i], F_SETFD, FD_CLOEXEC);
 	}
-	close(pipe_in[1]);
+	_started_at = time(NULL);
+	return true;
+}
+
+int CgiHandler::writeInput() {
+	while (true) {
+		if (!_fillInput()) {
+			return -1;
+		}
+		if (_input_offset == _input.length()) {
+			return 1;
+		}
 
-	// Read CGI output
-	std::string cgi_output;
-	char buffer[4096];
-	ssize_t bytes_read;
+		ssize_t written = write(_stdin_fd, _input.data() + _input_offset,
+		                        _input.length() - _input_offset);
+		if (written > 0) {
+			_input_offset += written;
+		} else if (written < 0 && errno == EINTR) {
+			continue;
+		} else if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			return 0;
+		} else {
+			return -1; // EPIPE: the script does not read its input
+		}
+	}
+}
 
-	while ((bytes_read = read(pipe_out[0], buffer, sizeof(buffer) - 1)) > 0) {
-		buffer[bytes_read] = '\0';
-		cgi_output += buffer;
+bool CgiHandler::nextInput(std::string& chunk, size_t max_length) {
+	if (!_fillInput()) {
+		return false;
 	}
-	close(pipe_out[0]);
+	chunk = _input.substr(_input_offset, max_length);
+	_input_offset += chunk.length();
+	return true;
+}
 
-	// Wait for child process
-	int status;
-	waitpid(pid, &status, 0);
+void CgiHandler::closeInput() {
+	if (_stdin_fd != -1)
+		close(_stdin_fd);
+	_stdin_fd = -1;
+}
 
-	if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
-		// Parse CGI output (headers + body)
-		size_t header_end = cgi_output.find("\r\n\r\n");
-		if (header_end == std::string::npos) {
-			header_end = cgi_output.find("\n\n");
-			if (header_end != std::string::npos) {
-				header_end += 1; // For \n\n
-			}
-		} else {
-			header_end += 2; // For \r\n\r\n
-		}
+ssize_t CgiHandler::readOutput(std::string& out) {
+	char buffer[CGI_IO_CHUNK];
 
-		if (header_end != std::string::npos) {
-			std::string headers = cgi_output.substr(0, header_end);
-			std::string body = cgi_output.substr(header_end + 2);
-
-			// Parse CGI headers
-			std::istringstream header_stream(headers);
-			std::string line;
-			while (std::getline(header_stream, line)) {
-				if (line.empty() || line == "\r") continue;
-
-				size_t colon = line.find(':');
-				if (colon != std::string::npos) {
-					std::string key = line.substr(0, colon);
-					std::string value = line.substr(colon + 1);
-
-					// Trim whitespace
-					while (!value.empty() && (value[0] == ' ' || value[0] == '\t')) {
-						value = value.substr(1);
-					}
-					while (!value.empty() && (value[value.length()-1] == '\r' || value[value.length()-1] == '\n')) {
-						value = value.substr(0, value.length() - 1);
-					}
-
-					response.setHeader(key, value);
-				}
-			}
-
-			response.setStatus(200);
-			response.setBody(body);
-		} else {
-			response.setStatus(200);
-			response.setBody(cgi_output);
-			response.setHeader("Content-Type", "text/html");
+	while (true) {
+		ssize_t bytes = read(_stdout_fd, buffer, sizeof(buffer));
+		if (bytes > 0) {
+			out.append(buffer, bytes);
+			return bytes;
 		}
-		return true;
+		if (bytes == 0) {
+			return 0;
+		}
+		if (errno == EINTR) {
+			continue;
+		}
+		return (errno == EAGAIN || errno == EWOULDBLOCK) ? -1 : -2;
 	}
+}
 
-	response.setStatus(500);
-	response.setBody("<html><body><h1>500 CGI Error</h1></body></html>");
-	response.setHeader("Content-Type", "text/html");
-	return false;
+void CgiHandler::closeOutput() {
+	if (_stdout_fd != -1)
+		close(_stdout_fd);
+	_stdout_fd = -1;
 }
 
-char** CgiHandler::_buildEnv() const {
-	std::vector<std::string> env_strings;
+int CgiHandler::parseHeaders(std::string& data) {
+	_header_buffer += data;
+	data.clear();
+
+	// Scripts often use bare LF line endings
+	size_t header_end = _header_buffer.find("\r\n\r\n");
+	size_t separator = 4;
+	size_t lf_end = _header_buffer.find("\n\n");
+	if (lf_end != std::string::npos && (header_end == std::string::npos || lf_end < header_end)) {
+		header_end = lf_end;
+		separator = 2;
+	}
+	if (header_end == std::string::npos) {
+		return _header_buffer.length() > CGI_MAX_HEADER_SIZE ? -1 : 0;
+	}
+	if (header_end > CGI_MAX_HEADER_SIZE) {
+		return -1;
+	}
 
-	// Required CGI environment variables
-	env_strings.push_back("REQUEST_METHOD=" + _request.getMethod());
-	env_strings.push_back("SCRIPT_FILENAME=" + _script_path);
-	env_strings.push_back("QUERY_STRING="); // TODO: Parse query string from URI
-	env_strings.push_back("CONTENT_TYPE=" + _request.getHeader("Content-Type"));
+	std::string headers = _header_buffer.substr(0, header_end);
+	data = _header_buffer.substr(header_end + separator);
+	_header_buffer.clear();
+	_headers_done = true;
+
+	// Parse CGI headers
+	int status = 200;
+	bool has_location = false;
+	std::istringstream header_stream(headers);
+	std::string line;
+	while (std::getline(header_stream, line)) {
+		if (!line.empty() && line[line.length() - 1] == '\r')
+			line.erase(line.length() - 1);
+
+		size_t colon = line.find(':');
+		if (colon == std::string::npos)
+			continue;
+
+		std::string key = line.substr(0, colon);
+		std::string value = line.substr(colon + 1);
+		while (!value.empty() && (value[0] == ' ' || value[0] == '\t'))
+			value.erase(0, 1);
+
+		std::string lower_key = key;
+		for (size_t i = 0; i < lower_key.length(); ++i)
+			lower_key[i] = std::tolower(lower_key[i]);
+
+		// RFC 3875 6.3: Status is a CGI field, not an HTTP header
+		if (lower_key == "status") {
+			status = std::atoi(value.c_str());
+			continue;
+		}
+		// Canonical names, the Response looks these up verbatim
+		if (lower_key == "content-type")
+			key = "Content-Type";
+		else if (lower_key == "content-length")
+			key = "Content-Length";
+		else if (lower_key == "location") {
+			key = "Location";
+			has_location = true;
+		}
+		_response.setHeader(key, value);
+	}
 
-	std::ostringstream len;
-	len << _request.getBody().length();
-	env_strings.push_back("CONTENT_LENGTH=" + len.str());
+	if (status < 100 || status > 599)
+		status = 502;
+	if (has_location && status == 200)
+		status = 302;
+	_response.setStatus(status);
+	return 1;
+}
 
-	env_strings.push_back("SERVER_PROTOCOL=" + _request.getVersion());
-	env_strings.push_back("GATEWAY_INTERFACE=CGI/1.1");
-	env_strings.push_back("SERVER_SOFTWARE=webserv/1.0");
-	env_strings.push_back("REDIRECT_STATUS=200");
+void CgiHandler::kill() {
+	if (_pid > 0 && !_exited)
+		::kill(_pid, SIGKILL);
+}
 
-	// Allocate environment array
-	char** env = new char*[env_strings.size() + 1];
-	for (size_t i = 0; i < env_strings.size(); ++i) {
-		env[i] = new char[env_strings[i].length() + 1];
-		std::strcpy(env[i], env_strings[i].c_str());
-	}
-	env[env_strings.size()] = NULL;
+void CgiHandler::markExited() {
+	_exited = true;
+}
 
-	return env;
+void CgiHandler::setOutputBuffered(bool buffered) {
+	_buffer_output = buffered;
 }
 
-void CgiHandler::_freeEnv(char** env) const {
-	for (size_t i = 0; env[i] != NULL; ++i) {
-		delete[] env[i];
-	}
-	delete[] env;
+void CgiHandler::setOutputPaused(bool paused) {
+	_output_paused = paused;
 }
 
-std::string CgiHandler::_getCgiExtension() const {
-	size_t dot_pos = _script_path.find_last_of('.');
-	if (dot_pos != std::string::npos) {
-		return _script_path.substr(dot_pos);
+// Getters
+pid_t CgiHandler::getPid() const { return _pid; }
+int CgiHandler::getClientFd() const { return _client_fd; }
+void CgiHandler::detachClient() { _client_fd = -1; }
+int CgiHandler::getStdinFd() const { return _stdin_fd; }
+int CgiHandler::getStdoutFd() const { return _stdout_fd; }
+time_t CgiHandler::getStartedAt() const { return _started_at; }
+long long CgiHandler::getReceivedAt() const { return _received_at; }
+bool CgiHandler::hasExited() const { return _exited; }
+bool CgiHandler::areHeadersDone() const { return _headers_done; }
+const std::string& CgiHandler::getProtocol() const { return _protocol; }
+const std::vector<std::string>& CgiHandler::getEnv() const { return _env; }
+const std::string& CgiHandler::getFastCgiPass() const { return _fastcgi_pass; }
+bool CgiHandler::isFastCgi() const { return !_fastcgi_pass.empty(); }
+Response& CgiHandler::getResponse() { return _response; }
+bool CgiHandler::isOutputBuffered() const { return _buffer_output; }
+bool CgiHandler::isOutputPaused() const { return _output_paused; }
+bool CgiHandler::isFinished() const { return _exited && _stdout_fd == -1; }
+
+void CgiHandler::_buildEnv(const Request& request, const ServerConfig& server) {
+	std::string content_length;
+	Utils::appendNumber(content_length, request.getBodyLength());
+	std::string port;
+	Utils::appendNumber(port, server.port);
+
+	// Required CGI environment variables
+	_env.push_back("REQUEST_METHOD=" + request.getMethod());
+	_env.push_back("SCRIPT_FILENAME=" + _script_path);
+	_env.push_back("SCRIPT_NAME=" + request.getPath());
+	_env.push_back("PATH_INFO=" + request.getPath());
+	_env.push_back("QUERY_STRING=" + request.getQuery());
+	_env.push_back("CONTENT_TYPE=" + request.getHeader("Content-Type"));
+	_env.push_back("CONTENT_LENGTH=" + content_length);
+	_env.push_back("SERVER_PROTOCOL=" + request.getVersion());
+	_env.push_back("SERVER_NAME=" + server.server_name);
+	_env.push_back("SERVER_PORT=" + port);
+	_env.push_back("GATEWAY_INTERFACE=CGI/1.1");
+	_env.push_back("SERVER_SOFTWARE=webserv/1.0");
+	_env.push_back("REDIRECT_STATUS=200");
+
+	// Request headers as HTTP_* meta-variables (RFC 3875 4.1.18)
+	for (size_t i = 0; i < request.getHeaderCount(); ++i) {
+		const RequestHeader& header = request.getHeaderAt(i);
+		std::string key(header.name, header.name_length);
+		if (key == "content-type" || key == "content-length")
+			continue;
+		std::string name = "HTTP_";
+		for (size_t j = 0; j < key.length(); ++j) {
+			char c = key[j];
+			name += (c == '-') ? '_' : static_cast<char>(std::toupper(c));
+		}
+		_env.push_back(name + "=" + std::string(header.value, header.value_length));
 	}
-	return "";
 }
 
+// Refills the input buffer from the spooled body file once it is consumed
+bool CgiHandler::_fillInput() {
+	if (_input_offset < _input.length() || _body_fd == -1) {
+		return true;
+	}
+
+	char buffer[CGI_IO_CHUNK];
+	ssize_t bytes = read(_body_fd, buffer, sizeof(buffer));
+	if (bytes < 0) {
+		return false;
+	}
+	_input.assign(buffer, bytes);
+	_input_offset = 0;
+	if (bytes == 0) {
+		close(_body_fd);
+		_body_fd = -1;
+	}
+	return true;
+}
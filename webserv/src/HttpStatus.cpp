@@ -1,22 +1,43 @@
 #include "HttpStatus.hpp"
+#include "Utils.hpp"
 
 std::string HttpStatus::getMessage(int code) {
 	switch (code) {
 		case 200: return "OK";
 		case 201: return "Created";
 		case 204: return "No Content";
+		case 206: return "Partial Content";
 		case 301: return "Moved Permanently";
 		case 302: return "Found";
+		case 304: return "Not Modified";
 		case 400: return "Bad Request";
 		case 403: return "Forbidden";
 		case 404: return "Not Found";
 		case 405: return "Method Not Allowed";
 		case 408: return "Request Timeout";
 		case 413: return "Payload Too Large";
+		case 416: return "Range Not Satisfiable";
+		case 431: return "Request Header Fields Too Large";
 		case 500: return "Internal Server Error";
 		case 501: return "Not Implemented";
+		case 502: return "Bad Gateway";
+		case 504: return "Gateway Timeout";
 		case 505: return "HTTP Version Not Supported";
 		default: return "Unknown";
 	}
 }
 
+
+const std::string& HttpStatus::getStatusLine(int code) {
+	static std::string lines[600];
+	if (code < 100 || code > 599) {
+		code = INTERNAL_SERVER_ERROR;
+	}
+	std::string& line = lines[code];
+	if (line.empty()) {
+		line = "HTTP/1.1 ";
+		Utils::appendNumber(line, code);
+		line += " " + getMessage(code) + "\r\n";
+	}
+	return line;
+}
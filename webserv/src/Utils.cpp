@@ -2,6 +2,9 @@
 #include <algorithm>
 #include <fstream>
 #include <sys/stat.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 
 // String utilities
 std::string Utils::trim(const std::string& str) {
@@ -40,9 +43,27 @@ std::vector<std::string> Utils::split(const std::string& str, char delimiter) {
 }
 
 std::string Utils::intToString(int value) {
-	std::ostringstream oss;
-	oss << value;
-	return oss.str();
+	std::string result;
+	if (value < 0) {
+		result += '-';
+	}
+	// Negated as unsigned, so INT_MIN does not overflow
+	unsigned long long magnitude = value < 0 ? 0ULL - static_cast<unsigned>(value) : value;
+	appendNumber(result, magnitude);
+	return result;
+}
+
+// Formats in place, without the allocations of an ostringstream
+void Utils::appendNumber(std::string& out, unsigned long long value, int base) {
+	static const char digits[] = "0123456789abcdef";
+	char buffer[32];
+	char* end = buffer + sizeof(buffer);
+	char* start = end;
+	do {
+		*--start = digits[value % base];
+		value /= base;
+	} while (value != 0);
+	out.append(start, end - start);
 }
 
 int Utils::stringToInt(const std::string& str) {
@@ -139,3 +160,217 @@ std::string Utils::normalizePath(const std::string& path) {
 	return normalized;
 }
 
+// HTTP utilities
+std::string Utils::httpDate(time_t time) {
+	// Formatted by hand, strftime() names depend on the locale
+	static const char* days[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+	static const char* months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+	                                "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+	struct tm gmt;
+	gmtime_r(&time, &gmt);
+
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), "%s, %02d %s %04d %02d:%02d:%02d GMT",
+	         days[gmt.tm_wday], gmt.tm_mday, months[gmt.tm_mon], gmt.tm_year + 1900,
+	         gmt.tm_hour, gmt.tm_min, gmt.tm_sec);
+	return buffer;
+}
+
+// Accepts the three formats recipients must support (RFC 9110 5.6.7)
+bool Utils::parseHttpDate(const std::string& value, time_t& time) {
+	static const char* months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+	struct tm tm;
+	std::memset(&tm, 0, sizeof(tm));
+	char month[4] = { 0 };
+	int year = 0;
+
+	const char* text = value.c_str();
+	bool parsed =
+		std::sscanf(text, "%*3s, %d %3s %d %d:%d:%d GMT", // IMF-fixdate
+		            &tm.tm_mday, month, &year, &tm.tm_hour, &tm.tm_min, &tm.tm_sec) == 6 ||
+		std::sscanf(text, "%*3s %3s %d %d:%d:%d %d", // asctime()
+		            month, &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &year) == 6;
+	if (!parsed && std::sscanf(text, "%*[A-Za-z], %d-%3s-%d %d:%d:%d GMT", // RFC 850
+	                           &tm.tm_mday, month, &year, &tm.tm_hour, &tm.tm_min, &tm.tm_sec) == 6) {
+		parsed = true;
+		year += (year < 70) ? 2000 : 1900;
+	}
+	if (!parsed) {
+		return false;
+	}
+
+	const char* found = std::strstr(months, month);
+	if (std::strlen(month) != 3 || !found || (found - months) % 3 != 0) {
+		return false;
+	}
+	tm.tm_mon = static_cast<int>(found - months) / 3;
+	tm.tm_year = year - 1900;
+	time = timegm(&tm);
+	return time != static_cast<time_t>(-1);
+}
+
+// Strong validator from the file's identity, changes whenever it is replaced
+std::string Utils::makeEtag(ino_t inode, off_t size, time_t mtime) {
+	std::string etag = "\"";
+	Utils::appendNumber(etag, static_cast<unsigned long>(inode), 16);
+	etag += '-';
+	Utils::appendNumber(etag, static_cast<unsigned long long>(size), 16);
+	etag += '-';
+	Utils::appendNumber(etag, static_cast<unsigned long>(mtime), 16);
+	etag += '"';
+	return etag;
+}
+
+// If-None-Match uses the weak comparison (RFC 9110 8.8.3.2): W/ is ignored
+bool Utils::etagMatches(const std::string& list, const std::string& etag) {
+	std::string opaque = etag.compare(0, 2, "W/") == 0 ? etag.substr(2) : etag;
+	std::vector<std::string> candidates = split(list, ',');
+	for (size_t i = 0; i < candidates.size(); ++i) {
+		std::string candidate = trim(candidates[i]);
+		if (candidate == "*") {
+			return true;
+		}
+		if (candidate.compare(0, 2, "W/") == 0) {
+			candidate = candidate.substr(2);
+		}
+		if (candidate == opaque) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Accept-Encoding (RFC 9110 12.5.3): coding or "*" listed with q > 0. An
+// explicit entry for the coding overrides the wildcard.
+bool Utils::acceptsEncoding(const std::string& list, const std::string& coding) {
+	bool wildcard = false;
+	std::vector<std::string> entries = split(list, ',');
+	for (size_t i = 0; i < entries.size(); ++i) {
+		std::vector<std::string> params = split(entries[i], ';');
+		if (params.empty()) {
+			continue;
+		}
+		bool accepted = true;
+		for (size_t j = 1; j < params.size(); ++j) {
+			std::string param = toLower(params[j]);
+			if (param.compare(0, 2, "q=") == 0) {
+				accepted = std::atof(param.c_str() + 2) > 0;
+			}
+		}
+		std::string name = toLower(params[0]);
+		if (name == coding) {
+			return accepted;
+		}
+		if (name == "*") {
+			wildcard = accepted;
+		}
+	}
+	return wildcard;
+}
+
+// Non-negative decimal, false on anything else or overflow
+static bool parseOffset(const std::string& str, off_t& value) {
+	if (str.empty() || str.length() > 18) {
+		return false;
+	}
+	value = 0;
+	for (size_t i = 0; i < str.length(); ++i) {
+		if (str[i] < '0' || str[i] > '9') {
+			return false;
+		}
+		value = value * 10 + (str[i] - '0');
+	}
+	return true;
+}
+
+// Range: bytes=... (RFC 9110 14.1.2) as inclusive [first, last] pairs
+// clipped to size. Returns 1 if any range is satisfiable, 0 if none is
+// (416), and -1 if the header should be ignored and the full body sent:
+// malformed, another unit, too many ranges or more bytes than the file.
+int Utils::parseRange(const std::string& value, off_t size,
+                      std::vector<std::pair<off_t, off_t> >& ranges) {
+	static const size_t max_ranges = 16;
+
+	ranges.clear();
+	std::string spec = trim(value);
+	if (toLower(spec.substr(0, 6)) != "bytes=") {
+		return -1;
+	}
+	std::vector<std::string> parts = split(spec.substr(6), ',');
+	if (parts.size() > max_ranges) {
+		return -1;
+	}
+
+	bool valid = false;
+	off_t total = 0;
+	for (size_t i = 0; i < parts.size(); ++i) {
+		if (parts[i].empty()) {
+			continue; // Empty list elements are allowed
+		}
+		size_t dash = parts[i].find('-');
+		if (dash == std::string::npos) {
+			return -1;
+		}
+		std::string first_str = trim(parts[i].substr(0, dash));
+		std::string last_str = trim(parts[i].substr(dash + 1));
+		off_t first;
+		off_t last;
+
+		if (first_str.empty()) {
+			// Suffix range: the final N bytes
+			off_t suffix;
+			if (!parseOffset(last_str, suffix)) {
+				return -1;
+			}
+			valid = true;
+			if (suffix == 0 || size == 0) {
+				continue;
+			}
+			first = suffix < size ? size - suffix : 0;
+			last = size - 1;
+		} else {
+			if (!parseOffset(first_str, first)) {
+				return -1;
+			}
+			if (last_str.empty()) {
+				last = size - 1;
+			} else if (!parseOffset(last_str, last) || last < first) {
+				return -1;
+			}
+			valid = true;
+			if (first >= size) {
+				continue;
+			}
+			if (last >= size) {
+				last = size - 1;
+			}
+		}
+		ranges.push_back(std::make_pair(first, last));
+		total += last - first + 1;
+	}
+
+	if (!valid || total > size) {
+		ranges.clear();
+		return -1;
+	}
+	return ranges.empty() ? 0 : 1;
+}
+
+int Utils::methodBit(const std::string& method) {
+	static const char* names[] = {
+		"GET", "HEAD", "POST", "PUT", "DELETE", "OPTIONS", "PATCH", "CONNECT", "TRACE"
+	};
+	for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+		if (method == names[i]) {
+			return 1 << i;
+		}
+	}
+	return 0;
+}
+
+// Time utilities
+long long Utils::monotonicUsec() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<long long>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
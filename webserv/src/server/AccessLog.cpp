@@ -0,0 +1,273 @@
+#include "AccessLog.hpp"
+#include "Utils.hpp"
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+AccessLog::AccessLog(const std::string& path) : _path(path), _fd(STDOUT_FILENO), _reopen(false),
+                                                _stopping(false), _lines(0), _dropped(0),
+                                                _time_cached(0) {
+	if (!_path.empty()) {
+		_fd = _open();
+		if (_fd < 0) {
+			throw std::runtime_error("Failed to open access log " + _path + ": " +
+			                         std::strerror(errno));
+		}
+	}
+	_time_local[0] = '\0';
+	_time_iso[0] = '\0';
+
+	pthread_mutex_init(&_mutex, NULL);
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&_wakeup, &attr);
+	pthread_condattr_destroy(&attr);
+
+	// Signals stay with the event loop thread
+	sigset_t all;
+	sigset_t previous;
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &previous);
+	int result = pthread_create(&_thread, NULL, _run, this);
+	pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+	if (result != 0) {
+		pthread_cond_destroy(&_wakeup);
+		pthread_mutex_destroy(&_mutex);
+		if (!_path.empty()) {
+			close(_fd);
+		}
+		throw std::runtime_error("Failed to start the access log writer");
+	}
+}
+
+AccessLog::~AccessLog() {
+	pthread_mutex_lock(&_mutex);
+	_stopping = true;
+	pthread_cond_signal(&_wakeup);
+	pthread_mutex_unlock(&_mutex);
+	pthread_join(_thread, NULL);
+
+	pthread_cond_destroy(&_wakeup);
+	pthread_mutex_destroy(&_mutex);
+	if (!_path.empty()) {
+		close(_fd);
+	}
+}
+
+// Formats outside the lock; the writer is only woken when a batch is
+// ready, otherwise it comes by once per ACCESS_LOG_FLUSH_INTERVAL
+void AccessLog::log(const AccessLogEntry& entry, const std::string& remote_addr, int status,
+                    off_t bytes, long long duration_usec, bool json) {
+	time_t now = time(NULL);
+	if (now != _time_cached) {
+		_formatTime(now);
+	}
+	_line.clear();
+	if (json) {
+		_appendJson(entry, remote_addr, status, bytes, duration_usec);
+	} else {
+		_appendCombined(entry, remote_addr, status, bytes);
+	}
+
+	pthread_mutex_lock(&_mutex);
+	if (_pending.length() + _line.length() > ACCESS_LOG_BUFFER_SIZE) {
+		_dropped++;
+		pthread_mutex_unlock(&_mutex);
+		return;
+	}
+	bool batch_ready = _pending.length() < ACCESS_LOG_FLUSH_SIZE &&
+	                   _pending.length() + _line.length() >= ACCESS_LOG_FLUSH_SIZE;
+	_pending += _line;
+	_lines++;
+	if (batch_ready) {
+		pthread_cond_signal(&_wakeup);
+	}
+	pthread_mutex_unlock(&_mutex);
+}
+
+void AccessLog::reopen() {
+	if (_path.empty()) {
+		return;
+	}
+	pthread_mutex_lock(&_mutex);
+	_reopen = true;
+	pthread_cond_signal(&_wakeup);
+	pthread_mutex_unlock(&_mutex);
+}
+
+// Getters
+const std::string& AccessLog::getPath() const {
+	return _path;
+}
+
+unsigned long AccessLog::getLines() {
+	pthread_mutex_lock(&_mutex);
+	unsigned long lines = _lines;
+	pthread_mutex_unlock(&_mutex);
+	return lines;
+}
+
+unsigned long AccessLog::getDropped() {
+	pthread_mutex_lock(&_mutex);
+	unsigned long dropped = _dropped;
+	pthread_mutex_unlock(&_mutex);
+	return dropped;
+}
+
+int AccessLog::_open() const {
+	return open(_path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+}
+
+void AccessLog::_formatTime(time_t now) {
+	struct tm local;
+	localtime_r(&now, &local);
+	strftime(_time_local, sizeof(_time_local), "%d/%b/%Y:%H:%M:%S %z", &local);
+
+	// strftime has no colon in the offset, ISO 8601 wants one
+	char offset[8];
+	strftime(offset, sizeof(offset), "%z", &local);
+	size_t length = strftime(_time_iso, sizeof(_time_iso), "%Y-%m-%dT%H:%M:%S", &local);
+	if (std::strlen(offset) == 5) {
+		std::snprintf(_time_iso + length, sizeof(_time_iso) - length, "%.3s:%s", offset, offset + 3);
+	}
+	_time_cached = now;
+}
+
+// remote - - [time] "request" status bytes "referer" "user-agent"
+void AccessLog::_appendCombined(const AccessLogEntry& entry, const std::string& remote_addr,
+                                int status, off_t bytes) {
+	_line += remote_addr.empty() ? "-" : remote_addr;
+	_line += " - - [";
+	_line += _time_local;
+	_line += "] \"";
+	if (entry.active) {
+		_appendEscaped(_line, entry.method, false);
+		_line += ' ';
+		_appendEscaped(_line, entry.uri, false);
+		_line += ' ';
+		_appendEscaped(_line, entry.version, false);
+	} else {
+		_line += '-'; // Rejected before it could be parsed
+	}
+	_line += "\" ";
+	Utils::appendNumber(_line, status);
+	_line += ' ';
+	Utils::appendNumber(_line, bytes);
+	_line += " \"";
+	_appendEscaped(_line, entry.active && !entry.referer.empty() ? entry.referer : "-", false);
+	_line += "\" \"";
+	_appendEscaped(_line, entry.active && !entry.user_agent.empty() ? entry.user_agent : "-", false);
+	_line += "\"\n";
+}
+
+void AccessLog::_appendJson(const AccessLogEntry& entry, const std::string& remote_addr,
+                            int status, off_t bytes, long long duration_usec) {
+	static const std::string empty;
+
+	_line += "{\"time\":\"";
+	_line += _time_iso;
+	_line += "\",\"remote_addr\":\"";
+	_appendEscaped(_line, remote_addr, true);
+	_line += "\",\"method\":\"";
+	_appendEscaped(_line, entry.active ? entry.method : empty, true);
+	_line += "\",\"uri\":\"";
+	_appendEscaped(_line, entry.active ? entry.uri : empty, true);
+	_line += "\",\"protocol\":\"";
+	_appendEscaped(_line, entry.active ? entry.version : empty, true);
+	_line += "\",\"status\":";
+	Utils::appendNumber(_line, status);
+	_line += ",\"bytes\":";
+	Utils::appendNumber(_line, bytes);
+	_line += ",\"request_time\":";
+	Utils::appendNumber(_line, duration_usec / 1000000);
+	_line += '.';
+	std::string fraction;
+	Utils::appendNumber(fraction, duration_usec % 1000000);
+	_line.append(6 - fraction.length(), '0');
+	_line += fraction;
+	_line += ",\"referer\":\"";
+	_appendEscaped(_line, entry.active ? entry.referer : empty, true);
+	_line += "\",\"user_agent\":\"";
+	_appendEscaped(_line, entry.active ? entry.user_agent : empty, true);
+	_line += "\"}\n";
+}
+
+// Client-supplied bytes never break a line or a quoted field: quotes,
+// backslashes and control characters are escaped, as \xHH in the
+// combined format (like nginx) and \u00HH in JSON
+void AccessLog::_appendEscaped(std::string& out, const std::string& value, bool json) {
+	static const char hex[] = "0123456789ABCDEF";
+	for (size_t i = 0; i < value.length(); ++i) {
+		unsigned char c = value[i];
+		if (c >= 0x20 && c != '"' && c != '\\' && c != 0x7f) {
+			out += c;
+		} else if (json && (c == '"' || c == '\\')) {
+			out += '\\';
+			out += c;
+		} else {
+			out += json ? "\\u00" : "\\x";
+			out += hex[c >> 4];
+			out += hex[c & 0xf];
+		}
+	}
+}
+
+void* AccessLog::_run(void* log) {
+	static_cast<AccessLog*>(log)->_work();
+	return NULL;
+}
+
+void AccessLog::_work() {
+	pthread_mutex_lock(&_mutex);
+	while (true) {
+		struct timespec deadline;
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += ACCESS_LOG_FLUSH_INTERVAL;
+		while (!_stopping && !_reopen && _pending.length() < ACCESS_LOG_FLUSH_SIZE) {
+			if (pthread_cond_timedwait(&_wakeup, &_mutex, &deadline) == ETIMEDOUT) {
+				break;
+			}
+		}
+
+		// Both buffers keep their capacity, so steady logging doesn't allocate
+		_writing.swap(_pending);
+		bool reopen = _reopen;
+		bool stopping = _stopping;
+		_reopen = false;
+		pthread_mutex_unlock(&_mutex);
+
+		_write(_writing);
+		_writing.clear();
+		if (reopen) {
+			int fd = _open(); // On failure the old file is kept
+			if (fd >= 0) {
+				close(_fd);
+				_fd = fd;
+			}
+		}
+		if (stopping) {
+			return;
+		}
+		pthread_mutex_lock(&_mutex);
+	}
+}
+
+void AccessLog::_write(const std::string& data) {
+	size_t offset = 0;
+	while (offset < data.length()) {
+		ssize_t written = write(_fd, data.data() + offset, data.length() - offset);
+		if (written < 0 && errno == EINTR) {
+			continue;
+		}
+		if (written <= 0) {
+			return; // Nowhere to put it, the batch is lost
+		}
+		offset += written;
+	}
+}
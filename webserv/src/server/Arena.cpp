@@ -0,0 +1,52 @@
+#include "Arena.hpp"
+#include <cstring>
+
+#define ARENA_ALIGN sizeof(double) // Matches malloc on the targets we build for
+
+Arena::Arena() : _used(0), _capacity(0) {}
+
+Arena::~Arena() {
+	for (size_t i = 0; i < _blocks.size(); ++i) {
+		delete[] _blocks[i];
+	}
+}
+
+void* Arena::allocate(size_t size) {
+	size_t offset = (_used + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+	if (_blocks.empty() || offset + size > _capacity) {
+		_grow(size);
+		offset = 0;
+	}
+	_used = offset + size;
+	return _blocks.back() + offset;
+}
+
+char* Arena::copy(const char* data, size_t length) {
+	char* result = static_cast<char*>(allocate(length + 1));
+	std::memcpy(result, data, length);
+	result[length] = '\0';
+	return result;
+}
+
+// Blocks added for an unusually large request are given back, the first
+// one stays for the next request
+void Arena::reset() {
+	while (_blocks.size() > 1) {
+		delete[] _blocks.back();
+		_blocks.pop_back();
+	}
+	_used = 0;
+	_capacity = _blocks.empty() ? 0 : ARENA_BLOCK_SIZE;
+}
+
+// Getters
+size_t Arena::getBlockCount() const {
+	return _blocks.size();
+}
+
+void Arena::_grow(size_t size) {
+	size_t capacity = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+	_blocks.push_back(new char[capacity]);
+	_used = 0;
+	_capacity = capacity;
+}
@@ -1,18 +1,73 @@
 #include "Client.hpp"
+#include <unistd.h>
+#include <fcntl.h>
+#include <cstdlib>
+#include <cerrno>
+#include <vector>
 
-Client::Client() : _fd(-1), _last_activity(time(NULL)), _request_complete(false),
-                   _content_length(0), _body_received(0), _headers_parsed(false) {}
+Client::Client() : _fd(-1), _last_activity(time(NULL)),
+                   _write_armed(false), _read_paused(false), _close_after_write(false),
+                   _requests_served(0), _spool_fd(-1),
+                   _request(_arena), _disk_job(NULL), _parse_usec(0), _handled_at(0),
+                   _queued_at(0), _location_metrics(NULL), _cgi(NULL),
+                   _snapshot(NULL), _virtual_hosts(NULL), _server(NULL), _server_selected(false) {}
 
-Client::Client(int fd) : _fd(fd), _last_activity(time(NULL)), _request_complete(false),
-                         _content_length(0), _body_received(0), _headers_parsed(false) {}
+Client::Client(int fd) : _fd(fd), _last_activity(time(NULL)),
+                         _write_armed(false), _read_paused(false), _close_after_write(false),
+                         _requests_served(0), _spool_fd(-1),
+                         _request(_arena), _disk_job(NULL), _parse_usec(0), _handled_at(0),
+                         _queued_at(0), _location_metrics(NULL), _cgi(NULL),
+                         _snapshot(NULL), _virtual_hosts(NULL), _server(NULL),
+                         _server_selected(false) {
+	_timer.id = fd;
+}
+
+Client::~Client() {
+	discardBodySpool();
+}
 
-Client::~Client() {}
+// Called by the pool between connections. The timer must already be
+// unlinked; a buffer grown by a big request is not kept around.
+void Client::reset(int fd) {
+	_fd = fd;
+	_remote_addr.clear();
+	if (_buffer.capacity() > CLIENT_BUFFER_KEEP) {
+		std::string().swap(_buffer);
+	}
+	_buffer.clear();
+	_last_activity = time(NULL);
+	_timer.id = fd;
+	_parser.reset();
+	_write_armed = false;
+	_read_paused = false;
+	_close_after_write = false;
+	_requests_served = 0;
+	discardBodySpool();
+	_output.clear();
+	_request.reset();
+	_arena.reset();
+	_disk_job = NULL;
+	_parse_usec = 0;
+	_handled_at = 0;
+	_queued_at = 0;
+	_location_metrics = NULL;
+	_log_entry.active = false;
+	_cgi = NULL;
+	_snapshot = NULL;
+	_virtual_hosts = NULL;
+	_server = NULL;
+	_server_selected = false;
+}
 
 // Getters
 int Client::getFd() const {
 	return _fd;
 }
 
+const std::string& Client::getRemoteAddress() const {
+	return _remote_addr;
+}
+
 std::string& Client::getBuffer() {
 	return _buffer;
 }
@@ -21,57 +76,227 @@ const std::string& Client::getBuffer() const {
 	return _buffer;
 }
 
+HttpParser& Client::getParser() {
+	return _parser;
+}
+
 time_t Client::getLastActivity() const {
 	return _last_activity;
 }
 
-bool Client::isRequestComplete() const {
-	return _request_complete;
+bool Client::isWriteArmed() const {
+	return _write_armed;
+}
+
+bool Client::shouldClose() const {
+	return _close_after_write;
+}
+
+int Client::getRequestsServed() const {
+	return _requests_served;
+}
+
+bool Client::isSpoolingBody() const {
+	return _spool_fd != -1;
+}
+
+bool Client::isReadPaused() const {
+	return _read_paused;
+}
+
+OutputQueue& Client::getOutput() {
+	return _output;
+}
+
+TimerNode* Client::getTimer() {
+	return &_timer;
+}
+
+Arena& Client::getArena() {
+	return _arena;
+}
+
+Request& Client::getRequest() {
+	return _request;
+}
+
+DiskJob* Client::getDiskJob() const {
+	return _disk_job;
+}
+
+long long Client::getParseTime() const {
+	return _parse_usec;
+}
+
+long long Client::getHandledAt() const {
+	return _handled_at;
+}
+
+long long Client::getQueuedAt() const {
+	return _queued_at;
+}
+
+LocationMetrics* Client::getLocationMetrics() const {
+	return _location_metrics;
+}
+
+AccessLogEntry& Client::getLogEntry() {
+	return _log_entry;
 }
 
-size_t Client::getContentLength() const {
-	return _content_length;
+CgiHandler* Client::getCgi() const {
+	return _cgi;
 }
 
-size_t Client::getBodyReceived() const {
-	return _body_received;
+ConfigSnapshot* Client::getSnapshot() const {
+	return _snapshot;
 }
 
-bool Client::areHeadersParsed() const {
-	return _headers_parsed;
+const VirtualHosts* Client::getVirtualHosts() const {
+	return _virtual_hosts;
+}
+
+const ServerConfig* Client::getServer() const {
+	return _server;
+}
+
+bool Client::isServerSelected() const {
+	return _server_selected;
 }
 
 // Setters
-void Client::setRequestComplete(bool complete) {
-	_request_complete = complete;
+void Client::setRemoteAddress(const std::string& address) {
+	_remote_addr = address;
+}
+
+void Client::setWriteArmed(bool armed) {
+	_write_armed = armed;
+}
+
+void Client::setReadPaused(bool paused) {
+	_read_paused = paused;
+}
+
+void Client::setCloseAfterWrite(bool close) {
+	_close_after_write = close;
+}
+
+void Client::incrementRequestsServed() {
+	_requests_served++;
+}
+
+void Client::setCgi(CgiHandler* cgi) {
+	_cgi = cgi;
+}
+
+void Client::setSnapshot(ConfigSnapshot* snapshot) {
+	_snapshot = snapshot;
+}
+
+void Client::setVirtualHosts(const VirtualHosts* virtual_hosts) {
+	_virtual_hosts = virtual_hosts;
+}
+
+void Client::setServer(const ServerConfig* server) {
+	_server = server;
+}
+
+void Client::setServerSelected(bool selected) {
+	_server_selected = selected;
+}
+
+void Client::setDiskJob(DiskJob* job) {
+	_disk_job = job;
 }
 
-void Client::setContentLength(size_t length) {
-	_content_length = length;
+void Client::setParseTime(long long usec) {
+	_parse_usec = usec;
 }
 
-void Client::setBodyReceived(size_t received) {
-	_body_received = received;
+void Client::setHandledAt(long long usec) {
+	_handled_at = usec;
 }
 
-void Client::setHeadersParsed(bool parsed) {
-	_headers_parsed = parsed;
+void Client::setQueuedAt(long long usec) {
+	_queued_at = usec;
+}
+
+void Client::setLocationMetrics(LocationMetrics* metrics) {
+	_location_metrics = metrics;
 }
 
 void Client::updateActivity() {
 	_last_activity = time(NULL);
 }
 
+// Body spooling
+bool Client::startBodySpool(const std::string& dir) {
+	std::string path = dir;
+	if (path.empty() || path[path.length() - 1] != '/') {
+		path += "/";
+	}
+	path += ".webserv-body-XXXXXX";
+
+	std::vector<char> name(path.begin(), path.end());
+	name.push_back('\0');
+	int fd = mkstemp(&name[0]);
+	if (fd < 0) {
+		return false;
+	}
+	fcntl(fd, F_SETFD, FD_CLOEXEC); // Not inherited by CGI children
+
+	discardBodySpool();
+	_spool_fd = fd;
+	_spool_path = &name[0];
+	return true;
+}
+
+bool Client::spoolBody(size_t offset, size_t length) {
+	size_t written = 0;
+	while (written < length) {
+		ssize_t ret = write(_spool_fd, _buffer.data() + offset + written, length - written);
+		if (ret < 0 && errno == EINTR) {
+			continue;
+		}
+		if (ret <= 0) {
+			return false;
+		}
+		written += ret;
+	}
+	_buffer.erase(offset, length);
+	return true;
+}
+
+std::string Client::releaseBodySpool() {
+	std::string path = _spool_path;
+	if (_spool_fd != -1) {
+		close(_spool_fd);
+	}
+	_spool_fd = -1;
+	_spool_path.clear();
+	return path;
+}
+
+void Client::discardBodySpool() {
+	if (_spool_fd != -1) {
+		unlink(releaseBodySpool().c_str());
+	}
+}
+
 // Buffer management
-void Client::addToBuffer(const std::string& data) {
-	_buffer += data;
+void Client::addToBuffer(const char* data, size_t length) {
+	_buffer.append(data, length);
+}
+
+void Client::consume(size_t length) {
+	_buffer.erase(0, length);
+	_parser.reset();
+	_server_selected = false;
 }
 
 void Client::clearBuffer() {
 	_buffer.clear();
-	_request_complete = false;
-	_content_length = 0;
-	_body_received = 0;
-	_headers_parsed = false;
+	_parser.reset();
+	_server_selected = false;
 }
 
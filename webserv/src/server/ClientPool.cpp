@@ -0,0 +1,46 @@
+#include "ClientPool.hpp"
+#include "Client.hpp"
+
+ClientPool::ClientPool(size_t capacity) : _capacity(capacity > 0 ? capacity : 1), _in_use(0) {
+	_free.reserve(_capacity);
+}
+
+ClientPool::~ClientPool() {
+	for (size_t i = 0; i < _free.size(); ++i) {
+		delete _free[i];
+	}
+}
+
+// Clients are created on demand rather than up front, an idle server
+// doesn't hold max_connections of them
+Client* ClientPool::acquire(int fd) {
+	if (_in_use >= _capacity) {
+		return NULL;
+	}
+	Client* client;
+	if (_free.empty()) {
+		client = new Client(fd);
+	} else {
+		client = _free.back();
+		_free.pop_back();
+		client->reset(fd);
+	}
+	_in_use++;
+	return client;
+}
+
+// Most recently released is handed out first, its memory is still warm
+void ClientPool::release(Client* client) {
+	client->reset(-1); // Drops the spool file and queued output now
+	_free.push_back(client);
+	_in_use--;
+}
+
+// Getters
+size_t ClientPool::getCapacity() const {
+	return _capacity;
+}
+
+size_t ClientPool::getInUse() const {
+	return _in_use;
+}
@@ -1,13 +1,17 @@
 #include "Config.hpp"
+#include "Utils.hpp"
+#include "Metrics.hpp"
 #include <fstream>
+#include <cstdlib>
 #include <sstream>
 #include <iostream>
 #include <algorithm>
 #include <vector>
 
-Config::Config() {}
+Config::Config() : _workers(1), _max_connections(1024), _aio_threads(4) {}
 
-Config::Config(const std::string& config_file) : _config_file(config_file) {}
+Config::Config(const std::string& config_file) : _config_file(config_file), _workers(1),
+                                                  _max_connections(1024), _aio_threads(4) {}
 
 Config::~Config() {}
 
@@ -16,6 +20,7 @@ bool Config::parse() {
 	if (!_config_file.empty()) {
 		try {
 			_parseConfigFile(_config_file);
+			_compile();
 			return !_servers.empty();
 		} catch (const std::exception& e) {
 			std::cerr << "Config parse error: " << e.what() << std::endl;
@@ -28,6 +33,7 @@ bool Config::parse() {
 	default_config.port = 8080;
 	default_config.host = "0.0.0.0";
 	default_config.server_name = "webserv";
+	default_config.server_names.push_back("webserv");
 	default_config.max_body_size = 1048576; // 1MB
 
 	// Default location
@@ -47,10 +53,24 @@ bool Config::parse() {
 	default_config.error_pages[500] = "./www/500.html";
 
 	_servers.push_back(default_config);
+	_compile();
 
 	return true;
 }
 
+// A reload must not swap a running configuration for the defaults
+// because of a typo, so errors are reported instead
+bool Config::load() {
+	try {
+		_parseConfigFile(_config_file);
+	} catch (const std::exception& e) {
+		std::cerr << "Config parse error: " << e.what() << std::endl;
+		return false;
+	}
+	_compile();
+	return !_servers.empty();
+}
+
 const std::vector<ServerConfig>& Config::getServers() const {
 	return _servers;
 }
@@ -59,26 +79,60 @@ const ServerConfig& Config::getServerConfig(size_t index) const {
 	return _servers[index];
 }
 
-const LocationConfig* Config::findLocation(const std::string& uri, const ServerConfig& server) const {
-	const LocationConfig* best_match = NULL;
-	size_t best_match_len = 0;
+const std::string& Config::getEventBackend() const {
+	return _event_backend;
+}
+
+int Config::getWorkers() const {
+	return _workers;
+}
 
-	for (size_t i = 0; i < server.locations.size(); ++i) {
-		const LocationConfig& loc = server.locations[i];
-		if (uri.find(loc.path) == 0) {
-			if (loc.path.length() > best_match_len) {
-				best_match = &loc;
-				best_match_len = loc.path.length();
-			}
+int Config::getMaxConnections() const {
+	return _max_connections;
+}
+
+int Config::getAioThreads() const {
+	return _aio_threads;
+}
+
+// Longest location prefix ending on a path segment boundary
+const LocationConfig* Config::findLocation(const std::string& uri, const ServerConfig& server) {
+	int index = server.location_trie.find(uri);
+	return index < 0 ? NULL : &server.locations[index];
+}
+
+// Requests then count through location.counters instead of looking the
+// path up in the metrics on every request
+void Config::bindMetrics(Metrics& metrics) {
+	for (size_t i = 0; i < _servers.size(); ++i) {
+		std::vector<LocationConfig>& locations = _servers[i].locations;
+		for (size_t j = 0; j < locations.size(); ++j) {
+			locations[j].counters = metrics.getLocation(locations[j].path);
 		}
 	}
+}
 
-	return best_match;
+// Turns parsed directives into the forms used per request: the location
+// trie and method bitmasks
+void Config::_compile() {
+	for (size_t i = 0; i < _servers.size(); ++i) {
+		ServerConfig& server = _servers[i];
+		server.location_trie.clear();
+		for (size_t j = 0; j < server.locations.size(); ++j) {
+			LocationConfig& location = server.locations[j];
+			server.location_trie.insert(location.path, static_cast<int>(j));
+			location.allowed_methods = 0;
+			for (size_t k = 0; k < location.methods.size(); ++k) {
+				location.allowed_methods |= Utils::methodBit(location.methods[k]);
+			}
+		}
+	}
 }
 
 // Extract server-level directives and location blocks
 void Config::_parseServerBlock(const std::string& block, ServerConfig& config) {
 	std::vector<std::string> lines = _split(block, '\n');
+	size_t search_pos = 0; // Character offset of the next location block
 
 	for (size_t i = 0; i < lines.size(); ++i)
 	{
@@ -109,12 +163,16 @@ void Config::_parseServerBlock(const std::string& block, ServerConfig& config) {
 		else if (line.find("server_name") == 0)
 		{
 			std::vector<std::string> tokens = _split(line, ' ');
-			if (tokens.size() >= 2)
+			for (size_t j = 1; j < tokens.size(); ++j)
 			{
-				config.server_name = tokens[1];
-				if (config.server_name[config.server_name.length() - 1] == ';')
-					config.server_name = config.server_name.substr(0, config.server_name.length() - 1);
+				std::string name = tokens[j];
+				if (!name.empty() && name[name.length() - 1] == ';')
+					name = name.substr(0, name.length() - 1);
+				if (!name.empty())
+					config.server_names.push_back(name);
 			}
+			if (!config.server_names.empty())
+				config.server_name = config.server_names[0];
 		}
 		else if (line.find("max_body_size") == 0)
 		{
@@ -124,7 +182,80 @@ void Config::_parseServerBlock(const std::string& block, ServerConfig& config) {
 				std::string size_str = tokens[1];
 				if (size_str[size_str.length() - 1] == ';')
 					size_str = size_str.substr(0, size_str.length() - 1);
-				config.max_body_size = std::atoi(size_str.c_str());
+				config.max_body_size = std::strtoul(size_str.c_str(), NULL, 10);
+			}
+		}
+		else if (line.find("client_body_buffer_size") == 0)
+		{
+			std::vector<std::string> tokens = _split(line, ' ');
+			if (tokens.size() >= 2)
+				config.client_body_buffer_size = std::strtoul(tokens[1].c_str(), NULL, 10);
+		}
+		else if (line.find("keepalive_timeout") == 0)
+		{
+			std::vector<std::string> tokens = _split(line, ' ');
+			if (tokens.size() >= 2)
+				config.keepalive_timeout = std::atoi(tokens[1].c_str());
+		}
+		else if (line.find("keepalive_requests") == 0)
+		{
+			std::vector<std::string> tokens = _split(line, ' ');
+			if (tokens.size() >= 2)
+				config.keepalive_requests = std::atoi(tokens[1].c_str());
+		}
+		else if (line.find("client_header_timeout") == 0)
+		{
+			std::vector<std::string> tokens = _split(line, ' ');
+			if (tokens.size() >= 2)
+				config.client_header_timeout = std::atoi(tokens[1].c_str());
+		}
+		else if (line.find("client_body_timeout") == 0)
+		{
+			std::vector<std::string> tokens = _split(line, ' ');
+			if (tokens.size() >= 2)
+				config.client_body_timeout = std::atoi(tokens[1].c_str());
+		}
+		else if (line.find("send_timeout") == 0)
+		{
+			std::vector<std::string> tokens = _split(line, ' ');
+			if (tokens.size() >= 2)
+				config.send_timeout = std::atoi(tokens[1].c_str());
+		}
+		else if (line.find("cgi_timeout") == 0)
+		{
+			std::vector<std::string> tokens = _split(line, ' ');
+			if (tokens.size() >= 2)
+				config.cgi_timeout = std::atoi(tokens[1].c_str());
+		}
+		else if (line.find("file_cache_size") == 0)
+		{
+			std::vector<std::string> tokens = _split(line, ' ');
+			if (tokens.size() >= 2)
+				config.file_cache_size = std::strtoul(tokens[1].c_str(), NULL, 10);
+		}
+		else if (line.find("file_cache_max_file_size") == 0)
+		{
+			std::vector<std::string> tokens = _split(line, ' ');
+			if (tokens.size() >= 2)
+				config.file_cache_max_file_size = std::strtoul(tokens[1].c_str(), NULL, 10);
+		}
+		else if (line.find("file_cache_valid") == 0)
+		{
+			std::vector<std::string> tokens = _split(line, ' ');
+			if (tokens.size() >= 2)
+				config.file_cache_valid = std::atoi(tokens[1].c_str());
+		}
+		else if (line.find("access_log") == 0)
+		{
+			std::vector<std::string> tokens = _split(line, ' ');
+			if (tokens.size() >= 2)
+			{
+				std::string& last = tokens[tokens.size() - 1];
+				if (last[last.length() - 1] == ';')
+					last = last.substr(0, last.length() - 1);
+				config.access_log = tokens[1];
+				if (tokens.size() >= 3)
+					config.access_log_format = tokens[2];
 			}
 		}
 		else if (line.find("error_page") == 0)
@@ -141,8 +272,11 @@ void Config::_parseServerBlock(const std::string& block, ServerConfig& config) {
 		}
 		else if (line.find("location") == 0)
 		{
-			size_t start = block.find("{", i);
+			size_t loc_pos = block.find(line, search_pos);
+			size_t start = block.find("{", loc_pos);
 			size_t end = _findClosingBrace(block, start);
+			if (loc_pos == std::string::npos || start == std::string::npos || end == std::string::npos)
+				throw std::runtime_error("Unterminated location block");
 			std::string loc_block = block.substr(start + 1, end - start - 1);
 
 			std::vector<std::string> tokens = _split(line, ' ');
@@ -152,6 +286,10 @@ void Config::_parseServerBlock(const std::string& block, ServerConfig& config) {
 
 			_parseLocationBlock(loc_block, location);
 			config.locations.push_back(location);
+
+			// Continue after the block, its lines are not server directives
+			i += std::count(block.begin() + loc_pos, block.begin() + end, '\n');
+			search_pos = end + 1;
 		}
 	}
 }
@@ -228,6 +366,82 @@ void Config::_parseLocationBlock(const std::string& block, LocationConfig& locat
 					location.redirect = location.redirect.substr(0, location.redirect.length() - 1);
 			}
 		}
+		else if (line.find("etag") == 0)
+		{
+			std::vector<std::string> tokens = _split(line, ' ');
+			if (tokens.size() >= 2)
+			{
+				location.etag = tokens[1];
+				if (location.etag[location.etag.length() - 1] == ';')
+					location.etag = location.etag.substr(0, location.etag.length() - 1);
+			}
+		}
+		else if (line.find("cache_control") == 0)
+		{
+			// The value is a directive list and may contain spaces
+			location.cache_control = _trim(line.substr(std::string("cache_control").length()));
+			if (!location.cache_control.empty() &&
+			    location.cache_control[location.cache_control.length() - 1] == ';')
+				location.cache_control = _trim(location.cache_control.substr(0, location.cache_control.length() - 1));
+		}
+		else if (line.find("gzip_static") == 0)
+		{
+			std::vector<std::string> tokens = _split(line, ' ');
+			if (tokens.size() >= 2)
+				location.gzip_static = (tokens[1] == "on" || tokens[1] == "on;");
+		}
+		else if (line.find("aio") == 0)
+		{
+			std::vector<std::string> tokens = _split(line, ' ');
+			if (tokens.size() >= 2)
+				location.aio = (tokens[1] == "on" || tokens[1] == "on;");
+		}
+		else if (line.find("metrics") == 0)
+		{
+			std::vector<std::string> tokens = _split(line, ' ');
+			if (tokens.size() >= 2)
+				location.metrics = (tokens[1] == "on" || tokens[1] == "on;");
+		}
+		else if (line.find("gzip_comp_level") == 0)
+		{
+			std::vector<std::string> tokens = _split(line, ' ');
+			if (tokens.size() >= 2)
+			{
+				int level = std::atoi(tokens[1].c_str());
+				if (level >= 1 && level <= 9)
+					location.gzip_comp_level = level;
+			}
+		}
+		else if (line.find("gzip_min_length") == 0)
+		{
+			std::vector<std::string> tokens = _split(line, ' ');
+			if (tokens.size() >= 2)
+				location.gzip_min_length = std::strtoul(tokens[1].c_str(), NULL, 10);
+		}
+		else if (line.find("gzip") == 0)
+		{
+			std::vector<std::string> tokens = _split(line, ' ');
+			if (tokens.size() >= 2)
+				location.gzip = (tokens[1] == "on" || tokens[1] == "on;");
+		}
+		else if (line.find("fastcgi_pass") == 0)
+		{
+			std::vector<std::string> tokens = _split(line, ' ');
+			if (tokens.size() >= 2)
+			{
+				location.fastcgi_pass = tokens[1];
+				if (location.fastcgi_pass[location.fastcgi_pass.length() - 1] == ';')
+					location.fastcgi_pass = location.fastcgi_pass.substr(0, location.fastcgi_pass.length() - 1);
+				if (location.fastcgi_pass.find("unix:") == 0)
+					location.fastcgi_pass = location.fastcgi_pass.substr(5);
+			}
+		}
+		else if (line.find("fastcgi_connections") == 0)
+		{
+			std::vector<std::string> tokens = _split(line, ' ');
+			if (tokens.size() >= 2)
+				location.fastcgi_connections = std::atoi(tokens[1].c_str());
+		}
 		else if (line.find("cgi") == 0)
 		{
 			std::vector<std::string> tokens = _split(line, ' ');
@@ -256,6 +470,8 @@ void Config::_parseConfigFile(const std::string& path){
 	}
 	file.close();
 
+	_parseGlobalDirectives(content);
+
 	// Find all server blocks
 	size_t pos = 0;
 	while ((pos = content.find("server", pos)) != std::string::npos) {
@@ -274,6 +490,41 @@ void Config::_parseConfigFile(const std::string& path){
 	}
 }
 
+// Directives outside of any block apply to the whole process
+void Config::_parseGlobalDirectives(const std::string& content) {
+	std::vector<std::string> lines = _split(content, '\n');
+	int depth = 0;
+
+	for (size_t i = 0; i < lines.size(); ++i)
+	{
+		std::string line = _trim(lines[i]);
+		if (line.empty() || line[0] == '#') continue;
+
+		if (depth == 0 && line.find('{') == std::string::npos)
+		{
+			std::vector<std::string> tokens = _split(line, ' ');
+			std::string value = tokens.size() >= 2 ? tokens[1] : "";
+			if (!value.empty() && value[value.length() - 1] == ';')
+				value = value.substr(0, value.length() - 1);
+
+			if (tokens[0] == "event_backend")
+				_event_backend = value;
+			else if (tokens[0] == "workers" && std::atoi(value.c_str()) > 0)
+				_workers = std::atoi(value.c_str());
+			else if (tokens[0] == "max_connections" && std::atoi(value.c_str()) > 0)
+				_max_connections = std::atoi(value.c_str());
+			else if (tokens[0] == "aio_threads" && std::atoi(value.c_str()) > 0)
+				_aio_threads = std::atoi(value.c_str());
+		}
+
+		for (size_t j = 0; j < line.length(); ++j)
+		{
+			if (line[j] == '{') depth++;
+			else if (line[j] == '}') depth--;
+		}
+	}
+}
+
 size_t Config::_findClosingBrace(const std::string& str, size_t start) const
 {
 	int depth = 1;
@@ -0,0 +1,68 @@
+#include "ConfigSnapshot.hpp"
+#include "Config.hpp"
+#include "VirtualHosts.hpp"
+#include "Utils.hpp"
+#include <vector>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// Groups the server blocks by host:port. A specific address can't be
+// bound next to the wildcard on the same port, so it joins that listener.
+ConfigSnapshot::ConfigSnapshot(Config* config) : _config(config), _references(1) {
+	const std::vector<ServerConfig>& servers = _config->getServers();
+	std::vector<int> wildcard_ports;
+	for (size_t i = 0; i < servers.size(); ++i) {
+		struct in_addr address;
+		if (inet_pton(AF_INET, servers[i].host.c_str(), &address) <= 0 ||
+		    address.s_addr == INADDR_ANY) {
+			wildcard_ports.push_back(servers[i].port);
+		}
+	}
+
+	for (size_t i = 0; i < servers.size(); ++i) {
+		const ServerConfig& server = servers[i];
+		std::string host = server.host;
+		for (size_t j = 0; j < wildcard_ports.size(); ++j) {
+			if (wildcard_ports[j] == server.port) {
+				host = "0.0.0.0";
+			}
+		}
+
+		std::string address = host + ":" + Utils::intToString(server.port);
+		VirtualHosts*& listener = _listeners[address];
+		if (!listener) {
+			listener = new VirtualHosts(host, server.port);
+		}
+		listener->add(&server);
+	}
+}
+
+ConfigSnapshot::~ConfigSnapshot() {
+	for (std::map<std::string, VirtualHosts*>::iterator it = _listeners.begin();
+	     it != _listeners.end(); ++it) {
+		delete it->second;
+	}
+	delete _config;
+}
+
+void ConfigSnapshot::retain() {
+	_references++;
+}
+
+bool ConfigSnapshot::release() {
+	return --_references == 0;
+}
+
+// Getters
+const Config& ConfigSnapshot::getConfig() const {
+	return *_config;
+}
+
+const std::map<std::string, VirtualHosts*>& ConfigSnapshot::getListeners() const {
+	return _listeners;
+}
+
+const VirtualHosts* ConfigSnapshot::findListener(const std::string& address) const {
+	std::map<std::string, VirtualHosts*>::const_iterator it = _listeners.find(address);
+	return it == _listeners.end() ? NULL : it->second;
+}
@@ -0,0 +1,58 @@
+#include "Deflater.hpp"
+
+#include <cstring>
+
+Deflater::Deflater(const std::string& encoding, int level) : _valid(false), _finished(false) {
+	std::memset(&_stream, 0, sizeof(_stream));
+	// windowBits 15 writes a zlib header, +16 a gzip header and trailer
+	int window_bits = encoding == "gzip" ? 15 + 16 : 15;
+	_valid = deflateInit2(&_stream, level, Z_DEFLATED, window_bits, 8,
+	                      Z_DEFAULT_STRATEGY) == Z_OK;
+}
+
+Deflater::~Deflater() {
+	if (_valid) {
+		deflateEnd(&_stream);
+	}
+}
+
+bool Deflater::compress(const char* data, size_t length, bool finish, std::string& out) {
+	if (!_valid || _finished) {
+		return false;
+	}
+	_stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+	_stream.avail_in = static_cast<uInt>(length);
+
+	char buffer[16384];
+	int flush = finish ? Z_FINISH : Z_NO_FLUSH;
+	int result;
+	do {
+		_stream.next_out = reinterpret_cast<Bytef*>(buffer);
+		_stream.avail_out = sizeof(buffer);
+		result = deflate(&_stream, flush);
+		if (result == Z_STREAM_ERROR) {
+			return false;
+		}
+		out.append(buffer, sizeof(buffer) - _stream.avail_out);
+	} while (_stream.avail_out == 0 || (finish && result != Z_STREAM_END));
+
+	_finished = (result == Z_STREAM_END);
+	return true;
+}
+
+// Getters
+bool Deflater::isValid() const {
+	return _valid;
+}
+
+bool Deflater::isFinished() const {
+	return _finished;
+}
+
+bool Deflater::compressAll(const std::string& encoding, int level, const std::string& data,
+                           std::string& out) {
+	Deflater deflater(encoding, level);
+	out.clear();
+	out.reserve(data.length() / 2);
+	return deflater.compress(data.data(), data.length(), true, out);
+}
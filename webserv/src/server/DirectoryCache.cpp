@@ -0,0 +1,145 @@
+#include "DirectoryCache.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#ifdef __linux__
+#include <sys/syscall.h>
+#else
+#include <dirent.h>
+#endif
+
+#ifdef __linux__
+// Record layout of getdents64(), which glibc only wraps since 2.30
+struct LinuxDirent64 {
+	unsigned long long d_ino;
+	long long d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[1]; // NUL-terminated, d_reclen covers the rest
+};
+#endif
+
+DirectoryCache::DirectoryCache(size_t max_entries) : _max_entries(max_entries), _hits(0),
+                                                     _misses(0) {}
+
+DirectoryCache::~DirectoryCache() {}
+
+bool DirectoryCache::lookup(const std::string& path, const struct stat& info,
+                            DirectorySnapshot& snapshot) {
+	std::map<std::string, EntryList::iterator>::iterator it = _index.find(path);
+	if (it != _index.end() && _isCurrent(*it->second, info)) {
+		_entries.splice(_entries.begin(), _entries, it->second);
+		_hits++;
+		snapshot = it->second->snapshot;
+		return true;
+	}
+	_misses++;
+
+	std::vector<DirectoryEntry> entries;
+	if (!scan(path, entries)) {
+		return false;
+	}
+	if (it != _index.end()) {
+		_entries.erase(it->second);
+		_index.erase(it);
+	}
+	while (_entries.size() >= _max_entries && !_entries.empty()) {
+		_index.erase(_entries.back().path);
+		_entries.pop_back();
+	}
+
+	_entries.push_front(CachedDirectory());
+	CachedDirectory& entry = _entries.front();
+	entry.path = path;
+	entry.snapshot = DirectorySnapshot(entries);
+	entry.device = info.st_dev;
+	entry.inode = info.st_ino;
+	entry.mtime = info.st_mtime;
+#ifdef __linux__
+	entry.mtime_nsec = info.st_mtim.tv_nsec;
+#else
+	entry.mtime_nsec = 0;
+#endif
+	_index[path] = _entries.begin();
+	snapshot = entry.snapshot;
+	return true;
+}
+
+// Getters
+size_t DirectoryCache::getEntryCount() const { return _entries.size(); }
+unsigned long DirectoryCache::getHits() const { return _hits; }
+unsigned long DirectoryCache::getMisses() const { return _misses; }
+
+// getdents64() fills DIRECTORY_READ_SIZE per call, twice what readdir()
+// asks for, and its records are parsed in place; size and mtime still
+// take one fstatat() per entry
+bool DirectoryCache::scan(const std::string& path, std::vector<DirectoryEntry>& entries) {
+	int dir_fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dir_fd < 0) {
+		return false;
+	}
+#ifdef __linux__
+	std::vector<char> buffer(DIRECTORY_READ_SIZE);
+	while (true) {
+		long bytes = syscall(SYS_getdents64, dir_fd, &buffer[0], buffer.size());
+		if (bytes < 0 && errno == EINTR) {
+			continue;
+		}
+		if (bytes < 0) {
+			close(dir_fd);
+			return false;
+		}
+		if (bytes == 0) {
+			break;
+		}
+		for (long offset = 0; offset < bytes;) {
+			const LinuxDirent64* record = reinterpret_cast<const LinuxDirent64*>(&buffer[offset]);
+			_addEntry(dir_fd, record->d_name, entries);
+			offset += record->d_reclen;
+		}
+	}
+	close(dir_fd);
+#else
+	DIR* dir = fdopendir(dir_fd);
+	if (!dir) {
+		close(dir_fd);
+		return false;
+	}
+	while (struct dirent* record = readdir(dir)) {
+		_addEntry(dir_fd, record->d_name, entries);
+	}
+	closedir(dir);
+#endif
+	return true;
+}
+
+// Same device, inode and mtime (to the nanosecond where there is one)
+bool DirectoryCache::_isCurrent(const CachedDirectory& entry, const struct stat& info) const {
+#ifdef __linux__
+	if (entry.mtime_nsec != info.st_mtim.tv_nsec)
+		return false;
+#endif
+	return entry.device == info.st_dev && entry.inode == info.st_ino && entry.mtime == info.st_mtime;
+}
+
+// Symlinks are followed, so they list as what they point to; a dangling
+// one lists as an empty file
+void DirectoryCache::_addEntry(int dir_fd, const char* name, std::vector<DirectoryEntry>& entries) {
+	if (name[0] == '.') {
+		return;
+	}
+	entries.push_back(DirectoryEntry());
+	DirectoryEntry& entry = entries.back();
+	entry.name = name;
+	entry.is_dir = false;
+	entry.size = 0;
+	entry.mtime = 0;
+
+	struct stat info;
+	if (fstatat(dir_fd, name, &info, 0) == 0) {
+		entry.is_dir = S_ISDIR(info.st_mode);
+		entry.size = info.st_size;
+		entry.mtime = info.st_mtime;
+	}
+}
@@ -0,0 +1,321 @@
+#include "DirectoryListing.hpp"
+#include "Utils.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#define LISTING_NAME_WIDTH 50 // Column the date starts at in HTML listings
+
+// Orders entry indices by one key, name breaking ties
+class EntryLess {
+private:
+	const std::vector<DirectoryEntry>* _entries;
+	ListingSort _sort;
+
+public:
+	EntryLess(const std::vector<DirectoryEntry>& entries, ListingSort sort)
+		: _entries(&entries), _sort(sort) {}
+
+	bool operator()(unsigned a, unsigned b) const {
+		const DirectoryEntry& left = (*_entries)[a];
+		const DirectoryEntry& right = (*_entries)[b];
+		if (_sort == SORT_NAME && left.is_dir != right.is_dir) {
+			return left.is_dir;
+		}
+		if (_sort == SORT_SIZE && left.size != right.size) {
+			return left.size < right.size;
+		}
+		if (_sort == SORT_MTIME && left.mtime != right.mtime) {
+			return left.mtime < right.mtime;
+		}
+		return std::strcmp(left.name.c_str(), right.name.c_str()) < 0;
+	}
+};
+
+//
+/* DirectorySnapshot */
+//
+
+DirectorySnapshot::DirectorySnapshot() : _block(NULL) {}
+
+DirectorySnapshot::DirectorySnapshot(std::vector<DirectoryEntry>& entries) : _block(new Block()) {
+	_block->entries.swap(entries);
+	_block->references = 1;
+}
+
+DirectorySnapshot::DirectorySnapshot(const DirectorySnapshot& other) : _block(other._block) {
+	if (_block) {
+		_block->references++;
+	}
+}
+
+DirectorySnapshot& DirectorySnapshot::operator=(const DirectorySnapshot& other) {
+	if (_block != other._block) {
+		_release();
+		_block = other._block;
+		if (_block) {
+			_block->references++;
+		}
+	}
+	return *this;
+}
+
+DirectorySnapshot::~DirectorySnapshot() {
+	_release();
+}
+
+// Getters
+bool DirectorySnapshot::isNull() const {
+	return _block == NULL;
+}
+
+size_t DirectorySnapshot::getCount() const {
+	return _block ? _block->entries.size() : 0;
+}
+
+const DirectoryEntry& DirectorySnapshot::getEntry(unsigned index) const {
+	return _block->entries[index];
+}
+
+// Sorting 200k names takes over 100ms, so each order is built
+// once per scan and shared by every listing of it
+const std::vector<unsigned>& DirectorySnapshot::getOrder(ListingSort sort) const {
+	static const std::vector<unsigned> empty;
+	if (!_block) {
+		return empty;
+	}
+	std::vector<unsigned>& order = _block->orders[sort];
+	if (order.size() != _block->entries.size()) {
+		order.resize(_block->entries.size());
+		for (size_t i = 0; i < order.size(); ++i) {
+			order[i] = i;
+		}
+		std::sort(order.begin(), order.end(), EntryLess(_block->entries, sort));
+	}
+	return order;
+}
+
+void DirectorySnapshot::_release() {
+	if (_block && --_block->references == 0) {
+		delete _block;
+	}
+	_block = NULL;
+}
+
+//
+/* DirectoryListing */
+//
+
+DirectoryListing::DirectoryListing(const ListingOptions& options)
+	: _options(options), _order(&_options.snapshot.getOrder(_options.sort)), _position(0),
+	  _count(0), _started(false) {
+	size_t total = _options.snapshot.getCount();
+	if (_options.offset > total) {
+		_options.offset = total;
+	}
+	_count = total - _options.offset;
+	if (_options.limit > 0 && _options.limit < _count) {
+		_count = _options.limit;
+	}
+}
+
+bool DirectoryListing::next(std::string& out) {
+	if (!_started) {
+		_appendHead(out);
+		_started = true;
+	}
+	size_t total = _options.snapshot.getCount();
+	size_t end = std::min(_position + LISTING_BATCH_ENTRIES, _count);
+	for (; _position < end; ++_position) {
+		size_t rank = _options.offset + _position;
+		unsigned index = (*_order)[_options.descending ? total - 1 - rank : rank];
+		_appendEntry(out, _options.snapshot.getEntry(index), _position == 0);
+	}
+	if (_position < _count) {
+		return false;
+	}
+	_appendTail(out);
+	return true;
+}
+
+// Percent-encodes everything but unreserved characters and '/' (RFC 3986)
+void DirectoryListing::appendEncodedUri(std::string& out, const std::string& value) {
+	static const char hex[] = "0123456789ABCDEF";
+	for (size_t i = 0; i < value.length(); ++i) {
+		unsigned char c = value[i];
+		if (std::isalnum(c) || c == '-' || c == '.' || c == '_' || c == '~' || c == '/') {
+			out += c;
+		} else {
+			out += '%';
+			out += hex[c >> 4];
+			out += hex[c & 0xf];
+		}
+	}
+}
+
+void DirectoryListing::_appendHead(std::string& out) const {
+	if (_options.json) {
+		out += "{\"path\":\"";
+		_appendJson(out, _options.uri);
+		out += "\",\"total\":";
+		Utils::appendNumber(out, _options.snapshot.getCount());
+		out += ",\"offset\":";
+		Utils::appendNumber(out, _options.offset);
+		out += ",\"entries\":[";
+		return;
+	}
+
+	out += "<html><head><meta charset=\"utf-8\"><title>Index of ";
+	_appendHtml(out, _options.uri);
+	out += "</title></head><body>\n<h1>Index of ";
+	_appendHtml(out, _options.uri);
+	out += "</h1><hr><pre>";
+
+	// Column headers sort by their key, a second click reverses
+	static const char* labels[SORT_KEYS] = {"Name", "Size", "Last modified"};
+	static const ListingSort columns[SORT_KEYS] = {SORT_NAME, SORT_MTIME, SORT_SIZE};
+	for (size_t i = 0; i < SORT_KEYS; ++i) {
+		ListingSort sort = columns[i];
+		bool descending = sort == _options.sort && !_options.descending;
+		out += "<a href=\"";
+		_appendHtml(out, _query(sort, descending, 0));
+		out += "\">";
+		out += labels[sort];
+		out += "</a>";
+		if (sort == SORT_NAME) {
+			out.append(LISTING_NAME_WIDTH - 4, ' ');
+		} else if (sort == SORT_MTIME) {
+			out.append(20 - 13 + 20 - 4, ' '); // Size is right-aligned, like the sizes below
+		}
+	}
+	out += '\n';
+	if (_options.uri != "/") {
+		out += "<a href=\"../\">../</a>\n";
+	}
+}
+
+void DirectoryListing::_appendEntry(std::string& out, const DirectoryEntry& entry,
+                                    bool first) const {
+	if (_options.json) {
+		out += first ? "\n{\"name\":\"" : ",\n{\"name\":\"";
+		_appendJson(out, entry.name);
+		out += entry.is_dir ? "\",\"type\":\"directory\"" : "\",\"type\":\"file\"";
+		out += ",\"size\":";
+		Utils::appendNumber(out, entry.is_dir ? 0 : entry.size);
+		out += ",\"mtime\":";
+		Utils::appendNumber(out, entry.mtime);
+		out += '}';
+		return;
+	}
+
+	out += "<a href=\"";
+	_appendHtml(out, _options.uri); // Already in URI form
+	appendEncodedUri(out, entry.name);
+	out += entry.is_dir ? "/\">" : "\">";
+	_appendHtml(out, entry.name);
+	size_t width = entry.name.length();
+	if (entry.is_dir) {
+		out += '/';
+		width++;
+	}
+	out += "</a>";
+	out.append(width < LISTING_NAME_WIDTH ? LISTING_NAME_WIDTH - width : 1, ' ');
+
+	char date[32];
+	struct tm utc;
+	gmtime_r(&entry.mtime, &utc);
+	strftime(date, sizeof(date), "%Y-%m-%d %H:%M UTC", &utc);
+	out += date;
+
+	std::string size;
+	if (entry.is_dir) {
+		size = "-";
+	} else {
+		Utils::appendNumber(size, entry.size);
+	}
+	out.append(size.length() < 20 ? 20 - size.length() : 1, ' ');
+	out += size;
+	out += '\n';
+}
+
+void DirectoryListing::_appendTail(std::string& out) const {
+	if (_options.json) {
+		out += _count > 0 ? "\n]}\n" : "]}\n";
+		return;
+	}
+
+	out += "</pre><hr>";
+	size_t total = _options.snapshot.getCount();
+	if (_count < total) {
+		out += "Entries ";
+		Utils::appendNumber(out, _count > 0 ? _options.offset + 1 : _options.offset);
+		out += '-';
+		Utils::appendNumber(out, _options.offset + _count);
+		out += " of ";
+		Utils::appendNumber(out, total);
+		if (_options.offset > 0) {
+			size_t page = _options.limit > 0 ? _options.limit : _options.offset;
+			_appendPageLink(out, _options.offset > page ? _options.offset - page : 0, "Previous");
+		}
+		if (_options.offset + _count < total) {
+			_appendPageLink(out, _options.offset + _count, "Next");
+		}
+	}
+	out += "\n</body></html>\n";
+}
+
+void DirectoryListing::_appendPageLink(std::string& out, size_t offset, const char* label) const {
+	out += " <a href=\"";
+	_appendHtml(out, _query(_options.sort, _options.descending, offset));
+	out += "\">";
+	out += label;
+	out += "</a>";
+}
+
+// Query string selecting a page, limit carried over from this one
+std::string DirectoryListing::_query(ListingSort sort, bool descending, size_t offset) const {
+	static const char* keys[SORT_KEYS] = {"name", "size", "mtime"};
+	std::string query = "?sort=";
+	query += keys[sort];
+	query += descending ? "&order=desc" : "&order=asc";
+	if (offset > 0) {
+		query += "&offset=";
+		Utils::appendNumber(query, offset);
+	}
+	if (_options.limit > 0) {
+		query += "&limit=";
+		Utils::appendNumber(query, _options.limit);
+	}
+	return query;
+}
+
+void DirectoryListing::_appendHtml(std::string& out, const std::string& value) {
+	for (size_t i = 0; i < value.length(); ++i) {
+		switch (value[i]) {
+			case '&': out += "&amp;"; break;
+			case '<': out += "&lt;"; break;
+			case '>': out += "&gt;"; break;
+			case '"': out += "&quot;"; break;
+			default: out += value[i];
+		}
+	}
+}
+
+// File names are arbitrary bytes; control characters are escaped and
+// anything else is passed through, so valid UTF-8 names stay readable
+void DirectoryListing::_appendJson(std::string& out, const std::string& value) {
+	static const char hex[] = "0123456789abcdef";
+	for (size_t i = 0; i < value.length(); ++i) {
+		unsigned char c = value[i];
+		if (c == '"' || c == '\\') {
+			out += '\\';
+			out += c;
+		} else if (c < 0x20 || c == 0x7f) {
+			out += "\\u00";
+			out += hex[c >> 4];
+			out += hex[c & 0xf];
+		} else {
+			out += c;
+		}
+	}
+}
@@ -0,0 +1,260 @@
+#include "DiskIoPool.hpp"
+#include "Utils.hpp"
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <cerrno>
+#include <stdexcept>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+#define AIO_READ_CHUNK 65536 // Per pread() while prefetching
+
+DiskIoPool::DiskIoPool(size_t threads) : _stopping(false), _running(0), _submitted(0),
+                                         _completed(0), _rejected(0), _wait_usec_total(0),
+                                         _wait_usec_max(0) {
+#ifdef __linux__
+	int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (fd < 0) {
+		throw std::runtime_error("Failed to create disk I/O eventfd");
+	}
+	_notify_fds[0] = fd;
+	_notify_fds[1] = fd;
+#else
+	if (pipe(_notify_fds) < 0) {
+		throw std::runtime_error("Failed to create disk I/O pipe");
+	}
+	for (int i = 0; i < 2; ++i) {
+		fcntl(_notify_fds[i], F_SETFL, O_NONBLOCK);
+		fcntl(_notify_fds[i], F_SETFD, FD_CLOEXEC);
+	}
+#endif
+	pthread_mutex_init(&_mutex, NULL);
+	pthread_cond_init(&_wakeup, NULL);
+
+	// Signals stay with the event loop thread, which the handlers expect
+	sigset_t all;
+	sigset_t previous;
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &previous);
+	for (size_t i = 0; i < threads; ++i) {
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, _run, this) == 0) {
+			_threads.push_back(thread);
+		}
+	}
+	pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+	if (_threads.empty()) {
+		pthread_cond_destroy(&_wakeup);
+		pthread_mutex_destroy(&_mutex);
+		close(_notify_fds[0]);
+		if (_notify_fds[1] != _notify_fds[0]) {
+			close(_notify_fds[1]);
+		}
+		throw std::runtime_error("Failed to start disk I/O threads");
+	}
+}
+
+// A thread stuck on a dead disk holds up shutdown, as the loop would have
+DiskIoPool::~DiskIoPool() {
+	_stop();
+	for (size_t i = 0; i < _threads.size(); ++i) {
+		pthread_join(_threads[i], NULL);
+	}
+	for (size_t i = 0; i < _queue.size(); ++i) {
+		delete _queue[i];
+	}
+	for (size_t i = 0; i < _done.size(); ++i) {
+		delete _done[i];
+	}
+	pthread_cond_destroy(&_wakeup);
+	pthread_mutex_destroy(&_mutex);
+	close(_notify_fds[0]);
+	if (_notify_fds[1] != _notify_fds[0]) {
+		close(_notify_fds[1]);
+	}
+}
+
+bool DiskIoPool::submit(DiskJob* job) {
+	pthread_mutex_lock(&_mutex);
+	if (_queue.size() >= AIO_MAX_QUEUE) {
+		_rejected++;
+		pthread_mutex_unlock(&_mutex);
+		return false;
+	}
+	job->queued_at = Utils::monotonicUsec();
+	_queue.push_back(job);
+	_submitted++;
+	pthread_cond_signal(&_wakeup);
+	pthread_mutex_unlock(&_mutex);
+	return true;
+}
+
+// The notification is drained before the list is taken: a job finishing
+// in between signals again, so none is left behind with edge triggering
+void DiskIoPool::collect(std::vector<DiskJob*>& done) {
+	char drain[64];
+	while (read(_notify_fds[0], drain, sizeof(drain)) > 0) {}
+
+	pthread_mutex_lock(&_mutex);
+	done.insert(done.end(), _done.begin(), _done.end());
+	_done.clear();
+	pthread_mutex_unlock(&_mutex);
+}
+
+// Getters
+int DiskIoPool::getNotifyFd() const {
+	return _notify_fds[0];
+}
+
+size_t DiskIoPool::getThreadCount() const {
+	return _threads.size();
+}
+
+size_t DiskIoPool::getQueueDepth() {
+	pthread_mutex_lock(&_mutex);
+	size_t depth = _queue.size() + _running;
+	pthread_mutex_unlock(&_mutex);
+	return depth;
+}
+
+unsigned long DiskIoPool::getSubmitted() {
+	pthread_mutex_lock(&_mutex);
+	unsigned long submitted = _submitted;
+	pthread_mutex_unlock(&_mutex);
+	return submitted;
+}
+
+unsigned long DiskIoPool::getCompleted() {
+	pthread_mutex_lock(&_mutex);
+	unsigned long completed = _completed;
+	pthread_mutex_unlock(&_mutex);
+	return completed;
+}
+
+unsigned long DiskIoPool::getRejected() {
+	pthread_mutex_lock(&_mutex);
+	unsigned long rejected = _rejected;
+	pthread_mutex_unlock(&_mutex);
+	return rejected;
+}
+
+long long DiskIoPool::getWaitTotal() {
+	pthread_mutex_lock(&_mutex);
+	long long total = _wait_usec_total;
+	pthread_mutex_unlock(&_mutex);
+	return total;
+}
+
+long long DiskIoPool::getWaitMax() {
+	pthread_mutex_lock(&_mutex);
+	long long max = _wait_usec_max;
+	pthread_mutex_unlock(&_mutex);
+	return max;
+}
+
+void* DiskIoPool::_run(void* pool) {
+	static_cast<DiskIoPool*>(pool)->_work();
+	return NULL;
+}
+
+void DiskIoPool::_work() {
+	std::vector<char> buffer(AIO_READ_CHUNK);
+
+	while (true) {
+		pthread_mutex_lock(&_mutex);
+		while (_queue.empty() && !_stopping) {
+			pthread_cond_wait(&_wakeup, &_mutex);
+		}
+		if (_stopping) {
+			pthread_mutex_unlock(&_mutex);
+			return;
+		}
+		DiskJob* job = _queue.front();
+		_queue.pop_front();
+		_running++;
+		job->started_at = Utils::monotonicUsec();
+		long long waited = job->started_at - job->queued_at;
+		_wait_usec_total += waited;
+		if (waited > _wait_usec_max) {
+			_wait_usec_max = waited;
+		}
+		pthread_mutex_unlock(&_mutex);
+
+		_prefetch(*job, buffer);
+		job->finished_at = Utils::monotonicUsec();
+
+		pthread_mutex_lock(&_mutex);
+		_running--;
+		_completed++;
+		_done.push_back(job);
+		pthread_mutex_unlock(&_mutex);
+
+#ifdef __linux__
+		unsigned long long one = 1;
+		ssize_t ret = write(_notify_fds[1], &one, sizeof(one));
+#else
+		char one = 1;
+		ssize_t ret = write(_notify_fds[1], &one, sizeof(one));
+#endif
+		(void)ret; // Full means the loop has a wakeup pending already
+	}
+}
+
+// Does what the event loop is about to do, so that it finds the inode
+// and the first part of the data cached. Failures are left for the
+// loop to report.
+void DiskIoPool::_prefetch(const DiskJob& job, std::vector<char>& buffer) {
+	struct stat info;
+	if (stat(job.path.c_str(), &info) != 0) {
+		return;
+	}
+	if (S_ISREG(info.st_mode)) {
+		_prefetchFile(job.path, buffer);
+	} else if (S_ISDIR(info.st_mode) && !job.index.empty()) {
+		_prefetchFile(job.index, buffer);
+	}
+}
+
+void DiskIoPool::_prefetchFile(const std::string& path, std::vector<char>& buffer) {
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return;
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+		close(fd);
+		return;
+	}
+
+	off_t offset = 0;
+	off_t limit = info.st_size < AIO_PREFETCH_SIZE ? info.st_size : AIO_PREFETCH_SIZE;
+	while (offset < limit) {
+		ssize_t ret = pread(fd, &buffer[0], buffer.size(), offset);
+		if (ret < 0 && errno == EINTR) {
+			continue;
+		}
+		if (ret <= 0) {
+			break;
+		}
+		offset += ret;
+	}
+
+	// The rest is read by the kernel while the first part is sent
+#ifdef POSIX_FADV_WILLNEED
+	if (info.st_size > offset) {
+		posix_fadvise(fd, offset, info.st_size - offset, POSIX_FADV_WILLNEED);
+	}
+#endif
+	close(fd);
+}
+
+void DiskIoPool::_stop() {
+	pthread_mutex_lock(&_mutex);
+	_stopping = true;
+	pthread_cond_broadcast(&_wakeup);
+	pthread_mutex_unlock(&_mutex);
+}
@@ -0,0 +1,73 @@
+#include "EpollEventLoop.hpp"
+
+#ifdef __linux__
+
+#include <unistd.h>
+#include <cerrno>
+#include <stdexcept>
+
+#define EPOLL_MAX_EVENTS 1024
+
+EpollEventLoop::EpollEventLoop() : _epoll_fd(-1), _ready(EPOLL_MAX_EVENTS) {
+	_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (_epoll_fd < 0) {
+		throw std::runtime_error("Failed to create epoll instance");
+	}
+}
+
+EpollEventLoop::~EpollEventLoop() {
+	if (_epoll_fd != -1)
+		close(_epoll_fd);
+}
+
+bool EpollEventLoop::add(int fd, int events) {
+	struct epoll_event ev;
+	ev.events = _toEpoll(events);
+	ev.data.fd = fd;
+	return epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+bool EpollEventLoop::modify(int fd, int events) {
+	struct epoll_event ev;
+	ev.events = _toEpoll(events);
+	ev.data.fd = fd;
+	return epoll_ctl(_epoll_fd, EPOLL_CTL_MOD, fd, &ev) == 0;
+}
+
+void EpollEventLoop::remove(int fd) {
+	struct epoll_event ev; // Ignored, but required before Linux 2.6.9
+	epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, &ev);
+}
+
+int EpollEventLoop::wait(std::vector<IoEvent>& events, int timeout_ms) {
+	events.clear();
+
+	int count = epoll_wait(_epoll_fd, &_ready[0], _ready.size(), timeout_ms);
+	if (count <= 0) {
+		return count;
+	}
+
+	for (int i = 0; i < count; ++i) {
+		IoEvent event;
+		event.fd = _ready[i].data.fd;
+		event.events = 0;
+		if (_ready[i].events & EPOLLIN) event.events |= EVENT_READ;
+		if (_ready[i].events & EPOLLOUT) event.events |= EVENT_WRITE;
+		if (_ready[i].events & (EPOLLERR | EPOLLHUP)) event.events |= EVENT_ERROR;
+		events.push_back(event);
+	}
+	return count;
+}
+
+const char* EpollEventLoop::getName() const {
+	return "epoll";
+}
+
+unsigned int EpollEventLoop::_toEpoll(int events) {
+	unsigned int result = EPOLLET;
+	if (events & EVENT_READ) result |= EPOLLIN;
+	if (events & EVENT_WRITE) result |= EPOLLOUT;
+	return result;
+}
+
+#endif // __linux__
@@ -0,0 +1,58 @@
+#include "EventLoop.hpp"
+#include "PollEventLoop.hpp"
+#include "EpollEventLoop.hpp"
+#include "UringEventLoop.hpp"
+
+#include <iostream>
+#include <stdexcept>
+
+EventLoop::~EventLoop() {}
+
+bool EventLoop::hasCompletions() const {
+	return false;
+}
+
+bool EventLoop::addAcceptor(int listen_fd) {
+	(void)listen_fd;
+	return false;
+}
+
+bool EventLoop::addReceiver(int fd, int events) {
+	(void)fd;
+	(void)events;
+	return false;
+}
+
+bool EventLoop::send(int fd, const struct iovec* parts, int count) {
+	(void)fd;
+	(void)parts;
+	(void)count;
+	return false;
+}
+
+EventLoop* EventLoop::create(const std::string& backend) {
+	if (backend == "poll") {
+		return new PollEventLoop();
+	}
+#ifdef __linux__
+	if (backend == "uring") {
+		try {
+			return new UringEventLoop();
+		} catch (const std::exception& e) {
+			std::cerr << e.what() << ", falling back to poll" << std::endl;
+			return new PollEventLoop();
+		}
+	}
+	if (backend.empty() || backend == "epoll") {
+		try {
+			return new EpollEventLoop();
+		} catch (const std::exception& e) {
+			std::cerr << e.what() << ", falling back to poll" << std::endl;
+		}
+	}
+#endif
+	if (!backend.empty() && backend != "epoll") {
+		std::cerr << "Unknown event backend '" << backend << "', using poll" << std::endl;
+	}
+	return new PollEventLoop();
+}
@@ -0,0 +1,219 @@
+#include "FastCgiConnection.hpp"
+#include "CgiHandler.hpp"
+
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define FCGI_REQUEST_ID 1
+#define FCGI_READ_SIZE 65536
+
+FastCgiConnection::FastCgiConnection() : _fd(-1), _connecting(false), _request(NULL),
+                                         _output_offset(0), _input_done(false) {}
+
+FastCgiConnection::~FastCgiConnection() {
+	if (_fd != -1)
+		close(_fd);
+}
+
+bool FastCgiConnection::connect(const std::string& path) {
+	struct sockaddr_un address;
+	if (path.length() >= sizeof(address.sun_path)) {
+		return false;
+	}
+
+	_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (_fd < 0) {
+		return false;
+	}
+	fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL, 0) | O_NONBLOCK);
+	fcntl(_fd, F_SETFD, FD_CLOEXEC);
+
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+	if (::connect(_fd, (struct sockaddr*)&address, sizeof(address)) == 0) {
+		return true;
+	}
+	if (errno == EINPROGRESS) {
+		_connecting = true;
+		return true;
+	}
+	close(_fd);
+	_fd = -1;
+	return false;
+}
+
+void FastCgiConnection::begin(CgiHandler* request) {
+	_request = request;
+	_input.clear();
+	_input_done = false;
+
+	// FCGI_BeginRequestBody: role, flags, 5 reserved bytes
+	char body[8] = { 0, FCGI_RESPONDER, FCGI_KEEP_CONN, 0, 0, 0, 0, 0 };
+	_appendRecord(FCGI_BEGIN_REQUEST, body, sizeof(body));
+
+	// The CGI environment becomes name-value pairs, split across records
+	std::string params;
+	const std::vector<std::string>& env = request->getEnv();
+	for (size_t i = 0; i < env.size(); ++i) {
+		size_t equals = env[i].find('=');
+		_appendParam(params, env[i].substr(0, equals), env[i].substr(equals + 1));
+	}
+	for (size_t offset = 0; offset < params.length(); offset += FCGI_MAX_CONTENT) {
+		size_t length = params.length() - offset;
+		if (length > FCGI_MAX_CONTENT)
+			length = FCGI_MAX_CONTENT;
+		_appendRecord(FCGI_PARAMS, params.data() + offset, length);
+	}
+	_appendRecord(FCGI_PARAMS, NULL, 0);
+}
+
+CgiHandler* FastCgiConnection::release() {
+	CgiHandler* request = _request;
+	_request = NULL;
+	_output.clear();
+	_output_offset = 0;
+	return request;
+}
+
+int FastCgiConnection::flush() {
+	if (_connecting) {
+		int error = 0;
+		socklen_t length = sizeof(error);
+		if (getsockopt(_fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0) {
+			return -1;
+		}
+		_connecting = false;
+	}
+
+	while (true) {
+		// Encode more of the body once the previous records are out
+		if (_output_offset == _output.length()) {
+			_output.clear();
+			_output_offset = 0;
+			if (!_request || _input_done) {
+				return 1;
+			}
+			std::string chunk;
+			if (!_request->nextInput(chunk, FCGI_MAX_CONTENT)) {
+				return -1;
+			}
+			_appendRecord(FCGI_STDIN, chunk.data(), chunk.length());
+			if (chunk.empty()) {
+				_input_done = true;
+			}
+		}
+
+		ssize_t sent = send(_fd, _output.data() + _output_offset,
+		                    _output.length() - _output_offset, MSG_NOSIGNAL);
+		if (sent > 0) {
+			_output_offset += sent;
+		} else if (sent == -1 && errno == EINTR) {
+			continue;
+		} else if (sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			return 0;
+		} else {
+			return -1;
+		}
+	}
+}
+
+int FastCgiConnection::receive(std::string& out) {
+	char buffer[FCGI_READ_SIZE];
+
+	while (true) {
+		ssize_t bytes = read(_fd, buffer, sizeof(buffer));
+		if (bytes > 0) {
+			_input.append(buffer, bytes);
+			return _parseRecords(out);
+		}
+		if (bytes == 0) {
+			return -2;
+		}
+		if (errno == EINTR) {
+			continue;
+		}
+		return (errno == EAGAIN || errno == EWOULDBLOCK) ? -1 : -2;
+	}
+}
+
+// Getters
+int FastCgiConnection::getFd() const { return _fd; }
+CgiHandler* FastCgiConnection::getRequest() const { return _request; }
+bool FastCgiConnection::isIdle() const { return _request == NULL && !_connecting; }
+bool FastCgiConnection::isConnecting() const { return _connecting; }
+bool FastCgiConnection::hasPendingOutput() const {
+	return _connecting || _output_offset < _output.length() || (_request && !_input_done);
+}
+
+void FastCgiConnection::_appendRecord(int type, const char* data, size_t length) {
+	unsigned char padding = static_cast<unsigned char>((8 - length % 8) % 8);
+	char header[FCGI_HEADER_LEN] = {
+		FCGI_VERSION_1, static_cast<char>(type),
+		0, FCGI_REQUEST_ID,
+		static_cast<char>((length >> 8) & 0xff), static_cast<char>(length & 0xff),
+		static_cast<char>(padding), 0
+	};
+	_output.append(header, sizeof(header));
+	if (length > 0)
+		_output.append(data, length);
+	_output.append(padding, '\0');
+}
+
+// Lengths below 128 take one byte, longer ones four with the top bit set
+void FastCgiConnection::_appendParam(std::string& params, const std::string& name,
+                                     const std::string& value) {
+	const std::string* parts[2] = { &name, &value };
+	for (int i = 0; i < 2; ++i) {
+		size_t length = parts[i]->length();
+		if (length < 128) {
+			params += static_cast<char>(length);
+		} else {
+			params += static_cast<char>(((length >> 24) & 0x7f) | 0x80);
+			params += static_cast<char>((length >> 16) & 0xff);
+			params += static_cast<char>((length >> 8) & 0xff);
+			params += static_cast<char>(length & 0xff);
+		}
+	}
+	params += name;
+	params += value;
+}
+
+// Consumes every complete record in _input
+int FastCgiConnection::_parseRecords(std::string& out) {
+	size_t offset = 0;
+	int result = 0;
+
+	while (_input.length() - offset >= FCGI_HEADER_LEN) {
+		const unsigned char* header = reinterpret_cast<const unsigned char*>(_input.data() + offset);
+		size_t content_length = (header[4] << 8) | header[5];
+		size_t record_length = FCGI_HEADER_LEN + content_length + header[6];
+		if (_input.length() - offset < record_length) {
+			break;
+		}
+
+		const char* content = _input.data() + offset + FCGI_HEADER_LEN;
+		int type = header[1];
+		if (type == FCGI_STDOUT) {
+			out.append(content, content_length);
+		} else if (type == FCGI_STDERR) {
+			std::cerr << "FastCGI: " << std::string(content, content_length);
+		} else if (type == FCGI_END_REQUEST) {
+			result = 1;
+		}
+		offset += record_length;
+		if (result == 1) {
+			break; // Nothing else is sent for this request
+		}
+	}
+
+	_input.erase(0, offset);
+	return result;
+}
@@ -0,0 +1,102 @@
+#include "FastCgiPool.hpp"
+#include "FastCgiConnection.hpp"
+#include "CgiHandler.hpp"
+
+#include <algorithm>
+
+FastCgiPool::FastCgiPool(const std::string& path, size_t max_connections)
+	: _path(path), _max_connections(max_connections > 0 ? max_connections : 1) {}
+
+FastCgiPool::~FastCgiPool() {
+	for (size_t i = 0; i < _connections.size(); ++i) {
+		delete _connections[i]->release();
+		delete _connections[i];
+	}
+	for (size_t i = 0; i < _pending.size(); ++i) {
+		delete _pending[i];
+	}
+}
+
+FastCgiConnection* FastCgiPool::acquire(bool& created) {
+	created = false;
+	for (size_t i = 0; i < _connections.size(); ++i) {
+		if (_connections[i]->isIdle()) {
+			return _connections[i];
+		}
+	}
+	if (_connections.size() >= _max_connections) {
+		return NULL;
+	}
+
+	FastCgiConnection* connection = new FastCgiConnection();
+	if (!connection->connect(_path)) {
+		delete connection;
+		return NULL;
+	}
+	_connections.push_back(connection);
+	created = true;
+	return connection;
+}
+
+void FastCgiPool::remove(FastCgiConnection* connection) {
+	std::vector<FastCgiConnection*>::iterator it =
+		std::find(_connections.begin(), _connections.end(), connection);
+	if (it != _connections.end()) {
+		_connections.erase(it);
+	}
+	delete connection;
+}
+
+FastCgiConnection* FastCgiPool::find(const CgiHandler* request) const {
+	for (size_t i = 0; i < _connections.size(); ++i) {
+		if (_connections[i]->getRequest() == request) {
+			return _connections[i];
+		}
+	}
+	return NULL;
+}
+
+FastCgiConnection* FastCgiPool::getConnection(int fd) const {
+	for (size_t i = 0; i < _connections.size(); ++i) {
+		if (_connections[i]->getFd() == fd) {
+			return _connections[i];
+		}
+	}
+	return NULL;
+}
+
+void FastCgiPool::enqueue(CgiHandler* request) {
+	_pending.push_back(request);
+}
+
+CgiHandler* FastCgiPool::dequeue() {
+	if (_pending.empty()) {
+		return NULL;
+	}
+	CgiHandler* request = _pending.front();
+	_pending.pop_front();
+	return request;
+}
+
+bool FastCgiPool::cancel(CgiHandler* request) {
+	std::deque<CgiHandler*>::iterator it = std::find(_pending.begin(), _pending.end(), request);
+	if (it == _pending.end()) {
+		return false;
+	}
+	_pending.erase(it);
+	return true;
+}
+
+// Getters
+const std::string& FastCgiPool::getPath() const { return _path; }
+size_t FastCgiPool::getConnectionCount() const { return _connections.size(); }
+bool FastCgiPool::hasPending() const { return !_pending.empty(); }
+
+void FastCgiPool::getRequests(std::vector<CgiHandler*>& requests) const {
+	for (size_t i = 0; i < _connections.size(); ++i) {
+		if (_connections[i]->getRequest()) {
+			requests.push_back(_connections[i]->getRequest());
+		}
+	}
+	requests.insert(requests.end(), _pending.begin(), _pending.end());
+}
@@ -0,0 +1,166 @@
+#include "FileCache.hpp"
+#include "Utils.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+
+FileCache::FileCache(size_t max_size, size_t max_file_size, int revalidate)
+	: _max_size(max_size), _max_file_size(max_file_size), _revalidate(revalidate), _size(0),
+	  _hits(0), _misses(0), _evictions(0) {}
+
+FileCache::~FileCache() {}
+
+const CachedFile* FileCache::lookup(const std::string& key) {
+	if (!isEnabled()) {
+		return NULL;
+	}
+	std::map<std::string, EntryList::iterator>::iterator it = _index.find(key);
+	if (it == _index.end()) {
+		_misses++;
+		return NULL;
+	}
+
+	EntryList::iterator entry = it->second;
+	time_t now = time(NULL);
+	if (now - entry->validated_at >= _revalidate) {
+		struct stat info;
+		if (stat(entry->path.c_str(), &info) != 0 || !_isCurrent(*entry, info)) {
+			_erase(entry);
+			_misses++;
+			return NULL;
+		}
+		entry->validated_at = now;
+	}
+
+	// Move to the front, iterators stay valid
+	_entries.splice(_entries.begin(), _entries, entry);
+	_hits++;
+	return &*entry;
+}
+
+const CachedFile* FileCache::insert(const std::string& key, const std::string& path,
+                                    const struct stat& info, const std::string& content_type) {
+	size_t size = static_cast<size_t>(info.st_size);
+	if (!isEnabled() || size > _max_file_size || size > _max_size) {
+		return NULL;
+	}
+
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return NULL;
+	}
+	std::string body(size, '\0');
+	size_t offset = 0;
+	while (offset < size) {
+		ssize_t bytes = read(fd, &body[offset], size - offset);
+		if (bytes < 0 && errno == EINTR) {
+			continue;
+		}
+		if (bytes <= 0) {
+			break;
+		}
+		offset += bytes;
+	}
+	close(fd);
+	if (offset != size) {
+		return NULL; // Changed while we read it
+	}
+
+	std::map<std::string, EntryList::iterator>::iterator existing = _index.find(key);
+	if (existing != _index.end()) {
+		_erase(existing->second);
+	}
+
+	// Evict least recently used entries until the new body fits
+	while (_size + size > _max_size && !_entries.empty()) {
+		_erase(--_entries.end());
+		_evictions++;
+	}
+
+	_entries.push_front(CachedFile());
+	CachedFile& entry = _entries.front();
+	entry.key = key;
+	entry.path = path;
+	entry.body = SharedBuffer(body);
+	entry.content_type = content_type;
+	entry.last_modified = Utils::httpDate(info.st_mtime);
+	entry.etag = Utils::makeEtag(info.st_ino, info.st_size, info.st_mtime);
+	entry.device = info.st_dev;
+	entry.inode = info.st_ino;
+	entry.mtime = info.st_mtime;
+#ifdef __linux__
+	entry.mtime_nsec = info.st_mtim.tv_nsec;
+#else
+	entry.mtime_nsec = 0;
+#endif
+	entry.size = info.st_size;
+	entry.validated_at = time(NULL);
+
+	_index[key] = _entries.begin();
+	_size += size;
+	return &entry;
+}
+
+void FileCache::invalidate(const std::string& path) {
+	EntryList::iterator it = _entries.begin();
+	while (it != _entries.end()) {
+		EntryList::iterator current = it++;
+		if (current->key == path || current->path == path) {
+			_erase(current);
+		}
+	}
+}
+
+const SharedBuffer* FileCache::addEncoding(const std::string& key, const std::string& encoding,
+                                           const SharedBuffer& body) {
+	std::map<std::string, EntryList::iterator>::iterator it = _index.find(key);
+	if (it == _index.end()) {
+		return NULL;
+	}
+	EntryList::iterator entry = it->second;
+	_entries.splice(_entries.begin(), _entries, entry);
+
+	// Make room from the cold end, never evicting the entry itself
+	while (_size + body.getLength() > _max_size && --_entries.end() != entry) {
+		_erase(--_entries.end());
+		_evictions++;
+	}
+	if (_size + body.getLength() > _max_size) {
+		return NULL;
+	}
+
+	SharedBuffer& stored = entry->encoded[encoding];
+	_size -= stored.getLength();
+	stored = body;
+	_size += stored.getLength();
+	return &stored;
+}
+
+// Getters
+bool FileCache::isEnabled() const { return _max_size > 0; }
+bool FileCache::contains(const std::string& key) const { return _index.find(key) != _index.end(); }
+size_t FileCache::getSize() const { return _size; }
+size_t FileCache::getEntryCount() const { return _entries.size(); }
+unsigned long FileCache::getHits() const { return _hits; }
+unsigned long FileCache::getMisses() const { return _misses; }
+unsigned long FileCache::getEvictions() const { return _evictions; }
+
+bool FileCache::_isCurrent(const CachedFile& entry, const struct stat& info) const {
+#ifdef __linux__
+	if (entry.mtime_nsec != info.st_mtim.tv_nsec)
+		return false;
+#endif
+	return S_ISREG(info.st_mode) && entry.device == info.st_dev && entry.inode == info.st_ino &&
+	       entry.mtime == info.st_mtime && entry.size == info.st_size;
+}
+
+void FileCache::_erase(EntryList::iterator entry) {
+	_size -= entry->body.getLength();
+	for (std::map<std::string, SharedBuffer>::const_iterator it = entry->encoded.begin();
+	     it != entry->encoded.end(); ++it) {
+		_size -= it->second.getLength();
+	}
+	_index.erase(entry->key);
+	_entries.erase(entry);
+}
@@ -0,0 +1,432 @@
+#include "HttpParser.hpp"
+#include <cstring>
+
+enum ParserState {
+	S_START,
+	S_METHOD,
+	S_URI,
+	S_VERSION,
+	S_REQUEST_LINE_LF,
+	S_HEADER_START,
+	S_HEADER_NAME,
+	S_HEADER_VALUE_START,
+	S_HEADER_VALUE,
+	S_HEADER_LF,
+	S_HEADERS_END_LF,
+	S_BODY,
+	S_CHUNK_SIZE,
+	S_CHUNK_EXT,
+	S_CHUNK_SIZE_LF,
+	S_CHUNK_DATA,
+	S_CHUNK_DATA_CR,
+	S_CHUNK_DATA_LF,
+	S_TRAILER_START,
+	S_TRAILER,
+	S_TRAILER_LF,
+	S_DONE,
+	S_ERROR
+};
+
+// RFC 9110 tchar
+static bool isTokenChar(unsigned char c) {
+	if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) {
+		return true;
+	}
+	return c != 0 && std::strchr("!#$%&'*+-.^_`|~", c) != NULL;
+}
+
+static StrRef makeRef(size_t start, size_t end) {
+	StrRef ref;
+	ref.offset = start;
+	ref.length = end - start;
+	return ref;
+}
+
+HttpParser::HttpParser() {
+	reset();
+}
+
+HttpParser::~HttpParser() {}
+
+void HttpParser::reset() {
+	_state = S_START;
+	_pos = 0;
+	_token_start = 0;
+	_token_end = 0;
+	_method = StrRef();
+	_uri = StrRef();
+	_version = StrRef();
+	_headers.clear();
+	_current = HeaderRef();
+	_body_offset = 0;
+	_content_length = 0;
+	_body_skipped = 0;
+	_has_content_length = false;
+	_chunked = false;
+	_has_transfer_encoding = false;
+	_decoded_end = 0;
+	_chunk_remaining = 0;
+	_trailer_bytes = 0;
+	_error_status = 0;
+}
+
+HttpParser::Result HttpParser::parse(std::string& buffer) {
+	const char* data = buffer.data();
+	size_t size = buffer.size();
+
+	while (_state < S_BODY && _pos < size) {
+		if (_pos >= MAX_HEADER_SIZE) {
+			return _fail(431);
+		}
+
+		unsigned char c = data[_pos];
+		switch (_state) {
+			case S_START:
+				// Ignore empty lines before the request line (RFC 9112 2.2)
+				if (c != '\r' && c != '\n') {
+					_token_start = _pos;
+					_state = S_METHOD;
+					continue;
+				}
+				break;
+
+			case S_METHOD:
+				if (c == ' ') {
+					if (_pos == _token_start) return _fail(400);
+					_method = makeRef(_token_start, _pos);
+					_token_start = _pos + 1;
+					_state = S_URI;
+				} else if (!isTokenChar(c)) {
+					return _fail(400);
+				}
+				break;
+
+			case S_URI:
+				if (c == ' ') {
+					if (_pos == _token_start) return _fail(400);
+					_uri = makeRef(_token_start, _pos);
+					_token_start = _pos + 1;
+					_state = S_VERSION;
+				} else if (c <= ' ' || c == 0x7f) {
+					return _fail(400);
+				}
+				break;
+
+			case S_VERSION:
+				if (c == '\r' || c == '\n') {
+					_version = makeRef(_token_start, _pos);
+					if (_version.length != 8 || std::memcmp(data + _token_start, "HTTP/1.", 7) != 0) {
+						return _fail(_version.length > 5 && std::memcmp(data + _token_start, "HTTP/", 5) == 0 ? 505 : 400);
+					}
+					if (data[_token_start + 7] != '0' && data[_token_start + 7] != '1') {
+						return _fail(505);
+					}
+					_state = (c == '\r') ? S_REQUEST_LINE_LF : S_HEADER_START;
+				}
+				break;
+
+			case S_REQUEST_LINE_LF:
+				if (c != '\n') return _fail(400);
+				_state = S_HEADER_START;
+				break;
+
+			case S_HEADER_START:
+				if (c == '\r') {
+					_state = S_HEADERS_END_LF;
+				} else if (c == '\n') {
+					_state = S_HEADERS_END_LF;
+					continue;
+				} else if (c == ' ' || c == '\t') {
+					return _fail(400); // Obsolete line folding
+				} else {
+					_token_start = _pos;
+					_state = S_HEADER_NAME;
+					continue;
+				}
+				break;
+
+			case S_HEADER_NAME:
+				if (c == ':') {
+					if (_pos == _token_start) return _fail(400);
+					_current.name = makeRef(_token_start, _pos);
+					_state = S_HEADER_VALUE_START;
+				} else if (!isTokenChar(c)) {
+					return _fail(400);
+				}
+				break;
+
+			case S_HEADER_VALUE_START:
+				if (c != ' ' && c != '\t') {
+					_token_start = _pos;
+					_token_end = _pos;
+					_state = S_HEADER_VALUE;
+					continue;
+				}
+				break;
+
+			case S_HEADER_VALUE:
+				if (c == '\r' || c == '\n') {
+					_current.value = makeRef(_token_start, _token_end);
+					if (!_onHeaderComplete(buffer)) return _fail(400);
+					_state = (c == '\r') ? S_HEADER_LF : S_HEADER_START;
+				} else if (c != ' ' && c != '\t') {
+					_token_end = _pos + 1;
+				}
+				break;
+
+			case S_HEADER_LF:
+				if (c != '\n') return _fail(400);
+				_state = S_HEADER_START;
+				break;
+
+			case S_HEADERS_END_LF: {
+				if (c != '\n') return _fail(400);
+				int status = _onHeadersComplete();
+				if (status != 0) return _fail(status);
+				_body_offset = _pos + 1;
+				_decoded_end = _body_offset;
+				_token_end = 0;
+				_state = _chunked ? S_CHUNK_SIZE : S_BODY;
+				break;
+			}
+		}
+		_pos++;
+	}
+
+	if (_state == S_ERROR) {
+		return ERROR;
+	}
+	if (_state < S_BODY) {
+		return INCOMPLETE;
+	}
+	if (_state > S_BODY && _state < S_DONE) {
+		return _parseChunked(buffer);
+	}
+
+	// Body bytes are not inspected, only counted
+	if (_state == S_BODY) {
+		_pos = size;
+		if (size - _body_offset + _body_skipped < _content_length) {
+			return INCOMPLETE;
+		}
+		_state = S_DONE;
+	}
+	return COMPLETE;
+}
+
+void HttpParser::skipBody(size_t length) {
+	_body_skipped += length;
+	if (_chunked) {
+		// The bytes came from the front of the decoded region
+		_decoded_end -= length;
+		_pos -= length;
+	}
+}
+
+// Decodes chunked framing in place: chunk data is moved down to
+// _decoded_end so the decoded body is contiguous after the headers,
+// and the framing bytes are dropped from the buffer once complete.
+HttpParser::Result HttpParser::_parseChunked(std::string& buffer) {
+	size_t size = buffer.size();
+
+	while (_state != S_DONE && _pos < size) {
+		unsigned char c = buffer[_pos];
+
+		if (_state >= S_TRAILER_START && ++_trailer_bytes > MAX_HEADER_SIZE) {
+			return _fail(431);
+		}
+
+		switch (_state) {
+			case S_CHUNK_SIZE: {
+				int digit = -1;
+				if (c >= '0' && c <= '9') digit = c - '0';
+				else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+				else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+
+				if (digit >= 0) {
+					if (_chunk_remaining > (static_cast<size_t>(-1) >> 4)) return _fail(413);
+					_chunk_remaining = (_chunk_remaining << 4) | digit;
+					_token_end++;
+				} else if (_token_end == 0) {
+					return _fail(400); // No size digits
+				} else if (c == ';' || c == ' ' || c == '\t') {
+					_state = S_CHUNK_EXT;
+				} else if (c == '\r') {
+					_state = S_CHUNK_SIZE_LF;
+				} else if (c == '\n') {
+					_state = S_CHUNK_SIZE_LF;
+					continue;
+				} else {
+					return _fail(400);
+				}
+				break;
+			}
+
+			case S_CHUNK_EXT:
+				// Extensions are ignored
+				if (c == '\r') _state = S_CHUNK_SIZE_LF;
+				else if (c == '\n') { _state = S_CHUNK_SIZE_LF; continue; }
+				break;
+
+			case S_CHUNK_SIZE_LF:
+				if (c != '\n') return _fail(400);
+				_token_end = 0;
+				_state = (_chunk_remaining == 0) ? S_TRAILER_START : S_CHUNK_DATA;
+				break;
+
+			case S_CHUNK_DATA: {
+				size_t available = size - _pos;
+				size_t length = available < _chunk_remaining ? available : _chunk_remaining;
+				if (_decoded_end != _pos) {
+					buffer.replace(_decoded_end, length, buffer, _pos, length);
+				}
+				_decoded_end += length;
+				_pos += length;
+				_chunk_remaining -= length;
+				_content_length += length;
+				if (_chunk_remaining == 0) {
+					_state = S_CHUNK_DATA_CR;
+				}
+				continue;
+			}
+
+			case S_CHUNK_DATA_CR:
+				if (c == '\r') _state = S_CHUNK_DATA_LF;
+				else if (c == '\n') { _state = S_CHUNK_SIZE; _chunk_remaining = 0; }
+				else return _fail(400);
+				break;
+
+			case S_CHUNK_DATA_LF:
+				if (c != '\n') return _fail(400);
+				_chunk_remaining = 0;
+				_state = S_CHUNK_SIZE;
+				break;
+
+			case S_TRAILER_START:
+				// Trailer fields are accepted and discarded
+				if (c == '\r') _state = S_TRAILER_LF;
+				else if (c == '\n') { _state = S_DONE; }
+				else _state = S_TRAILER;
+				break;
+
+			case S_TRAILER:
+				if (c == '\n') _state = S_TRAILER_START;
+				break;
+
+			case S_TRAILER_LF:
+				if (c != '\n') return _fail(400);
+				_state = S_DONE;
+				break;
+		}
+
+		_pos++;
+	}
+
+	// Drop the framing consumed so far. Everything up to _pos is parsed,
+	// so only the unparsed tail (usually nothing) has to move.
+	buffer.erase(_decoded_end, _pos - _decoded_end);
+	_pos = _decoded_end;
+
+	return _state == S_DONE ? COMPLETE : INCOMPLETE;
+}
+
+HttpParser::Result HttpParser::_fail(int status) {
+	_state = S_ERROR;
+	_error_status = status;
+	return ERROR;
+}
+
+bool HttpParser::_onHeaderComplete(const std::string& buffer) {
+	_headers.push_back(_current);
+
+	// Length checks first: most headers are neither of these
+	size_t name_length = _current.name.length;
+	if (name_length == 14 && equalsIgnoreCase(buffer, _current.name, "content-length")) {
+		if (_current.value.length == 0) {
+			return false;
+		}
+
+		size_t length = 0;
+		for (size_t i = 0; i < _current.value.length; ++i) {
+			char c = buffer[_current.value.offset + i];
+			if (c < '0' || c > '9' || length > (static_cast<size_t>(-1) - 9) / 10) {
+				return false;
+			}
+			length = length * 10 + (c - '0');
+		}
+
+		// Conflicting duplicates are a smuggling vector (RFC 9112 6.3)
+		if (_has_content_length && length != _content_length) {
+			return false;
+		}
+		_has_content_length = true;
+		_content_length = length;
+	} else if (name_length == 17 && equalsIgnoreCase(buffer, _current.name, "transfer-encoding")) {
+		// Only "chunked" alone is supported, it must be the final coding
+		_has_transfer_encoding = true;
+		_chunked = equalsIgnoreCase(buffer, _current.value, "chunked");
+	}
+	return true;
+}
+
+// Returns an error status, or 0 if the body framing is acceptable
+int HttpParser::_onHeadersComplete() {
+	if (_has_transfer_encoding) {
+		if (!_chunked) {
+			return 501;
+		}
+		if (_has_content_length) {
+			return 400; // Ambiguous framing (RFC 9112 6.3)
+		}
+		_content_length = 0; // Grows as chunks are decoded
+	}
+	return 0;
+}
+
+// Getters
+bool HttpParser::areHeadersComplete() const { return _state >= S_BODY && _state != S_ERROR; }
+const StrRef& HttpParser::getMethod() const { return _method; }
+const StrRef& HttpParser::getUri() const { return _uri; }
+const StrRef& HttpParser::getVersion() const { return _version; }
+const std::vector<HeaderRef>& HttpParser::getHeaders() const { return _headers; }
+size_t HttpParser::getBodyOffset() const { return _body_offset; }
+size_t HttpParser::getContentLength() const { return _content_length; }
+bool HttpParser::isChunked() const { return _chunked; }
+
+size_t HttpParser::getMessageLength() const {
+	if (_chunked) {
+		return _decoded_end;
+	}
+	return _body_offset + _content_length - _body_skipped;
+}
+
+size_t HttpParser::getBufferedBodyLength(const std::string& buffer) const {
+	if (_chunked) {
+		return _decoded_end - _body_offset;
+	}
+	size_t available = buffer.size() - _body_offset;
+	size_t wanted = _content_length - _body_skipped;
+	return available < wanted ? available : wanted;
+}
+int HttpParser::getErrorStatus() const { return _error_status; }
+
+std::string HttpParser::toString(const std::string& buffer, const StrRef& ref) {
+	return std::string(buffer.data() + ref.offset, ref.length);
+}
+
+bool HttpParser::equalsIgnoreCase(const std::string& buffer, const StrRef& ref, const char* lower) {
+	size_t length = std::strlen(lower);
+	if (ref.length != length) {
+		return false;
+	}
+	for (size_t i = 0; i < length; ++i) {
+		char c = buffer[ref.offset + i];
+		if (c >= 'A' && c <= 'Z') {
+			c += 'a' - 'A';
+		}
+		if (c != lower[i]) {
+			return false;
+		}
+	}
+	return true;
+}
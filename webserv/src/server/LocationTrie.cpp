@@ -0,0 +1,111 @@
+#include "LocationTrie.hpp"
+
+LocationTrie::LocationTrie() {
+	clear();
+}
+
+LocationTrie::~LocationTrie() {}
+
+void LocationTrie::insert(const std::string& path, int index) {
+	size_t node = 0;
+	size_t pos = 0;
+	while (pos < path.length()) {
+		if (path[pos] == '/') {
+			pos++; // Empty segments ("//") are ignored
+			continue;
+		}
+		size_t stop = path.find('/', pos);
+		if (stop == std::string::npos) {
+			stop = path.length();
+		}
+		size_t child = _child(node, path.data() + pos, stop - pos);
+		node = child ? child : _addChild(node, path.substr(pos, stop - pos));
+		pos = stop;
+	}
+
+	// "/" itself covers everything, other trailing slashes only what is below
+	bool dir = node != 0 && path[path.length() - 1] == '/';
+	int& slot = dir ? _nodes[node].dir_location : _nodes[node].location;
+	if (slot == -1) {
+		slot = index;
+	}
+}
+
+void LocationTrie::clear() {
+	_nodes.clear();
+	_nodes.push_back(Node());
+	_nodes[0].location = -1;
+	_nodes[0].dir_location = -1;
+}
+
+// Getters
+int LocationTrie::find(const std::string& uri) const {
+	size_t end = uri.find('?');
+	if (end == std::string::npos) {
+		end = uri.length();
+	}
+
+	int best = _nodes[0].location;
+	size_t node = 0;
+	size_t pos = 0;
+	while (pos < end) {
+		if (uri[pos] == '/') {
+			pos++;
+			continue;
+		}
+		size_t stop = pos;
+		while (stop < end && uri[stop] != '/') {
+			stop++;
+		}
+		node = _child(node, uri.data() + pos, stop - pos);
+		if (node == 0) {
+			break;
+		}
+
+		const Node& current = _nodes[node];
+		if (stop < end && current.dir_location != -1) {
+			best = current.dir_location;
+		} else if (current.location != -1) {
+			best = current.location;
+		}
+		pos = stop;
+	}
+	return best;
+}
+
+// Binary search, children are kept sorted
+size_t LocationTrie::_child(size_t node, const char* segment, size_t length) const {
+	const std::vector<size_t>& children = _nodes[node].children;
+	size_t low = 0;
+	size_t high = children.size();
+	while (low < high) {
+		size_t mid = (low + high) / 2;
+		int cmp = _nodes[children[mid]].segment.compare(0, std::string::npos, segment, length);
+		if (cmp == 0) {
+			return children[mid];
+		}
+		if (cmp < 0) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return 0;
+}
+
+size_t LocationTrie::_addChild(size_t node, const std::string& segment) {
+	Node child;
+	child.segment = segment;
+	child.location = -1;
+	child.dir_location = -1;
+	_nodes.push_back(child);
+	size_t index = _nodes.size() - 1;
+
+	std::vector<size_t>& children = _nodes[node].children;
+	std::vector<size_t>::iterator it = children.begin();
+	while (it != children.end() && _nodes[*it].segment < segment) {
+		++it;
+	}
+	children.insert(it, index);
+	return index;
+}
@@ -0,0 +1,283 @@
+#include "Metrics.hpp"
+#include "Utils.hpp"
+#include <unistd.h>
+
+// location="path", escaped the way the text format requires of label values
+static std::string locationLabel(const std::string& path) {
+	std::string label = "location=\"";
+	for (size_t i = 0; i < path.length(); ++i) {
+		if (path[i] == '\\' || path[i] == '"') {
+			label += '\\';
+			label += path[i];
+		} else if (path[i] == '\n') {
+			label += "\\n";
+		} else {
+			label += path[i];
+		}
+	}
+	label += '"';
+	return label;
+}
+
+// Microseconds as decimal seconds, the unit Prometheus expects
+static void appendSeconds(std::string& out, unsigned long long usec) {
+	Utils::appendNumber(out, usec / 1000000);
+	unsigned long long fraction = usec % 1000000;
+	if (fraction == 0) {
+		return;
+	}
+	char digits[7];
+	for (int i = 5; i >= 0; --i) {
+		digits[i] = '0' + fraction % 10;
+		fraction /= 10;
+	}
+	int length = 6;
+	while (digits[length - 1] == '0') {
+		length--;
+	}
+	out += '.';
+	out.append(digits, length);
+}
+
+//
+/* LatencyHistogram */
+//
+
+LatencyHistogram::LatencyHistogram() : _count(0), _sum_usec(0) {
+	for (size_t i = 0; i <= LATENCY_BUCKETS; ++i) {
+		_buckets[i] = 0;
+	}
+}
+
+void LatencyHistogram::record(long long usec) {
+	if (usec < 0) {
+		usec = 0; // The clock is monotonic, but be safe
+	}
+	_buckets[bucketOf(usec)]++;
+	_count++;
+	_sum_usec += usec;
+}
+
+void LatencyHistogram::write(std::string& out, const std::string& name,
+                             const std::string& labels) const {
+	std::string prefix = labels.empty() ? "" : labels + ",";
+	unsigned long cumulative = 0;
+	for (size_t i = 0; i <= LATENCY_BUCKETS; ++i) {
+		cumulative += _buckets[i];
+		out += name;
+		out += "_bucket{";
+		out += prefix;
+		out += "le=\"";
+		if (i == LATENCY_BUCKETS) {
+			out += "+Inf";
+		} else {
+			appendSeconds(out, upperBound(i));
+		}
+		out += "\"} ";
+		Utils::appendNumber(out, cumulative);
+		out += '\n';
+	}
+
+	std::string braces = labels.empty() ? "" : "{" + labels + "}";
+	out += name + "_sum" + braces + " ";
+	appendSeconds(out, _sum_usec);
+	out += '\n';
+	out += name + "_count" + braces + " ";
+	Utils::appendNumber(out, _count);
+	out += '\n';
+}
+
+// Values are bucketed by their highest set bit and the LATENCY_SUB_BITS
+// below it. Counting from value - 1 makes every bound inclusive.
+size_t LatencyHistogram::bucketOf(unsigned long long usec) {
+	if (usec <= (1ULL << LATENCY_MIN_SHIFT)) {
+		return 0;
+	}
+	unsigned long long value = usec - 1;
+	int shift = 63 - __builtin_clzll(value);
+	if (shift >= LATENCY_MAX_SHIFT) {
+		return LATENCY_BUCKETS;
+	}
+	size_t sub = (value >> (shift - LATENCY_SUB_BITS)) & ((1 << LATENCY_SUB_BITS) - 1);
+	return ((shift - LATENCY_MIN_SHIFT) << LATENCY_SUB_BITS) + sub + 1;
+}
+
+unsigned long long LatencyHistogram::upperBound(size_t bucket) {
+	if (bucket == 0) {
+		return 1ULL << LATENCY_MIN_SHIFT;
+	}
+	size_t shift = ((bucket - 1) >> LATENCY_SUB_BITS) + LATENCY_MIN_SHIFT;
+	size_t sub = (bucket - 1) & ((1 << LATENCY_SUB_BITS) - 1);
+	return (1ULL << (shift - LATENCY_SUB_BITS)) * ((1 << LATENCY_SUB_BITS) + sub + 1);
+}
+
+//
+/* Metrics */
+//
+
+Metrics::Metrics() : _accepted(0), _refused(0), _bytes_in(0), _bytes_out(0),
+                     _cgi_started(0), _fastcgi_started(0), _client_timeouts(0), _cgi_timeouts(0) {
+	for (size_t i = 0; i < METRICS_MAX_STATUS; ++i) {
+		_responses[i] = 0;
+	}
+}
+
+LocationMetrics* Metrics::getLocation(const std::string& path) {
+	return &_locations[path];
+}
+
+void Metrics::countResponse(int status, LocationMetrics* location) {
+	if (status < 100 || status >= METRICS_MAX_STATUS) {
+		return;
+	}
+	_responses[status]++;
+	if (location) {
+		location->responses[status / 100 - 1]++;
+	}
+}
+
+void Metrics::countAccepted() {
+	_accepted++;
+}
+
+void Metrics::countRefused() {
+	_refused++;
+}
+
+void Metrics::addBytesIn(size_t bytes) {
+	_bytes_in += bytes;
+}
+
+void Metrics::addBytesOut(unsigned long long bytes) {
+	_bytes_out += bytes;
+}
+
+void Metrics::countCgi(bool fastcgi) {
+	if (fastcgi) {
+		_fastcgi_started++;
+	} else {
+		_cgi_started++;
+	}
+}
+
+void Metrics::countTimeout(bool cgi) {
+	if (cgi) {
+		_cgi_timeouts++;
+	} else {
+		_client_timeouts++;
+	}
+}
+
+void Metrics::recordParse(long long usec) {
+	_parse.record(usec);
+}
+
+void Metrics::recordHandler(long long usec) {
+	_handler.record(usec);
+}
+
+void Metrics::recordSend(long long usec) {
+	_send.record(usec);
+}
+
+void Metrics::recordCgi(long long usec) {
+	_cgi.record(usec);
+}
+
+void Metrics::write(std::string& out, unsigned long long bytes_out_open) const {
+	writeHeader(out, "webserv_worker_pid", "gauge", "Process that answered this scrape");
+	writeValue(out, "webserv_worker_pid", "", getpid());
+
+	writeHeader(out, "webserv_responses_total", "counter", "Responses by status code");
+	for (size_t i = 100; i < METRICS_MAX_STATUS; ++i) {
+		if (_responses[i] > 0) {
+			writeValue(out, "webserv_responses_total", "code=\"" + Utils::intToString(i) + "\"",
+			           _responses[i]);
+		}
+	}
+
+	writeHeader(out, "webserv_location_requests_total", "counter", "Requests by location");
+	for (std::map<std::string, LocationMetrics>::const_iterator it = _locations.begin();
+	     it != _locations.end(); ++it) {
+		writeValue(out, "webserv_location_requests_total", locationLabel(it->first),
+		           it->second.requests);
+	}
+	writeHeader(out, "webserv_location_responses_total", "counter",
+	            "Responses by location and status class");
+	for (std::map<std::string, LocationMetrics>::const_iterator it = _locations.begin();
+	     it != _locations.end(); ++it) {
+		std::string location = locationLabel(it->first);
+		for (size_t i = 0; i < 5; ++i) {
+			writeValue(out, "webserv_location_responses_total",
+			           location + ",class=\"" + Utils::intToString(i + 1) + "xx\"",
+			           it->second.responses[i]);
+		}
+	}
+
+	writeHeader(out, "webserv_connections_accepted_total", "counter", "Connections accepted");
+	writeValue(out, "webserv_connections_accepted_total", "", _accepted);
+	writeHeader(out, "webserv_connections_refused_total", "counter",
+	            "Connections closed at once because max_connections was reached");
+	writeValue(out, "webserv_connections_refused_total", "", _refused);
+	writeHeader(out, "webserv_received_bytes_total", "counter", "Bytes read from clients");
+	writeValue(out, "webserv_received_bytes_total", "", _bytes_in);
+	writeHeader(out, "webserv_sent_bytes_total", "counter", "Bytes written to clients");
+	writeValue(out, "webserv_sent_bytes_total", "", _bytes_out + bytes_out_open);
+
+	writeHeader(out, "webserv_timeouts_total", "counter",
+	            "Clients disconnected and CGI requests abandoned for taking too long");
+	writeValue(out, "webserv_timeouts_total", "type=\"client\"", _client_timeouts);
+	writeValue(out, "webserv_timeouts_total", "type=\"cgi\"", _cgi_timeouts);
+
+	writeHeader(out, "webserv_cgi_started_total", "counter", "CGI requests by how they ran");
+	writeValue(out, "webserv_cgi_started_total", "type=\"cgi\"", _cgi_started);
+	writeValue(out, "webserv_cgi_started_total", "type=\"fastcgi\"", _fastcgi_started);
+	writeHeader(out, "webserv_cgi_duration_seconds", "histogram",
+	            "Request handed to CGI until its output ended");
+	_cgi.write(out, "webserv_cgi_duration_seconds", "");
+
+	writeHeader(out, "webserv_request_phase_seconds", "histogram",
+	            "Time spent parsing, handling and sending requests");
+	_parse.write(out, "webserv_request_phase_seconds", "phase=\"parse\"");
+	_handler.write(out, "webserv_request_phase_seconds", "phase=\"handler\"");
+	_send.write(out, "webserv_request_phase_seconds", "phase=\"send\"");
+}
+
+void Metrics::writeHeader(std::string& out, const char* name, const char* type,
+                          const char* help) {
+	out += "# HELP ";
+	out += name;
+	out += ' ';
+	out += help;
+	out += "\n# TYPE ";
+	out += name;
+	out += ' ';
+	out += type;
+	out += '\n';
+}
+
+void Metrics::writeValue(std::string& out, const char* name, const std::string& labels,
+                         unsigned long long value) {
+	out += name;
+	if (!labels.empty()) {
+		out += '{';
+		out += labels;
+		out += '}';
+	}
+	out += ' ';
+	Utils::appendNumber(out, value);
+	out += '\n';
+}
+
+void Metrics::writeSeconds(std::string& out, const char* name, const std::string& labels,
+                           unsigned long long usec) {
+	out += name;
+	if (!labels.empty()) {
+		out += '{';
+		out += labels;
+		out += '}';
+	}
+	out += ' ';
+	appendSeconds(out, usec);
+	out += '\n';
+}
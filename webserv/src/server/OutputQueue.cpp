@@ -0,0 +1,328 @@
+#include "OutputQueue.hpp"
+#include "Deflater.hpp"
+#include "DirectoryListing.hpp"
+#include "Response.hpp"
+
+#include <unistd.h>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+OutputQueue::OutputQueue() : _size(0), _sent(0), _sending(0) {}
+
+OutputQueue::~OutputQueue() {
+	clear();
+}
+
+void OutputQueue::append(const std::string& data) {
+	append(data.data(), data.length());
+}
+
+void OutputQueue::append(const char* data, size_t length) {
+	if (length == 0) {
+		return;
+	}
+	_size += length;
+
+	// Heads, chunk framing and small bodies share one segment, unless the
+	// kernel is sending from it
+	if (length <= OUTPUT_COALESCE_SIZE && _segments.size() > _sending &&
+	    _segments.back().type == OutputSegment::DATA) {
+		OutputSegment& last = _segments.back();
+		last.data.append(data, length);
+		last.length += length;
+		return;
+	}
+	_segments.push_back(OutputSegment());
+	OutputSegment& segment = _segments.back();
+	segment.data.assign(data, length);
+	segment.length = length;
+}
+
+// A body swapped in rather than copied; writev() sends it with the head
+void OutputQueue::appendOwned(std::string& data) {
+	if (data.empty()) {
+		return;
+	}
+	_segments.push_back(OutputSegment());
+	OutputSegment& segment = _segments.back();
+	segment.data.swap(data);
+	segment.length = segment.data.length();
+	_size += segment.length;
+}
+
+void OutputQueue::appendShared(const SharedBuffer& buffer) {
+	if (buffer.getLength() == 0) {
+		return;
+	}
+	_segments.push_back(OutputSegment());
+	OutputSegment& segment = _segments.back();
+	segment.type = OutputSegment::SHARED;
+	segment.shared = buffer;
+	segment.length = buffer.getLength();
+	_size += segment.length;
+}
+
+void OutputQueue::appendFile(int fd, off_t offset, off_t length, bool owns_fd) {
+	if (length <= 0) {
+		if (owns_fd) {
+			close(fd);
+		}
+		return;
+	}
+	_segments.push_back(OutputSegment());
+	OutputSegment& segment = _segments.back();
+	segment.type = OutputSegment::FILE;
+	segment.fd = fd;
+	segment.owns_fd = owns_fd;
+	segment.offset = offset;
+	segment.length = length;
+	_size += length;
+}
+
+// Emits the chunked body, last chunk included, even for an empty range
+void OutputQueue::appendDeflate(int fd, off_t offset, off_t length, Deflater* deflater) {
+	_segments.push_back(OutputSegment());
+	OutputSegment& segment = _segments.back();
+	segment.type = OutputSegment::DEFLATE;
+	segment.fd = fd;
+	segment.owns_fd = true;
+	segment.deflater = deflater;
+	segment.offset = offset;
+	segment.length = length;
+	_size += length;
+}
+
+// Emits the chunked body, last chunk included
+void OutputQueue::appendListing(DirectoryListing* listing) {
+	_segments.push_back(OutputSegment());
+	OutputSegment& segment = _segments.back();
+	segment.type = OutputSegment::LISTING;
+	segment.listing = listing;
+}
+
+void OutputQueue::clear() {
+	while (!_segments.empty()) {
+		_pop();
+	}
+	_size = 0;
+	_sent = 0;
+	_sending = 0;
+}
+
+int OutputQueue::flush(int socket_fd) {
+	while (!_segments.empty()) {
+		OutputSegment& front = _segments.front();
+
+		if (front.type == OutputSegment::FILE) {
+			int result = _sendFile(socket_fd, front);
+			if (result <= 0) {
+				return result;
+			}
+			continue;
+		}
+		if (front.type == OutputSegment::DEFLATE) {
+			if (!_deflate(front)) {
+				return -1;
+			}
+			continue;
+		}
+		if (front.type == OutputSegment::LISTING) {
+			_list(front);
+			continue;
+		}
+
+		struct iovec parts[OUTPUT_IOV_MAX];
+		int count = _gather(parts);
+		ssize_t sent = writev(socket_fd, parts, count);
+		if (sent > 0) {
+			_sent += sent;
+			_consume(static_cast<size_t>(sent));
+		} else if (sent == -1 && errno == EINTR) {
+			continue;
+		} else if (sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			return 0;
+		} else {
+			return -1;
+		}
+	}
+	return 1;
+}
+
+int OutputQueue::gather(struct iovec* parts) {
+	while (!_segments.empty() && _segments.front().type != OutputSegment::FILE) {
+		OutputSegment& front = _segments.front();
+		if (front.type == OutputSegment::DEFLATE) {
+			if (!_deflate(front)) {
+				return -1;
+			}
+		} else if (front.type == OutputSegment::LISTING) {
+			_list(front);
+		} else {
+			int count = _gather(parts);
+			_sending = count;
+			return count;
+		}
+	}
+	return 0;
+}
+
+void OutputQueue::sent(size_t length) {
+	_sending = 0;
+	_sent += length;
+	_consume(length);
+}
+
+// Getters
+bool OutputQueue::empty() const {
+	return _segments.empty();
+}
+
+bool OutputQueue::isSending() const {
+	return _sending > 0;
+}
+
+off_t OutputQueue::getSize() const {
+	return _size;
+}
+
+unsigned long long OutputQueue::getSent() const {
+	return _sent;
+}
+
+// The memory segments up to the next file, at most OUTPUT_IOV_MAX
+int OutputQueue::_gather(struct iovec* parts) const {
+	int count = 0;
+	for (std::deque<OutputSegment>::const_iterator it = _segments.begin();
+	     it != _segments.end() && count < OUTPUT_IOV_MAX; ++it) {
+		if (it->type != OutputSegment::DATA && it->type != OutputSegment::SHARED) {
+			break;
+		}
+		const std::string& bytes = it->type == OutputSegment::DATA ? it->data : it->shared.getData();
+		parts[count].iov_base = const_cast<char*>(bytes.data() + it->offset);
+		parts[count].iov_len = static_cast<size_t>(it->length);
+		count++;
+	}
+	return count;
+}
+
+// Streams a file segment without copying it through userspace
+int OutputQueue::_sendFile(int socket_fd, OutputSegment& segment) {
+	size_t chunk = static_cast<size_t>(segment.length);
+#ifdef __linux__
+	off_t offset = segment.offset;
+	ssize_t sent = sendfile(socket_fd, segment.fd, &offset, chunk);
+#else
+	char buffer[65536];
+	if (chunk > sizeof(buffer))
+		chunk = sizeof(buffer);
+	ssize_t sent = pread(segment.fd, buffer, chunk, segment.offset);
+	if (sent > 0)
+		sent = send(socket_fd, buffer, sent, 0);
+#endif
+	if (sent > 0) {
+		_sent += sent;
+		segment.offset += sent;
+		segment.length -= sent;
+		_size -= sent;
+		if (segment.length == 0) {
+			_pop();
+		}
+		return 1;
+	}
+	if (sent == -1 && errno == EINTR) {
+		return 1;
+	}
+	if (sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+		return 0;
+	}
+	return -1; // Error, or the file shrank underneath us
+}
+
+// Compresses the next block of the file into a chunk queued in front of
+// it, so at most one block of output is buffered at a time
+bool OutputQueue::_deflate(OutputSegment& segment) {
+	char block[DEFLATE_BLOCK_SIZE];
+	size_t length = static_cast<size_t>(segment.length);
+	if (length > sizeof(block)) {
+		length = sizeof(block);
+	}
+	ssize_t bytes = 0;
+	if (length > 0) {
+		bytes = pread(segment.fd, block, length, segment.offset);
+		if (bytes == -1 && errno == EINTR) {
+			return true;
+		}
+		if (bytes <= 0) {
+			return false;
+		}
+		segment.offset += bytes;
+		segment.length -= bytes;
+		_size -= bytes;
+	}
+
+	bool finish = segment.length == 0;
+	std::string compressed;
+	if (!segment.deflater->compress(block, bytes, finish, compressed)) {
+		return false;
+	}
+	std::string chunk = Response::encodeChunk(compressed.data(), compressed.length());
+	if (finish) {
+		chunk += Response::lastChunk();
+		_pop(); // segment is gone from here on
+	}
+	if (!chunk.empty()) {
+		_segments.push_front(OutputSegment());
+		_segments.front().data.swap(chunk);
+		_segments.front().length = _segments.front().data.length();
+		_size += _segments.front().length;
+	}
+	return true;
+}
+
+// The next batch of entries as a chunk in front of the listing, so like
+// _deflate only one batch is buffered however large the directory
+void OutputQueue::_list(OutputSegment& segment) {
+	std::string batch;
+	bool finish = segment.listing->next(batch);
+	std::string chunk = Response::encodeChunk(batch.data(), batch.length());
+	if (finish) {
+		chunk += Response::lastChunk();
+		_pop(); // segment is gone from here on
+	}
+	if (!chunk.empty()) {
+		_segments.push_front(OutputSegment());
+		_segments.front().data.swap(chunk);
+		_segments.front().length = _segments.front().data.length();
+		_size += _segments.front().length;
+	}
+}
+
+void OutputQueue::_consume(size_t sent) {
+	while (sent > 0) {
+		OutputSegment& front = _segments.front();
+		if (sent < static_cast<size_t>(front.length)) {
+			front.offset += sent;
+			front.length -= sent;
+			_size -= sent;
+			return;
+		}
+		sent -= static_cast<size_t>(front.length);
+		_pop();
+	}
+}
+
+// Drops the front segment, with whatever it still had to send
+void OutputQueue::_pop() {
+	OutputSegment& front = _segments.front();
+	if (front.owns_fd && front.fd != -1) {
+		close(front.fd);
+	}
+	delete front.deflater;
+	delete front.listing;
+	_size -= front.length;
+	_segments.pop_front();
+}
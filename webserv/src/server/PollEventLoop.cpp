@@ -0,0 +1,93 @@
+#include "PollEventLoop.hpp"
+
+PollEventLoop::PollEventLoop() {}
+
+PollEventLoop::~PollEventLoop() {}
+
+bool PollEventLoop::add(int fd, int events) {
+	if (fd < 0 || _slotOf(fd) != -1) {
+		return false;
+	}
+	if (static_cast<size_t>(fd) >= _slots.size()) {
+		_slots.resize(fd + 1, -1);
+	}
+
+	struct pollfd pfd;
+	pfd.fd = fd;
+	pfd.events = _toPoll(events);
+	pfd.revents = 0;
+	_slots[fd] = static_cast<int>(_fds.size());
+	_fds.push_back(pfd);
+	return true;
+}
+
+bool PollEventLoop::modify(int fd, int events) {
+	int slot = _slotOf(fd);
+	if (slot == -1) {
+		return false;
+	}
+	_fds[slot].events = _toPoll(events);
+	return true;
+}
+
+void PollEventLoop::remove(int fd) {
+	int slot = _slotOf(fd);
+	if (slot == -1) {
+		return;
+	}
+
+	// Move the last entry into the freed slot
+	int last = static_cast<int>(_fds.size()) - 1;
+	if (slot != last) {
+		_fds[slot] = _fds[last];
+		_slots[_fds[slot].fd] = slot;
+	}
+	_fds.pop_back();
+	_slots[fd] = -1;
+}
+
+int PollEventLoop::wait(std::vector<IoEvent>& events, int timeout_ms) {
+	events.clear();
+	if (_fds.empty()) {
+		return poll(NULL, 0, timeout_ms);
+	}
+
+	int count = poll(&_fds[0], _fds.size(), timeout_ms);
+	if (count <= 0) {
+		return count;
+	}
+
+	for (size_t i = 0; i < _fds.size() && events.size() < static_cast<size_t>(count); ++i) {
+		short revents = _fds[i].revents;
+		if (revents == 0) {
+			continue;
+		}
+
+		IoEvent event;
+		event.fd = _fds[i].fd;
+		event.events = 0;
+		if (revents & POLLIN) event.events |= EVENT_READ;
+		if (revents & POLLOUT) event.events |= EVENT_WRITE;
+		if (revents & (POLLERR | POLLHUP | POLLNVAL)) event.events |= EVENT_ERROR;
+		events.push_back(event);
+	}
+	return static_cast<int>(events.size());
+}
+
+const char* PollEventLoop::getName() const {
+	return "poll";
+}
+
+int PollEventLoop::_slotOf(int fd) const {
+	if (fd < 0 || static_cast<size_t>(fd) >= _slots.size()) {
+		return -1;
+	}
+	return _slots[fd];
+}
+
+short PollEventLoop::_toPoll(int events) {
+	short result = 0;
+	if (events & EVENT_READ) result |= POLLIN;
+	if (events & EVENT_WRITE) result |= POLLOUT;
+	return result;
+}
@@ -1,141 +1,160 @@
 #include "Request.hpp"
-#include <sstream>
+#include "HttpParser.hpp"
+#include "Utils.hpp"
 #include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <unistd.h>
 
-Request::Request() : _valid(false) {}
+Request::Request() : _method_bit(0), _arena(&_own_arena), _headers(NULL), _header_count(0),
+                     _body_length(0), _valid(false) {}
 
-Request::~Request() {}
+Request::Request(Arena& arena) : _method_bit(0), _arena(&arena), _headers(NULL), _header_count(0),
+                                 _body_length(0), _valid(false) {}
 
-bool Request::parse(const std::string& raw_request) {
-	if (raw_request.empty()) {
-		_valid = false;
-		_error_message = "Empty request";
-		return false;
-	}
-
-	// Find header/body separator
-	size_t header_end = raw_request.find("\r\n\r\n");
-	if (header_end == std::string::npos) {
-		_valid = false;
-		_error_message = "Incomplete request headers";
-		return false;
+Request::~Request() {
+	if (!_body_file.empty()) {
+		unlink(_body_file.c_str());
 	}
+}
 
-	std::string header_section = raw_request.substr(0, header_end);
-	_body = raw_request.substr(header_end + 4);
-
-	// Parse request line and headers
-	size_t first_line_end = header_section.find("\r\n");
-	if (first_line_end == std::string::npos) {
-		_valid = false;
-		_error_message = "Invalid request line";
-		return false;
-	}
-
-	std::string request_line = header_section.substr(0, first_line_end);
-	_parseRequestLine(request_line);
-
-	if (!_valid) {
-		return false;
+void Request::reset() {
+	if (!_body_file.empty()) {
+		unlink(_body_file.c_str());
 	}
-
-	std::string headers_str = header_section.substr(first_line_end + 2);
-	_parseHeaders(headers_str);
-
-	_valid = true;
-	return true;
+	_body_file.clear();
+	_method.clear();
+	_method_bit = 0;
+	_uri.clear();
+	_path.clear();
+	_query.clear();
+	_version.clear();
+	_headers = NULL;
+	_header_count = 0;
+	std::string().swap(_body); // Can be large, not worth keeping
+	_body_length = 0;
+	_valid = false;
+	_error_message.clear();
 }
 
-void Request::_parseRequestLine(const std::string& line) {
-	std::istringstream iss(line);
-	iss >> _method >> _uri >> _version;
-
-	if (_method.empty() || _uri.empty() || _version.empty()) {
-		_valid = false;
-		_error_message = "Invalid request line format";
-		return;
+bool Request::parse(const std::string& raw_request) {
+	HttpParser parser;
+	std::string buffer(raw_request); // Chunked bodies are decoded in place
+
+	switch (parser.parse(buffer)) {
+		case HttpParser::COMPLETE:
+			build(buffer, parser);
+			return true;
+		case HttpParser::INCOMPLETE:
+			_error_message = raw_request.empty() ? "Empty request" : "Incomplete request";
+			break;
+		case HttpParser::ERROR:
+			_error_message = "Malformed request";
+			break;
 	}
+	_valid = false;
+	return false;
+}
 
-	// Convert method to uppercase
+// Copies each token exactly once out of the receive buffer, headers
+// into the arena so they cost no allocation of their own
+void Request::build(const std::string& buffer, const HttpParser& parser) {
+	_method.assign(buffer, parser.getMethod().offset, parser.getMethod().length);
 	std::transform(_method.begin(), _method.end(), _method.begin(), ::toupper);
+	_method_bit = Utils::methodBit(_method);
+	_uri.assign(buffer, parser.getUri().offset, parser.getUri().length);
+	size_t query = _uri.find('?');
+	_path.assign(_uri, 0, query);
+	if (query != std::string::npos)
+		_query.assign(_uri, query + 1, std::string::npos);
+	else
+		_query.clear();
+	_version.assign(buffer, parser.getVersion().offset, parser.getVersion().length);
+
+	const std::vector<HeaderRef>& headers = parser.getHeaders();
+	_headers = static_cast<RequestHeader*>(_arena->allocate(headers.size() * sizeof(RequestHeader)));
+	_header_count = 0;
+	for (size_t i = 0; i < headers.size(); ++i) {
+		const StrRef& name = headers[i].name;
+		const StrRef& value = headers[i].value;
+		char* lower = _arena->copy(buffer.data() + name.offset, name.length);
+		for (size_t j = 0; j < name.length; ++j) {
+			lower[j] = std::tolower(static_cast<unsigned char>(lower[j]));
+		}
 
-	// Validate HTTP version
-	if (_version != "HTTP/1.1" && _version != "HTTP/1.0") {
-		_valid = false;
-		_error_message = "Unsupported HTTP version";
-		return;
+		// A repeated name replaces the earlier value
+		RequestHeader* header = const_cast<RequestHeader*>(_findHeader(lower, name.length));
+		if (!header) {
+			header = &_headers[_header_count++];
+			header->name = lower;
+			header->name_length = name.length;
+		}
+		header->value = _arena->copy(buffer.data() + value.offset, value.length);
+		header->value_length = value.length;
 	}
 
+	_body.assign(buffer, parser.getBodyOffset(), parser.getBufferedBodyLength(buffer));
+	_body_length = parser.getContentLength();
 	_valid = true;
 }
 
-void Request::_parseHeaders(const std::string& header_section) {
-	std::istringstream stream(header_section);
-	std::string line;
-
-	while (std::getline(stream, line)) {
-		if (line.empty() || line == "\r") {
+// Linear: requests carry a handful of headers and this beats hashing them
+const RequestHeader* Request::_findHeader(const char* key, size_t length) const {
+	for (size_t i = 0; i < _header_count; ++i) {
+		if (_headers[i].name_length != length) {
 			continue;
 		}
-
-		// Remove trailing \r if present
-		if (!line.empty() && line[line.length() - 1] == '\r') {
-			line = line.substr(0, line.length() - 1);
+		size_t j = 0;
+		while (j < length &&
+		       std::tolower(static_cast<unsigned char>(key[j])) == _headers[i].name[j]) {
+			j++;
 		}
-
-		size_t colon_pos = line.find(':');
-		if (colon_pos == std::string::npos) {
-			continue;
+		if (j == length) {
+			return &_headers[i];
 		}
-
-		std::string key = _trim(line.substr(0, colon_pos));
-		std::string value = _trim(line.substr(colon_pos + 1));
-
-		// Convert key to lowercase for case-insensitive lookup
-		_headers[_toLower(key)] = value;
-	}
-}
-
-std::string Request::_toLower(const std::string& str) const {
-	std::string result = str;
-	std::transform(result.begin(), result.end(), result.begin(), ::tolower);
-	return result;
-}
-
-std::string Request::_trim(const std::string& str) const {
-	size_t start = 0;
-	size_t end = str.length();
-
-	while (start < end && (str[start] == ' ' || str[start] == '\t')) {
-		start++;
-	}
-
-	while (end > start && (str[end - 1] == ' ' || str[end - 1] == '\t')) {
-		end--;
 	}
-
-	return str.substr(start, end - start);
+	return NULL;
 }
 
 // Getters
 const std::string& Request::getMethod() const { return _method; }
+int Request::getMethodBit() const { return _method_bit; }
 const std::string& Request::getUri() const { return _uri; }
+const std::string& Request::getPath() const { return _path; }
+const std::string& Request::getQuery() const { return _query; }
 const std::string& Request::getVersion() const { return _version; }
-const std::map<std::string, std::string>& Request::getHeaders() const { return _headers; }
+size_t Request::getHeaderCount() const { return _header_count; }
+const RequestHeader& Request::getHeaderAt(size_t index) const { return _headers[index]; }
 const std::string& Request::getBody() const { return _body; }
+bool Request::hasBodyFile() const { return !_body_file.empty(); }
+const std::string& Request::getBodyFile() const { return _body_file; }
+size_t Request::getBodyLength() const { return _body_length; }
 bool Request::isValid() const { return _valid; }
 const std::string& Request::getErrorMessage() const { return _error_message; }
 
+void Request::setBodyFile(const std::string& path) {
+	_body_file = path;
+	_body.clear();
+}
+
+std::string Request::releaseBodyFile() {
+	std::string path = _body_file;
+	_body_file.clear();
+	return path;
+}
+
 std::string Request::getHeader(const std::string& key) const {
-	std::string lower_key = _toLower(key);
-	std::map<std::string, std::string>::const_iterator it = _headers.find(lower_key);
-	if (it != _headers.end()) {
-		return it->second;
+	const RequestHeader* header = _findHeader(key.data(), key.length());
+	if (header) {
+		return std::string(header->value, header->value_length);
 	}
 	return "";
 }
 
 bool Request::hasHeader(const std::string& key) const {
-	return _headers.find(_toLower(key)) != _headers.end();
+	return _findHeader(key.data(), key.length()) != NULL;
 }
 
+const RequestHeader* Request::findHeader(const char* key) const {
+	return _findHeader(key, std::strlen(key));
+}
@@ -1,19 +1,17 @@
 #include "Response.hpp"
-#include <sstream>
+#include "HttpStatus.hpp"
+#include "Utils.hpp"
 
-Response::Response() : _status_code(200) {
-	_status_message = _getDefaultStatusMessage(200);
-}
+Response::Response() : _status_code(200), _file_level(0), _chunked(false) {}
 
-Response::Response(int status_code) : _status_code(status_code) {
-	_status_message = _getDefaultStatusMessage(status_code);
-}
+Response::Response(int status_code) : _status_code(status_code), _file_level(0),
+                                      _chunked(false) {}
 
 Response::~Response() {}
 
 void Response::setStatus(int code) {
 	_status_code = code;
-	_status_message = _getDefaultStatusMessage(code);
+	_status_message.clear();
 }
 
 void Response::setStatusMessage(const std::string& message) {
@@ -21,69 +19,220 @@ void Response::setStatusMessage(const std::string& message) {
 }
 
 void Response::setHeader(const std::string& key, const std::string& value) {
-	_headers[key] = value;
+	for (size_t i = 0; i < _headers.size(); ++i) {
+		if (_headers[i].first == key) {
+			_headers[i].second = value;
+			return;
+		}
+	}
+	_headers.push_back(std::make_pair(key, value));
 }
 
 void Response::setBody(const std::string& body) {
 	_body = body;
+	_shared_body = SharedBuffer();
+	_file_path.clear();
+	_file_ranges.clear();
+	_file_trailer.clear();
+	_listing = ListingOptions();
+}
+
+void Response::appendBody(const std::string& data) {
+	_body += data;
+}
+
+void Response::setSharedBody(const SharedBuffer& body) {
+	setBody("");
+	_shared_body = body;
+}
+
+void Response::setFileBody(const std::string& path, off_t offset, off_t length) {
+	setFileBody(path);
+	addFileRange("", offset, length);
+}
+
+void Response::setFileBody(const std::string& path) {
+	_body.clear();
+	_shared_body = SharedBuffer();
+	_file_path = path;
+	_file_ranges.clear();
+	_file_trailer.clear();
+	_file_encoding.clear();
+	_listing = ListingOptions();
+}
+
+void Response::addFileRange(const std::string& prefix, off_t offset, off_t length) {
+	FileRange range;
+	range.prefix = prefix;
+	range.offset = offset;
+	range.length = length;
+	_file_ranges.push_back(range);
+}
+
+void Response::setFileTrailer(const std::string& trailer) {
+	_file_trailer = trailer;
+}
+
+// The compressed length is unknown up front, so the body is chunked
+void Response::setFileEncoding(const std::string& encoding, int level) {
+	_file_encoding = encoding;
+	_file_level = level;
+	_chunked = true;
+}
+
+// The listing is formatted by the output queue, whose length is unknown
+void Response::setListingBody(const ListingOptions& listing) {
+	setBody("");
+	_listing = listing;
+	_chunked = true;
+}
+
+void Response::swapBody(std::string& other) {
+	_body.swap(other);
+}
+
+void Response::setChunked(bool chunked) {
+	_chunked = chunked;
 }
 
 int Response::getStatusCode() const {
 	return _status_code;
 }
 
-const std::string& Response::getStatusMessage() const {
-	return _status_message;
+std::string Response::getStatusMessage() const {
+	return _status_message.empty() ? HttpStatus::getMessage(_status_code) : _status_message;
 }
 
 const std::string& Response::getBody() const {
-	return _body;
+	return _shared_body.isNull() ? _body : _shared_body.getData();
 }
 
-std::string Response::build() const {
-	std::ostringstream response;
+bool Response::hasSharedBody() const {
+	return !_shared_body.isNull();
+}
+
+const SharedBuffer& Response::getSharedBody() const {
+	return _shared_body;
+}
+
+bool Response::hasHeader(const std::string& key) const {
+	for (size_t i = 0; i < _headers.size(); ++i) {
+		if (_headers[i].first == key) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool Response::hasFileBody() const {
+	return !_file_path.empty();
+}
+
+const std::string& Response::getFilePath() const {
+	return _file_path;
+}
+
+const std::vector<FileRange>& Response::getFileRanges() const {
+	return _file_ranges;
+}
+
+const std::string& Response::getFileTrailer() const {
+	return _file_trailer;
+}
+
+// Everything sent after the headers: range prefixes, file bytes, trailer
+off_t Response::getFileBodyLength() const {
+	off_t length = _file_trailer.length();
+	for (size_t i = 0; i < _file_ranges.size(); ++i) {
+		length += _file_ranges[i].prefix.length() + _file_ranges[i].length;
+	}
+	return length;
+}
+
+const std::string& Response::getFileEncoding() const {
+	return _file_encoding;
+}
+
+int Response::getFileLevel() const {
+	return _file_level;
+}
+
+bool Response::hasListingBody() const {
+	return !_listing.snapshot.isNull();
+}
 
+const ListingOptions& Response::getListing() const {
+	return _listing;
+}
+
+bool Response::isChunked() const {
+	return _chunked;
+}
+
+// Appends the status line and headers to out, so a connection's output
+// buffer can be reused instead of building a temporary string.
+void Response::writeHead(std::string& out) const {
 	// Status line
-	response << "HTTP/1.1 " << _status_code << " " << _status_message << "\r\n";
+	if (_status_message.empty() && _status_code >= 100 && _status_code <= 599) {
+		out += HttpStatus::getStatusLine(_status_code);
+	} else {
+		out += "HTTP/1.1 ";
+		Utils::appendNumber(out, _status_code);
+		out += " " + getStatusMessage() + "\r\n";
+	}
 
 	// Headers
-	for (std::map<std::string, std::string>::const_iterator it = _headers.begin();
-	     it != _headers.end(); ++it) {
-		response << it->first << ": " << it->second << "\r\n";
+	for (size_t i = 0; i < _headers.size(); ++i) {
+		out += _headers[i].first;
+		out += ": ";
+		out += _headers[i].second;
+		out += "\r\n";
+	}
+
+	// Streamed bodies are framed by chunks instead of a length
+	if (_chunked) {
+		out += "Transfer-Encoding: chunked\r\n\r\n";
+		return;
 	}
 
-	// Ensure Content-Length is set
-	if (_headers.find("Content-Length") == _headers.end()) {
-		std::ostringstream len;
-		len << _body.length();
-		response << "Content-Length: " << len.str() << "\r\n";
+	// Ensure Content-Length is set (never on 204 or 304, RFC 9110 8.6)
+	if (_status_code != 204 && _status_code != 304 && !hasHeader("Content-Length")) {
+		out += "Content-Length: ";
+		Utils::appendNumber(out, hasFileBody() ? getFileBodyLength() : getBody().length());
+		out += "\r\n";
 	}
 
 	// Empty line before body
-	response << "\r\n";
-
-	// Body
-	response << _body;
-
-	return response.str();
-}
-
-std::string Response::_getDefaultStatusMessage(int code) const {
-	switch (code) {
-		case 200: return "OK";
-		case 201: return "Created";
-		case 204: return "No Content";
-		case 301: return "Moved Permanently";
-		case 302: return "Found";
-		case 400: return "Bad Request";
-		case 403: return "Forbidden";
-		case 404: return "Not Found";
-		case 405: return "Method Not Allowed";
-		case 413: return "Payload Too Large";
-		case 500: return "Internal Server Error";
-		case 501: return "Not Implemented";
-		case 505: return "HTTP Version Not Supported";
-		default: return "Unknown";
+	out += "\r\n";
+}
+
+std::string Response::build() const {
+	const std::string& body = getBody();
+	std::string response;
+	response.reserve(256 + body.length());
+	writeHead(response);
+	if (_chunked) {
+		response += encodeChunk(body.data(), body.length());
+	} else {
+		response += body;
 	}
+	return response;
 }
 
+std::string Response::encodeChunk(const char* data, size_t length) {
+	if (length == 0) {
+		return ""; // A zero-size chunk would terminate the body
+	}
+
+	std::string result;
+	result.reserve(length + 16);
+	Utils::appendNumber(result, length, 16);
+	result += "\r\n";
+	result.append(data, length);
+	result += "\r\n";
+	return result;
+}
+
+std::string Response::lastChunk() {
+	return "0\r\n\r\n";
+}
@@ -1,111 +1,284 @@
 #include "Server.hpp"
 #include "Client.hpp"
+#include "ClientPool.hpp"
 #include "Config.hpp"
+#include "ConfigSnapshot.hpp"
+#include "DiskIoPool.hpp"
+#include "AccessLog.hpp"
 #include "Request.hpp"
 #include "Response.hpp"
 #include "CgiHandler.hpp"
+#include "FastCgiConnection.hpp"
+#include "FastCgiPool.hpp"
+#include "FileCache.hpp"
+#include "DirectoryCache.hpp"
+#include "TimerWheel.hpp"
+#include "VirtualHosts.hpp"
+#include "Deflater.hpp"
+#include "EventLoop.hpp"
+#include "HttpParser.hpp"
+#include "Utils.hpp"
 
 #include <iostream>
 #include <fcntl.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fstream>
 #include <sstream>
 #include <cstring>
+#include <cstdlib>
+#include <cctype>
 #include <cerrno>
 #include <dirent.h>
+#include <sys/wait.h>
+#include <csignal>
 
-Server::Server(const std::string& config_file) : _config(NULL), _server_fd(-1) {
-	_config = new Config(config_file);
-	if (!_config->parse()) {
-		delete _config;
+// Set from signal handlers, polled by the event loop
+static volatile sig_atomic_t g_drain_requested = 0;
+static volatile sig_atomic_t g_reload_requested = 0;
+static volatile sig_atomic_t g_reopen_requested = 0;
+
+static void _onDrainSignal(int sig) {
+	(void)sig;
+	g_drain_requested = 1;
+}
+
+static void _onReloadSignal(int sig) {
+	(void)sig;
+	g_reload_requested = 1;
+}
+
+static void _onReopenSignal(int sig) {
+	(void)sig;
+	g_reopen_requested = 1;
+}
+
+// Write end of the SIGCHLD self-pipe
+static int g_signal_pipe_fd = -1;
+
+static void _onChildSignal(int sig) {
+	(void)sig;
+	int saved_errno = errno;
+	if (g_signal_pipe_fd != -1) {
+		ssize_t written = write(g_signal_pipe_fd, "c", 1);
+		(void)written; // Pipe full means a wakeup is already pending
+	}
+	errno = saved_errno;
+}
+
+Server::Server(const std::string& config_file) : _config_file(config_file), _snapshot(NULL),
+                                                   _loop(NULL), _file_cache(NULL),
+                                                   _directory_cache(NULL), _disk_pool(NULL),
+                                                   _timers(NULL), _draining(false), _client_pool(NULL) {
+	_signal_pipe[0] = -1;
+	_signal_pipe[1] = -1;
+	Config* config = new Config(config_file);
+	if (!config->parse()) {
+		delete config;
 		throw std::runtime_error("Failed to parse configuration file");
 	}
-	_setupSocket();
+	config->bindMetrics(_metrics);
+	_snapshot = new ConfigSnapshot(config);
+	_loop = EventLoop::create(config->getEventBackend());
+
+	// One cache for all sites, sized by the first server block. Like the
+	// event backend, it keeps its startup settings across reloads.
+	const ServerConfig& server_config = config->getServerConfig(0);
+	_file_cache = new FileCache(server_config.file_cache_size,
+	                            server_config.file_cache_max_file_size,
+	                            server_config.file_cache_valid);
+	_directory_cache = new DirectoryCache(DIRECTORY_CACHE_ENTRIES);
+	_timers = new TimerWheel();
+	_client_pool = new ClientPool(config->getMaxConnections());
+	try {
+		_setupListeners();
+		_setupSignalPipe();
+	} catch (...) {
+		_closeListeners();
+		if (_signal_pipe[0] != -1) {
+			close(_signal_pipe[0]);
+			close(_signal_pipe[1]);
+		}
+		delete _client_pool;
+		delete _timers;
+		delete _directory_cache;
+		delete _file_cache;
+		delete _loop;
+		delete _snapshot;
+		throw;
+	}
 }
 
 Server::~Server() {
 	// Close all client connections
 	for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end(); ++it) {
-		delete it->second;
+		_releaseSnapshot(it->second->getSnapshot());
+		_client_pool->release(it->second);
 		close(it->first);
 	}
+	delete _client_pool;
+
+	// Running CGI processes are not waited for
+	for (std::map<pid_t, CgiHandler*>::iterator it = _cgi_processes.begin();
+	     it != _cgi_processes.end(); ++it) {
+		it->second->kill();
+		delete it->second;
+	}
+	for (std::map<std::string, FastCgiPool*>::iterator it = _fastcgi_pools.begin();
+	     it != _fastcgi_pools.end(); ++it) {
+		delete it->second;
+	}
+
+	// Close listen sockets
+	_closeListeners();
 
-	// Close server socket
-	if (_server_fd != -1)
-		close(_server_fd);
+	g_signal_pipe_fd = -1;
+	if (_signal_pipe[0] != -1) {
+		close(_signal_pipe[0]);
+		close(_signal_pipe[1]);
+	}
 
-	delete _config;
+	// Written out by their threads before they go
+	for (std::map<std::string, AccessLog*>::iterator it = _access_logs.begin();
+	     it != _access_logs.end(); ++it) {
+		delete it->second;
+	}
+	delete _disk_pool;
+	delete _timers;
+	delete _directory_cache;
+	delete _file_cache;
+	delete _loop;
+	_releaseSnapshot(_snapshot);
 }
 
 void Server::run() {
-	const ServerConfig& server_config = _config->getServerConfig(0);
-	std::cout << "Server running on " << server_config.host << ":" << server_config.port << std::endl;
-	std::cout << "Waiting for connections..." << std::endl;
+	std::cout << "Waiting for connections (" << _loop->getName() << ")..." << std::endl;
+
+	_installSignalHandlers();
 
+	std::vector<IoEvent> events;
 	while (true) {
-		int poll_count = poll(_poll_fds.data(), _poll_fds.size(), 1000); // 1 second timeout
+		if (g_reload_requested) {
+			g_reload_requested = 0;
+			if (!_draining) {
+				_reload();
+			}
+		}
+		if (g_reopen_requested) {
+			g_reopen_requested = 0;
+			_reopenAccessLogs();
+		}
+		if (g_drain_requested && !_draining) {
+			_beginDrain();
+		}
+		if (_draining && _clients.empty()) {
+			std::cout << "Drained, exiting (file cache: " << _file_cache->getHits() << " hits, "
+			          << _file_cache->getMisses() << " misses)" << std::endl;
+			return;
+		}
 
-		if (poll_count < 0) {
+		int event_count = _loop->wait(events, 1000); // 1 second timeout
+
+		if (event_count < 0) {
 			if (errno == EINTR) continue;
-			throw std::runtime_error("Poll failed");
+			throw std::runtime_error("Event loop wait failed");
 		}
 
 		// Check for timeout cleanup
 		_cleanupTimedOutClients();
 
-		for (size_t i = 0; i < _poll_fds.size(); ) {
-			if (_poll_fds[i].revents == 0) {
-				i++;
+		for (int i = 0; i < event_count; ++i) {
+			int current_fd = events[i].fd;
+			int ready = events[i].events;
+			if (ready == 0) {
+				continue; // Dropped by the backend, the fd was closed since
+			}
+
+			if (_listeners.find(current_fd) != _listeners.end()) {
+				if (ready & EVENT_ACCEPT) {
+					if (events[i].result >= 0) {
+						_addClient(current_fd, events[i].result);
+					} else if (events[i].result != -EAGAIN && events[i].result != -EINTR) {
+						std::cerr << "Failed to accept client connection" << std::endl;
+					}
+				} else if (ready & EVENT_ERROR) {
+					std::cerr << "Error on server socket" << std::endl;
+				} else {
+					_acceptNewClients(current_fd);
+				}
+				continue;
+			}
+
+			if (current_fd == _signal_pipe[0]) {
+				char drain[64];
+				while (read(_signal_pipe[0], drain, sizeof(drain)) > 0) {}
+				_reapCgiProcesses();
+				continue;
+			}
+
+			if (_disk_pool && current_fd == _disk_pool->getNotifyFd()) {
+				_handleDiskCompletions();
+				continue;
+			}
+
+			std::map<int, CgiHandler*>::iterator cgi = _cgi_fds.find(current_fd);
+			if (cgi != _cgi_fds.end()) {
+				_handleCgiEvent(cgi->second, current_fd);
+				continue;
+			}
+
+			std::map<int, FastCgiPool*>::iterator fastcgi = _fastcgi_fds.find(current_fd);
+			if (fastcgi != _fastcgi_fds.end()) {
+				_handleFastCgiEvent(fastcgi->second, current_fd, ready);
 				continue;
 			}
 
-			int current_fd = _poll_fds[i].fd;
+			// Client may have been removed earlier in this batch
+			if (_clients.find(current_fd) == _clients.end()) {
+				continue;
+			}
 
 			// Check for errors
-			if (_poll_fds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) {
-				if (current_fd == _server_fd) {
-					std::cerr << "Error on server socket" << std::endl;
-					i++;
-					continue;
-				}
+			if (ready & EVENT_ERROR) {
 				_removeClient(current_fd);
-				// Don't increment i, as the vector has shifted
 				continue;
 			}
 
-			// Handle POLLIN (incoming data)
-			if (_poll_fds[i].revents & POLLIN) {
-				if (current_fd == _server_fd) {
-					_acceptNewClient();
-				} else {
-					_handleClientData(current_fd);
-					// Check if client was removed during handling
-					if (_clients.find(current_fd) == _clients.end()) {
-						// Client was removed, don't increment i
-						continue;
-					}
+			// Handle incoming data
+			if (ready & EVENT_READ) {
+				_handleClientData(current_fd);
+				if (_clients.find(current_fd) == _clients.end()) {
+					continue;
 				}
 			}
 
-			// Check if i is still valid (in case _acceptNewClient modified the vector)
-			if (i >= _poll_fds.size() || _poll_fds[i].fd != current_fd) {
-				// Vector was modified, restart or continue
-				continue;
+			// Or what the kernel received and sent for it
+			if (ready & EVENT_DATA) {
+				_receiveClientData(current_fd, events[i].data, events[i].result);
+				if (_clients.find(current_fd) == _clients.end()) {
+					continue;
+				}
 			}
-
-			// Handle POLLOUT (ready to write)
-			if (_poll_fds[i].revents & POLLOUT) {
-				if (_output_buffers.find(current_fd) != _output_buffers.end() &&
-				    !_output_buffers[current_fd].empty()) {
-					_flushClientBuffer(current_fd);
+			if (ready & EVENT_SENT) {
+				_finishSend(current_fd, events[i].result);
+				if (_clients.find(current_fd) == _clients.end()) {
+					continue;
 				}
 			}
 
-			i++;
+			// Handle ready to write
+			if (ready & EVENT_WRITE) {
+				_flushClientBuffer(current_fd);
+				if (_clients.find(current_fd) == _clients.end()) {
+					continue;
+				}
+			}
+			_scheduleTimeout(_clients[current_fd]);
 		}
 	}
 }
@@ -114,102 +287,200 @@ void Server::run() {
 /* Socket setup */
 //
 
-void Server::_setupSocket() {
-	const ServerConfig& config = _config->getServerConfig(0);
+// Binds every distinct host:port of the server blocks, blocks sharing
+// one are told apart by their server_name
+void Server::_setupListeners() {
+	const std::map<std::string, VirtualHosts*>& listeners = _snapshot->getListeners();
+	for (std::map<std::string, VirtualHosts*>::const_iterator it = listeners.begin();
+	     it != listeners.end(); ++it) {
+		int fd = _openListener(it->second->getHost(), it->second->getPort());
+		_listeners[fd] = it->second;
+		std::cout << "Server running on " << it->first << std::endl;
+	}
+}
 
+int Server::_openListener(const std::string& host, int port) {
 	// Create server socket
-	_server_fd = socket(AF_INET, SOCK_STREAM, 0);
-	if (_server_fd < 0) {
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) {
 		throw std::runtime_error("Failed to create socket");
 	}
 
 	// Allow port reuse
 	int opt = 1;
-	if (setsockopt(_server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-		close(_server_fd);
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+		close(fd);
 		throw std::runtime_error("Failed to set socket options");
 	}
 
+#ifdef SO_REUSEPORT
+	// Every worker binds its own listener, the kernel balances between them
+	if (_snapshot->getConfig().getWorkers() > 1 &&
+	    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+		close(fd);
+		throw std::runtime_error("Failed to set SO_REUSEPORT");
+	}
+#endif
+
 	// Bind to port
 	struct sockaddr_in address;
 	address.sin_family = AF_INET;
 
 	// Convert host string to network address
-	if (inet_pton(AF_INET, config.host.c_str(), &address.sin_addr) <= 0) {
+	if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) <= 0) {
 		// Fallback to INADDR_ANY if host is invalid
 		address.sin_addr.s_addr = INADDR_ANY;
 	}
 
-	address.sin_port = htons(config.port);
+	address.sin_port = htons(port);
 
-	if (bind(_server_fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
-		close(_server_fd);
+	if (bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+		close(fd);
 		std::ostringstream oss;
-		oss << "Failed to bind socket to port " << config.port;
+		oss << "Failed to bind socket to " << host << ":" << port;
 		throw std::runtime_error(oss.str());
 	}
 
 	// Listen for connections
-	if (listen(_server_fd, LISTEN_CONN) < 0) {
-		close(_server_fd);
+	if (listen(fd, LISTEN_CONN) < 0) {
+		close(fd);
 		throw std::runtime_error("Failed to listen on server socket");
 	}
 
-	_setNonBlocking(_server_fd);
+	_setNonBlocking(fd);
+
+	// Inherited by accepted sockets, see _addClient
+	int nodelay = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+	// Register server socket with the event loop
+	bool added = _loop->hasCompletions() ? _loop->addAcceptor(fd) : _loop->add(fd, EVENT_READ);
+	if (!added) {
+		close(fd);
+		throw std::runtime_error("Failed to register server socket");
+	}
+	return fd;
+}
 
-	// Add server socket to poll array
-	struct pollfd server_pollfd;
-	server_pollfd.fd = _server_fd;
-	server_pollfd.events = POLLIN;
-	server_pollfd.revents = 0;
-	_poll_fds.push_back(server_pollfd);
+void Server::_closeListeners() {
+	for (std::map<int, const VirtualHosts*>::iterator it = _listeners.begin(); it != _listeners.end();
+	     ++it) {
+		_loop->remove(it->first);
+		close(it->first);
+	}
+	_listeners.clear();
 }
 
-void Server::_acceptNewClient() {
-	struct sockaddr_in client_addr;
-	socklen_t client_len = sizeof(client_addr);
+void Server::_acceptNewClients(int listen_fd) {
+	// Edge-triggered backends only notify once, so drain the backlog
+	while (true) {
+		struct sockaddr_in client_addr;
+		socklen_t client_len = sizeof(client_addr);
 
-	int client_fd = accept(_server_fd, (struct sockaddr*)&client_addr, &client_len);
-	if (client_fd < 0) {
-		std::cerr << "Failed to accept client connection" << std::endl;
-		return;
+		int client_fd = accept(listen_fd, (struct sockaddr*)&client_addr, &client_len);
+		if (client_fd < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+				std::cerr << "Failed to accept client connection" << std::endl;
+			}
+			return;
+		}
+
+		Client* client = _addClient(listen_fd, client_fd);
+		char address[INET_ADDRSTRLEN];
+		if (client && inet_ntop(AF_INET, &client_addr.sin_addr, address, sizeof(address))) {
+			client->setRemoteAddress(address);
+		}
 	}
+}
 
-	_setNonBlocking(client_fd);
+// Takes on an accepted connection, NULL if it was refused. io_uring
+// accepts non-blocking, close-on-exec sockets that inherit TCP_NODELAY
+// from the listener; the peer's address is looked up if a log needs it.
+Client* Server::_addClient(int listen_fd, int client_fd) {
+	Client* client = _client_pool->acquire(client_fd);
+	// Over max_connections. Counted rather than logged: under overload a
+	// line per refused connection would only add a blocking write
+	if (!client) {
+		_metrics.countRefused();
+		close(client_fd);
+		return NULL;
+	}
 
-	// Add to poll array
-	struct pollfd client_pollfd;
-	client_pollfd.fd = client_fd;
-	client_pollfd.events = POLLIN;
-	client_pollfd.revents = 0;
-	_poll_fds.push_back(client_pollfd);
+	bool added;
+	if (_loop->hasCompletions()) {
+		added = _loop->addReceiver(client_fd, EVENT_READ);
+	} else {
+		_setNonBlocking(client_fd);
+
+		// Streamed responses go out in several writes, don't let Nagle
+		// hold the tail back waiting for a delayed ACK
+		int nodelay = 1;
+		setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+		added = _loop->add(client_fd, EVENT_READ);
+	}
+	if (!added) {
+		std::cerr << "Failed to register client: fd=" << client_fd << std::endl;
+		_client_pool->release(client);
+		close(client_fd);
+		return NULL;
+	}
 
-	// Create client instance
-	_clients[client_fd] = new Client(client_fd);
-	std::cout << "New client connected: fd=" << client_fd << std::endl;
+	_snapshot->retain();
+	client->setSnapshot(_snapshot);
+	client->setVirtualHosts(_listeners[listen_fd]);
+	client->setServer(_listeners[listen_fd]->getDefault());
+	_clients[client_fd] = client;
+	_scheduleTimeout(client);
+	_metrics.countAccepted();
+	return client;
 }
 
 void Server::_handleClientData(int client_fd) {
 	char buffer[BUFFER_SIZE];
-	int bytes_read = recv(client_fd, buffer, sizeof(buffer) - 1, 0);
 
-	if (bytes_read <= 0) {
-		if (bytes_read == 0) {
-			std::cout << "Client disconnected: fd=" << client_fd << std::endl;
-		} else {
+	// Read until the socket is drained (required for edge-triggered backends)
+	while (true) {
+		ssize_t bytes_read = recv(client_fd, buffer, sizeof(buffer), 0);
+
+		if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			return;
+		}
+		if (bytes_read < 0 && errno == EINTR) {
+			continue;
+		}
+		if (!_receiveClientData(client_fd, buffer, bytes_read)) {
+			return;
+		}
+	}
+}
+
+// One read's worth of input, from recv() or an io_uring completion: 0 at
+// EOF, negative on errors. False once the client takes no more input.
+bool Server::_receiveClientData(int client_fd, const char* data, ssize_t length) {
+	if (length <= 0) {
+		if (length < 0) {
 			std::cerr << "Error reading from client: fd=" << client_fd << std::endl;
 		}
 		_removeClient(client_fd);
-		return;
+		return false;
 	}
 
 	// Append to client buffer
-	buffer[bytes_read] = '\0';
-	_clients[client_fd]->addToBuffer(std::string(buffer, bytes_read));
-	_clients[client_fd]->updateActivity();
+	Client* client = _clients[client_fd];
+	client->addToBuffer(data, length);
+	_metrics.addBytesIn(length);
+	client->updateActivity();
 
 	// Try to process the request
 	_processClientRequest(client_fd);
+	if (_clients.find(client_fd) == _clients.end()) {
+		return false;
+	}
+	if (client->shouldClose()) {
+		client->clearBuffer(); // Nothing after the last response is read
+		return false;
+	}
+	return !client->isReadPaused();
 }
 
 void Server::_setNonBlocking(int fd) {
@@ -218,6 +489,132 @@ void Server::_setNonBlocking(int fd) {
 		flags = 0;
 	}
 	fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+	// Server fds must not leak into CGI children
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+
+void Server::_installSignalHandlers() {
+	struct sigaction sa;
+	std::memset(&sa, 0, sizeof(sa));
+	sigemptyset(&sa.sa_mask);
+
+	// No SA_RESTART: the pending wait() must return with EINTR
+	sa.sa_handler = _onReloadSignal;
+	sigaction(SIGHUP, &sa, NULL);
+	sa.sa_handler = _onDrainSignal;
+	sigaction(SIGQUIT, &sa, NULL);
+	sa.sa_handler = _onReopenSignal;
+	sigaction(SIGUSR1, &sa, NULL);
+
+	sa.sa_handler = SIG_IGN;
+	sigaction(SIGPIPE, &sa, NULL);
+
+	// The self-pipe wakes the loop, no need to interrupt syscalls
+	sa.sa_handler = _onChildSignal;
+	sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+	sigaction(SIGCHLD, &sa, NULL);
+}
+
+void Server::_setupSignalPipe() {
+	if (pipe(_signal_pipe) < 0) {
+		throw std::runtime_error("Failed to create signal pipe");
+	}
+	_setNonBlocking(_signal_pipe[0]);
+	_setNonBlocking(_signal_pipe[1]);
+
+	if (!_loop->add(_signal_pipe[0], EVENT_READ)) {
+		throw std::runtime_error("Failed to register signal pipe");
+	}
+	g_signal_pipe_fd = _signal_pipe[1];
+}
+
+// Graceful shutdown (SIGQUIT): stop accepting and let in-flight
+// connections finish before exiting.
+void Server::_beginDrain() {
+	std::cout << "Draining connections before exit" << std::endl;
+	_draining = true;
+	_closeListeners();
+
+	// Idle keep-alive connections have nothing in flight
+	std::vector<int> idle_clients;
+	for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end(); ++it) {
+		if (_isIdle(it->second)) {
+			idle_clients.push_back(it->first);
+		}
+	}
+	for (size_t i = 0; i < idle_clients.size(); ++i) {
+		_removeClient(idle_clients[i]);
+	}
+}
+
+// SIGHUP: re-reads the configuration file into a new snapshot. Requests
+// already running finish on the one they started with, later ones use
+// the new one. Listeners are opened and closed to match the new server
+// blocks; connected clients are never closed.
+void Server::_reload() {
+	std::cout << "Reloading configuration" << std::endl;
+	Config* config = new Config(_config_file);
+	if (!config->load()) {
+		std::cerr << "Reload failed, keeping the current configuration" << std::endl;
+		delete config;
+		return;
+	}
+	config->bindMetrics(_metrics);
+	ConfigSnapshot* snapshot = new ConfigSnapshot(config);
+
+	std::map<std::string, int> unused; // Currently bound address -> listen fd
+	for (std::map<int, const VirtualHosts*>::iterator it = _listeners.begin(); it != _listeners.end();
+	     ++it) {
+		unused[it->second->getHost() + ":" + Utils::intToString(it->second->getPort())] = it->first;
+	}
+
+	// Bind new addresses first, so a failure leaves everything as it was
+	std::map<int, const VirtualHosts*> listeners;
+	const std::map<std::string, VirtualHosts*>& addresses = snapshot->getListeners();
+	try {
+		for (std::map<std::string, VirtualHosts*>::const_iterator it = addresses.begin();
+		     it != addresses.end(); ++it) {
+			std::map<std::string, int>::iterator bound = unused.find(it->first);
+			if (bound != unused.end()) {
+				listeners[bound->second] = it->second;
+				unused.erase(bound);
+				continue;
+			}
+			int fd = _openListener(it->second->getHost(), it->second->getPort());
+			listeners[fd] = it->second;
+			std::cout << "Server running on " << it->first << std::endl;
+		}
+	} catch (const std::exception& e) {
+		std::cerr << "Reload failed: " << e.what() << std::endl;
+		for (std::map<int, const VirtualHosts*>::iterator it = listeners.begin();
+		     it != listeners.end(); ++it) {
+			if (_listeners.find(it->first) == _listeners.end()) {
+				_loop->remove(it->first);
+				close(it->first);
+			}
+		}
+		delete snapshot;
+		return;
+	}
+
+	// Clients accepted on a removed address stay on the old configuration
+	for (std::map<std::string, int>::iterator it = unused.begin(); it != unused.end(); ++it) {
+		_loop->remove(it->second);
+		close(it->second);
+		std::cout << "Stopped listening on " << it->first << std::endl;
+	}
+
+	_listeners.swap(listeners);
+	_releaseSnapshot(_snapshot);
+	_snapshot = snapshot;
+	std::cout << "Configuration reloaded" << std::endl;
+}
+
+void Server::_releaseSnapshot(ConfigSnapshot* snapshot) {
+	if (snapshot->release()) {
+		delete snapshot;
+	}
 }
 
 //
@@ -226,71 +623,321 @@ void Server::_setNonBlocking(int fd) {
 
 void Server::_processClientRequest(int client_fd) {
 	Client* client = _clients[client_fd];
-	const std::string& buffer = client->getBuffer();
+	std::string& buffer = client->getBuffer();
+
+	// Pipelined requests are handled one at a time, in order. Responses
+	// queue up behind each other until the output reaches the high-water
+	// mark; a running CGI or a file being read ahead must finish before
+	// the next response is queued.
+	while (!client->shouldClose() && !client->getCgi() && !client->getDiskJob() &&
+	       client->getOutput().getSize() < OUTPUT_HIGH_WATER) {
+		HttpParser& parser = client->getParser();
+		long long parse_started = Utils::monotonicUsec();
+		HttpParser::Result result = parser.parse(buffer);
+
+		if (result != HttpParser::ERROR && parser.areHeadersComplete()) {
+			if (!client->isServerSelected()) {
+				_selectServer(client);
+			}
+			if (!_prepareRequestBody(client)) {
+				return;
+			}
+			result = parser.parse(buffer);
+		}
 
-	// Check if headers are complete
-	if (!client->areHeadersParsed()) {
-		size_t header_end = buffer.find("\r\n\r\n");
-		if (header_end == std::string::npos) {
-			// Headers not complete yet
+		if (result == HttpParser::INCOMPLETE) {
+			client->setParseTime(client->getParseTime() + Utils::monotonicUsec() - parse_started);
 			return;
 		}
-		client->setHeadersParsed(true);
 
-		// Parse headers to get Content-Length
-		Request temp_request;
-		if (temp_request.parse(buffer.substr(0, header_end + 4))) {
-			std::string content_length_str = temp_request.getHeader("Content-Length");
-			if (!content_length_str.empty()) {
-				size_t content_length = 0;
-				std::istringstream(content_length_str) >> content_length;
-				client->setContentLength(content_length);
-			}
+		if (result == HttpParser::ERROR) {
+			int status = parser.getErrorStatus();
+			Response response(status);
+			response.setBody("<html><body><h1>" + Utils::intToString(status) + " " +
+			                 response.getStatusMessage() + "</h1></body></html>");
+			response.setHeader("Content-Type", "text/html");
+			response.setHeader("Connection", "close");
+			client->setCloseAfterWrite(true);
+			_sendResponse(client_fd, response);
+			return;
+		}
+
+		// Only this request's bytes, anything after belongs to the next one
+		Request& request = client->getRequest();
+		request.build(buffer, parser);
+		if (client->isSpoolingBody()) {
+			request.setBodyFile(client->releaseBodySpool());
+		}
+		client->consume(parser.getMessageLength());
+
+		long long parsed_at = Utils::monotonicUsec();
+		_metrics.recordParse(client->getParseTime() + parsed_at - parse_started);
+		client->setParseTime(0);
+		client->setHandledAt(parsed_at);
+
+		_handleRequest(client_fd, request);
+		if (!client->getDiskJob()) {
+			request.reset();
+			client->getArena().reset(); // Nothing refers to the request's headers anymore
+		}
+	}
+}
+
+// Picks the server block for the request whose headers were just parsed:
+// the one on the client's listen socket named by the Host header. Each
+// request starts on the newest configuration, unless a reload removed the
+// address this client connected to. Runs once per request, so a body
+// still arriving across a reload stays on the configuration it began on.
+void Server::_selectServer(Client* client) {
+	client->setServerSelected(true);
+	if (client->getSnapshot() != _snapshot) {
+		const VirtualHosts* previous = client->getVirtualHosts();
+		const VirtualHosts* current = _snapshot->findListener(
+			previous->getHost() + ":" + Utils::intToString(previous->getPort()));
+		if (current) {
+			_snapshot->retain();
+			_releaseSnapshot(client->getSnapshot());
+			client->setSnapshot(_snapshot);
+			client->setVirtualHosts(current);
 		}
 	}
 
-	// Check if we have the complete request (including body if present)
-	size_t header_end = buffer.find("\r\n\r\n");
-	if (header_end != std::string::npos) {
-		size_t body_start = header_end + 4;
-		size_t body_received = buffer.length() - body_start;
-		client->setBodyReceived(body_received);
+	const std::string& buffer = client->getBuffer();
+	const std::vector<HeaderRef>& headers = client->getParser().getHeaders();
+	const VirtualHosts* virtual_hosts = client->getVirtualHosts();
+
+	for (size_t i = 0; i < headers.size(); ++i) {
+		if (HttpParser::equalsIgnoreCase(buffer, headers[i].name, "host")) {
+			client->setServer(virtual_hosts->find(buffer.data() + headers[i].value.offset,
+			                                      headers[i].value.length));
+			return;
+		}
+	}
+	client->setServer(virtual_hosts->getDefault());
+}
+
+// Enforces max_body_size as soon as the headers are known and moves large
+// bodies out of the receive buffer into a temp file as they arrive.
+// Returns false if the request was rejected.
+bool Server::_prepareRequestBody(Client* client) {
+	const ServerConfig& server_config = *client->getServer();
+	HttpParser& parser = client->getParser();
+	const std::string& buffer = client->getBuffer();
+
+	if (parser.getContentLength() > server_config.max_body_size) {
+		Response response(413);
+		response.setBody("<html><body><h1>413 Payload Too Large</h1></body></html>");
+		response.setHeader("Content-Type", "text/html");
+		response.setHeader("Connection", "close");
+		client->setCloseAfterWrite(true);
+		_sendResponse(client->getFd(), response);
+		return false;
+	}
+
+	if (parser.getContentLength() <= server_config.client_body_buffer_size) {
+		return true;
+	}
+
+	if (!client->isSpoolingBody()) {
+		// Spool next to the upload destination so POST can rename() it
+		std::string uri = HttpParser::toString(buffer, parser.getUri());
+		const LocationConfig* location = Config::findLocation(uri, server_config);
+		std::string dir = (location && !location->upload_path.empty()) ? location->upload_path : "/tmp";
+
+		if (!client->startBodySpool(dir)) {
+			std::cerr << "Failed to create body spool in " << dir << std::endl;
+			Response response(500);
+			response.setBody("<html><body><h1>500 Internal Server Error</h1></body></html>");
+			response.setHeader("Content-Type", "text/html");
+			response.setHeader("Connection", "close");
+			client->setCloseAfterWrite(true);
+			_sendResponse(client->getFd(), response);
+			return false;
+		}
+	}
 
-		// Check if body is complete
-		if (client->getContentLength() == 0 || body_received >= client->getContentLength()) {
-			client->setRequestComplete(true);
+	size_t length = parser.getBufferedBodyLength(buffer);
+	if (length > 0) {
+		if (!client->spoolBody(parser.getBodyOffset(), length)) {
+			Response response(500);
+			response.setBody("<html><body><h1>500 Internal Server Error</h1></body></html>");
+			response.setHeader("Content-Type", "text/html");
+			response.setHeader("Connection", "close");
+			client->setCloseAfterWrite(true);
+			_sendResponse(client->getFd(), response);
+			return false;
 		}
+		parser.skipBody(length);
 	}
+	return true;
+}
 
-	if (!client->isRequestComplete()) {
+void Server::_handleRequest(int client_fd, Request& request, bool prefetched) {
+	Client* client = _clients[client_fd];
+	const ServerConfig& server_config = *client->getServer();
+	if (!prefetched && server_config.access_log != "off") {
+		_captureLogEntry(client->getLogEntry(), request);
+	}
+	const LocationConfig* location = Config::findLocation(request.getPath(), server_config);
+	if (location && !prefetched) {
+		location->counters->requests++;
+		client->setLocationMetrics(location->counters);
+	}
+	std::string interpreter;
+	if (_isCgiRequest(request, location, interpreter)) {
+		_handleCgiRequest(client_fd, request, *location, interpreter);
 		return;
 	}
 
-	// Parse and handle the request
-	Request request;
-	if (!request.parse(buffer)) {
-		Response response(400);
-		response.setBody("<html><body><h1>400 Bad Request</h1></body></html>");
-		response.setHeader("Content-Type", "text/html");
-		_sendToClient(client_fd, response.build());
-		client->clearBuffer();
+	// Parked until the disk threads have read the file ahead
+	if (!prefetched && _startPrefetch(client, request, location)) {
 		return;
 	}
 
-	_handleRequest(client_fd, request);
-	client->clearBuffer();
+	Response response = location && location->metrics ?
+		_buildMetricsResponse(request, *location) : _buildResponse(request, server_config);
+
+	int file_fd = -1;
+	if (response.hasFileBody()) {
+		file_fd = open(response.getFilePath().c_str(), O_RDONLY | O_CLOEXEC);
+		if (file_fd < 0) {
+			response = Response(500);
+			response.setBody("<html><body><h1>500 Internal Server Error</h1></body></html>");
+			response.setHeader("Content-Type", "text/html");
+		}
+	}
+
+	client->incrementRequestsServed();
+	if (!_keepAlive(client, request)) {
+		client->setCloseAfterWrite(true);
+	}
+	_setConnectionHeaders(client, response);
+	_sendResponse(client_fd, response, file_fd);
+}
+
+// Hands a static GET to the disk threads when the file is not cached in
+// memory. True if the request was parked on the client; on any failure
+// it is served right away, as without aio.
+bool Server::_startPrefetch(Client* client, const Request& request,
+                            const LocationConfig* location) {
+	if (!location || !location->aio || location->metrics || request.getMethodBit() != METHOD_GET ||
+	    request.getPath().find("..") != std::string::npos) {
+		return false;
+	}
+	std::string key = location->root + request.getPath();
+	if (_file_cache->contains(key)) {
+		return false;
+	}
+
+	if (!_disk_pool) {
+		try {
+			_disk_pool = new DiskIoPool(_snapshot->getConfig().getAioThreads());
+		} catch (const std::exception& e) {
+			std::cerr << "aio disabled: " << e.what() << std::endl;
+			return false;
+		}
+		_loop->add(_disk_pool->getNotifyFd(), EVENT_READ);
+	}
+
+	DiskJob* job = new DiskJob();
+	job->path = key;
+	if (!location->index.empty()) {
+		job->index = key;
+		if (key[key.length() - 1] != '/') {
+			job->index += "/";
+		}
+		job->index += location->index;
+	}
+	job->client_fd = client->getFd();
+	if (!_disk_pool->submit(job)) {
+		delete job; // Queue full, read in the loop instead
+		return false;
+	}
+	client->setDiskJob(job);
+	_setReadInterest(client, false); // Resumed when the job is collected
+	return true;
+}
+
+// Resumes the clients whose files were read ahead. A job whose client
+// went away, or whose fd now belongs to a new connection, is dropped.
+void Server::_handleDiskCompletions() {
+	std::vector<DiskJob*> done;
+	_disk_pool->collect(done);
+
+	for (size_t i = 0; i < done.size(); ++i) {
+		int client_fd = done[i]->client_fd;
+		std::map<int, Client*>::iterator it = _clients.find(client_fd);
+		bool current = it != _clients.end() && it->second->getDiskJob() == done[i];
+		delete done[i];
+		if (!current) {
+			continue;
+		}
+
+		Client* client = it->second;
+		client->setDiskJob(NULL);
+		_resumeReading(client);
+		Request& request = client->getRequest();
+		_handleRequest(client_fd, request, true);
+		request.reset();
+		client->getArena().reset();
+
+		// Pipelined requests waited behind this one
+		_processClientRequest(client_fd);
+		if (_clients.count(client_fd)) {
+			_scheduleTimeout(client);
+		}
+	}
+}
+
+// Decides whether the connection survives this response (RFC 9112 9.3)
+bool Server::_keepAlive(Client* client, const Request& request) {
+	const ServerConfig& server_config = *client->getServer();
+	std::string connection = request.getHeader("Connection");
+	for (size_t i = 0; i < connection.length(); ++i) {
+		connection[i] = std::tolower(connection[i]);
+	}
+
+	bool keep_alive;
+	if (request.getVersion() == "HTTP/1.0") {
+		keep_alive = connection.find("keep-alive") != std::string::npos;
+	} else {
+		keep_alive = connection.find("close") == std::string::npos;
+	}
+
+	if (server_config.keepalive_timeout <= 0 || _draining ||
+	    client->getRequestsServed() >= server_config.keepalive_requests) {
+		keep_alive = false;
+	}
+	return keep_alive;
 }
 
-void Server::_handleRequest(int client_fd, Request& request) {
-	std::cout << "Request: " << request.getMethod() << " " << request.getUri() << std::endl;
+void Server::_setConnectionHeaders(Client* client, Response& response) {
+	const ServerConfig& server_config = *client->getServer();
+	if (client->shouldClose()) {
+		response.setHeader("Connection", "close");
+		return;
+	}
 
-	Response response = _buildResponse(request);
-	_sendToClient(client_fd, response.build());
+	// _keepAlive closed the connection if no requests were left
+	std::string keep_alive_value = "timeout=";
+	Utils::appendNumber(keep_alive_value, server_config.keepalive_timeout);
+	keep_alive_value += ", max=";
+	Utils::appendNumber(keep_alive_value,
+	                    server_config.keepalive_requests - client->getRequestsServed());
+	response.setHeader("Connection", "keep-alive");
+	response.setHeader("Keep-Alive", keep_alive_value);
 }
 
-Response Server::_buildResponse(const Request& request) {
-	const ServerConfig& server_config = _config->getServerConfig(0);
-	const LocationConfig* location = _config->findLocation(request.getUri(), server_config);
+Response Server::_buildResponse(Request& request, const ServerConfig& server_config) {
+	const LocationConfig* location = Config::findLocation(request.getPath(), server_config);
+
+	// Never resolve paths outside of the configured roots
+	if (request.getPath().find("..") != std::string::npos) {
+		Response response(403);
+		response.setBody("<html><body><h1>403 Forbidden</h1></body></html>");
+		response.setHeader("Content-Type", "text/html");
+		return response;
+	}
 
 	if (!location) {
 		Response response(404);
@@ -300,15 +947,7 @@ Response Server::_buildResponse(const Request& request) {
 	}
 
 	// Check if method is allowed
-	bool method_allowed = false;
-	for (size_t i = 0; i < location->methods.size(); ++i) {
-		if (location->methods[i] == request.getMethod()) {
-			method_allowed = true;
-			break;
-		}
-	}
-
-	if (!method_allowed) {
+	if (!(location->allowed_methods & request.getMethodBit())) {
 		Response response(405);
 		response.setBody("<html><body><h1>405 Method Not Allowed</h1></body></html>");
 		response.setHeader("Content-Type", "text/html");
@@ -317,12 +956,20 @@ Response Server::_buildResponse(const Request& request) {
 
 	// Handle different methods
 	if (request.getMethod() == "GET") {
-		std::string file_path = location->root + request.getUri();
+		std::string key = location->root + request.getPath();
 
-		// Check if path is a directory
-		struct stat path_stat;
-		if (stat(file_path.c_str(), &path_stat) == 0) {
-			if (S_ISDIR(path_stat.st_mode)) {
+		// Hot files are served from memory without touching the disk
+		const CachedFile* cached = _file_cache->lookup(key);
+		if (cached) {
+			return _serveCachedFile(request, *location, *cached);
+		}
+
+		// One stat() for the path, one more for a directory's index
+		std::string file_path = key;
+		struct stat file_stat;
+		bool found = stat(file_path.c_str(), &file_stat) == 0;
+		if (found) {
+			if (S_ISDIR(file_stat.st_mode)) {
 				// Try index file
 				std::string index_path = file_path;
 				if (index_path[index_path.length() - 1] != '/') {
@@ -330,14 +977,13 @@ Response Server::_buildResponse(const Request& request) {
 				}
 				index_path += location->index;
 
-				if (_fileExists(index_path)) {
+				struct stat index_stat;
+				if (!location->index.empty() && stat(index_path.c_str(), &index_stat) == 0 &&
+				    S_ISREG(index_stat.st_mode)) {
 					file_path = index_path;
+					file_stat = index_stat;
 				} else if (location->autoindex) {
-					// TODO: Implement directory listing
-					Response response(200);
-					response.setBody("<html><body><h1>Directory listing not yet implemented</h1></body></html>");
-					response.setHeader("Content-Type", "text/html");
-					return response;
+					return _serveDirectoryListing(request, file_path, file_stat);
 				} else {
 					Response response(403);
 					response.setBody("<html><body><h1>403 Forbidden</h1></body></html>");
@@ -347,12 +993,8 @@ Response Server::_buildResponse(const Request& request) {
 			}
 		}
 
-		if (_fileExists(file_path)) {
-			std::string content = _readFile(file_path);
-			Response response(200);
-			response.setBody(content);
-			response.setHeader("Content-Type", _getContentType(file_path));
-			return response;
+		if (found && S_ISREG(file_stat.st_mode)) {
+			return _serveFile(request, *location, key, file_path, file_stat);
 		} else {
 			Response response(404);
 			response.setBody("<html><body><h1>404 Not Found</h1></body></html>");
@@ -361,6 +1003,14 @@ Response Server::_buildResponse(const Request& request) {
 		}
 	}
 
+	if (request.getMethod() == "POST") {
+		return _handleUpload(request, *location);
+	}
+
+	if (request.getMethod() == "DELETE") {
+		return _handleDelete(request, *location);
+	}
+
 	// Default response
 	Response response(501);
 	response.setBody("<html><body><h1>501 Not Implemented</h1></body></html>");
@@ -368,103 +1018,1466 @@ Response Server::_buildResponse(const Request& request) {
 	return response;
 }
 
-//
-/* Output handling */
-//
-
-void Server::_sendToClient(int client_fd, const std::string& data) {
-	_output_buffers[client_fd] += data;
+// autoindex: a page of the directory's snapshot, JSON when the client
+// prefers it to HTML. It is formatted as the socket drains, except for
+// HTTP/1.0 clients, which can't take chunks and get it built in memory.
+Response Server::_serveDirectoryListing(const Request& request, const std::string& path,
+                                        const struct stat& info) {
+	// "/uploads" and "/uploads/" share one snapshot
+	std::string key = path;
+	if (key.length() > 1 && key[key.length() - 1] == '/') {
+		key.erase(key.length() - 1);
+	}
+	ListingOptions listing;
+	if (!_directory_cache->lookup(key, info, listing.snapshot)) {
+		int status = errno == EACCES ? 403 : 500;
+		Response response(status);
+		response.setBody("<html><body><h1>" + Utils::intToString(status) + " " +
+		                 response.getStatusMessage() + "</h1></body></html>");
+		response.setHeader("Content-Type", "text/html");
+		return response;
+	}
+	listing.uri = request.getPath();
+	if (listing.uri[listing.uri.length() - 1] != '/') {
+		listing.uri += '/';
+	}
+	_parseListingQuery(request.getQuery(), listing);
+	std::string accept = request.getHeader("Accept");
+	listing.json = accept.find("application/json") != std::string::npos &&
+	               accept.find("text/html") == std::string::npos;
+
+	Response response(200);
+	response.setHeader("Content-Type", listing.json ? "application/json" : "text/html; charset=utf-8");
+	response.setHeader("Vary", "Accept");
+	if (request.getVersion() == "HTTP/1.1") {
+		response.setListingBody(listing);
+		return response;
+	}
+	DirectoryListing formatter(listing);
+	std::string body;
+	while (!formatter.next(body)) {
+	}
+	response.setBody(body);
+	return response;
+}
 
-	// Update poll events to include POLLOUT
-	for (size_t i = 0; i < _poll_fds.size(); i++) {
-		if (_poll_fds[i].fd == client_fd) {
-			_poll_fds[i].events |= POLLOUT;
-			break;
+// sort=name|size|mtime, order=asc|desc, offset=N, limit=N; anything
+// else, or a value that doesn't parse, keeps the default
+void Server::_parseListingQuery(const std::string& query, ListingOptions& listing) {
+	std::vector<std::string> params = Utils::split(query, '&');
+	for (size_t i = 0; i < params.size(); ++i) {
+		size_t equals = params[i].find('=');
+		if (equals == std::string::npos) {
+			continue;
+		}
+		std::string key = params[i].substr(0, equals);
+		std::string value = params[i].substr(equals + 1);
+		if (key == "sort") {
+			if (value == "name") {
+				listing.sort = SORT_NAME;
+			} else if (value == "size") {
+				listing.sort = SORT_SIZE;
+			} else if (value == "mtime") {
+				listing.sort = SORT_MTIME;
+			}
+		} else if (key == "order") {
+			listing.descending = value == "desc";
+		} else if ((key == "offset" || key == "limit") && !value.empty() && value.length() <= 9 &&
+		           value.find_first_not_of("0123456789") == std::string::npos) {
+			size_t number = static_cast<size_t>(std::atol(value.c_str()));
+			if (key == "offset") {
+				listing.offset = number;
+			} else {
+				listing.limit = number;
+			}
 		}
 	}
 }
 
-void Server::_flushClientBuffer(int client_fd) {
-	std::string& buffer = _output_buffers[client_fd];
-	if (buffer.empty()) {
-		return;
+// Small files go through the cache, larger ones are streamed from disk
+// by _flushClientBuffer. A gzip_static sibling wins over compressing.
+Response Server::_serveFile(const Request& request, const LocationConfig& location,
+                            const std::string& key, const std::string& path,
+                            const struct stat& info) {
+	std::string content_type = _getContentType(path);
+	Response response;
+	if (_servePrecompressed(request, location, path, content_type, response)) {
+		return response;
 	}
 
-	ssize_t sent = send(client_fd, buffer.c_str(), buffer.length(), 0);
-	if (sent > 0) {
-		buffer.erase(0, static_cast<size_t>(sent));
-	} else if (sent == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
-		// Real error
-		return;
+	std::string encoding = _negotiateEncoding(request, location, content_type, info.st_size);
+	const CachedFile* cached = _file_cache->insert(key, path, info, content_type);
+	if (cached) {
+		return _sendCachedFile(request, location, *cached, encoding, false);
 	}
 
-	// If buffer is empty, remove POLLOUT from events
-	if (buffer.empty()) {
-		for (size_t i = 0; i < _poll_fds.size(); i++) {
-			if (_poll_fds[i].fd == client_fd) {
-				_poll_fds[i].events = POLLIN;
-				break;
-			}
-		}
+	// Streamed compression needs chunked framing and cannot serve ranges
+	if (request.getVersion() != "HTTP/1.1" || request.hasHeader("Range")) {
+		encoding.clear();
 	}
+	return _sendFile(request, location, path, info, content_type, encoding, !encoding.empty());
 }
 
-//
-/* Client management */
-//
-
-void Server::_removeClient(int client_fd) {
-	// Remove from poll_fds
-	for (std::vector<struct pollfd>::iterator it = _poll_fds.begin(); it != _poll_fds.end(); ++it) {
-		if (it->fd == client_fd) {
-			_poll_fds.erase(it);
+Response Server::_serveCachedFile(const Request& request, const LocationConfig& location,
+                                  const CachedFile& file) {
+	Response response;
+	if (_servePrecompressed(request, location, file.path, file.content_type, response)) {
+		return response;
+	}
+	std::string encoding = _negotiateEncoding(request, location, file.content_type, file.size);
+	return _sendCachedFile(request, location, file, encoding, false);
+}
+
+// gzip_static: path.gz is sent as-is, with the original's content type
+bool Server::_servePrecompressed(const Request& request, const LocationConfig& location,
+                                 const std::string& path, const std::string& content_type,
+                                 Response& response) {
+	if (!location.gzip_static ||
+	    !Utils::acceptsEncoding(request.getHeader("Accept-Encoding"), "gzip")) {
+		return false;
+	}
+	std::string gz_path = path + ".gz";
+	const CachedFile* cached = _file_cache->lookup(gz_path);
+	if (cached) {
+		response = _sendCachedFile(request, location, *cached, "gzip", true);
+		return true;
+	}
+
+	struct stat info;
+	if (stat(gz_path.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) {
+		return false;
+	}
+	cached = _file_cache->insert(gz_path, gz_path, info, content_type);
+	if (cached) {
+		response = _sendCachedFile(request, location, *cached, "gzip", true);
+	} else {
+		response = _sendFile(request, location, gz_path, info, content_type, "gzip", false);
+	}
+	return true;
+}
+
+// Sends file's body, or its compressed variant when encoding is set and
+// the body is not precompressed. Variants are compressed once and kept
+// in the cache next to the original. Bodies are queued without a copy.
+Response Server::_sendCachedFile(const Request& request, const LocationConfig& location,
+                                 const CachedFile& file, const std::string& encoding,
+                                 bool precompressed) {
+	SharedBuffer body = file.body;
+	std::string etag = file.etag;
+	std::string content_encoding = encoding;
+
+	if (!encoding.empty() && !precompressed) {
+		std::map<std::string, SharedBuffer>::const_iterator it = file.encoded.find(encoding);
+		std::string compressed;
+		if (it != file.encoded.end()) {
+			body = it->second;
+		} else if (Deflater::compressAll(encoding, location.gzip_comp_level,
+		                                 file.body.getData(), compressed)) {
+			body = SharedBuffer(compressed);
+			_file_cache->addEncoding(file.key, encoding, body);
+		} else {
+			content_encoding.clear(); // Fall back to identity
+		}
+		if (!content_encoding.empty()) {
+			etag = _encodedEtag(file.etag, encoding);
+		}
+	}
+
+	if (_isNotModified(request, location, etag, file.mtime)) {
+		Response response(304);
+		_setCacheHeaders(response, location, etag, file.last_modified);
+		_setEncodingHeaders(response, location, file.content_type, "");
+		return response;
+	}
+
+	Response response(200);
+	if (!_setRangeBody(response, request, etag, file.mtime, body.getLength(),
+	                   file.content_type, &body.getData(), file.path)) {
+		response.setSharedBody(body);
+		response.setHeader("Content-Type", file.content_type);
+	}
+	response.setHeader("Accept-Ranges", "bytes");
+	_setCacheHeaders(response, location, etag, file.last_modified);
+	_setEncodingHeaders(response, location, file.content_type, content_encoding);
+	return response;
+}
+
+// Sent from disk with sendfile(), or compressed block by block on the way
+// out when compress is set.
+Response Server::_sendFile(const Request& request, const LocationConfig& location,
+                           const std::string& path, const struct stat& info,
+                           const std::string& content_type, const std::string& encoding,
+                           bool compress) {
+	std::string etag = Utils::makeEtag(info.st_ino, info.st_size, info.st_mtime);
+	if (compress) {
+		etag = _encodedEtag(etag, encoding);
+	}
+	if (_isNotModified(request, location, etag, info.st_mtime)) {
+		Response response(304);
+		_setCacheHeaders(response, location, etag, Utils::httpDate(info.st_mtime));
+		_setEncodingHeaders(response, location, content_type, "");
+		return response;
+	}
+
+	Response response(200);
+	if (compress) {
+		response.setFileBody(path, 0, info.st_size);
+		response.setFileEncoding(encoding, location.gzip_comp_level);
+		response.setHeader("Content-Type", content_type);
+	} else {
+		if (!_setRangeBody(response, request, etag, info.st_mtime, info.st_size,
+		                   content_type, NULL, path)) {
+			response.setFileBody(path, 0, info.st_size);
+			response.setHeader("Content-Type", content_type);
+		}
+		response.setHeader("Accept-Ranges", "bytes");
+	}
+	_setCacheHeaders(response, location, etag, Utils::httpDate(info.st_mtime));
+	_setEncodingHeaders(response, location, content_type, encoding);
+	return response;
+}
+
+// Best coding the client accepts for a compressible body, "" for identity
+std::string Server::_negotiateEncoding(const Request& request, const LocationConfig& location,
+                                       const std::string& content_type, off_t size) {
+	if (!location.gzip || static_cast<size_t>(size) < location.gzip_min_length ||
+	    !_isCompressible(content_type)) {
+		return "";
+	}
+	std::string accept = request.getHeader("Accept-Encoding");
+	if (Utils::acceptsEncoding(accept, "gzip")) {
+		return "gzip";
+	}
+	if (Utils::acceptsEncoding(accept, "deflate")) {
+		return "deflate";
+	}
+	return "";
+}
+
+// Each coding is its own representation and needs its own strong ETag
+std::string Server::_encodedEtag(const std::string& etag, const std::string& encoding) {
+	return etag.substr(0, etag.length() - 1) + "-" + encoding + "\"";
+}
+
+// Content-Encoding, and Vary whenever the coding depends on the request
+void Server::_setEncodingHeaders(Response& response, const LocationConfig& location,
+                                 const std::string& content_type, const std::string& encoding) {
+	if (!encoding.empty()) {
+		response.setHeader("Content-Encoding", encoding);
+	}
+	if (location.gzip_static || (location.gzip && _isCompressible(content_type))) {
+		response.setHeader("Vary", "Accept-Encoding");
+	}
+}
+
+// If-Range (RFC 9110 13.1.5): the range applies only to the representation
+// the client already holds, matched by strong ETag or exact Last-Modified.
+bool Server::_isRangeFresh(const Request& request, const std::string& etag, time_t mtime) {
+	if (!request.hasHeader("If-Range")) {
+		return true;
+	}
+	std::string validator = Utils::trim(request.getHeader("If-Range"));
+	if (!validator.empty() && validator[0] == '"') {
+		return validator == etag;
+	}
+	time_t date;
+	return Utils::parseHttpDate(validator, date) && date == mtime;
+}
+
+// Range requests (RFC 9110 14.2): turns response into a 206 or 416 and
+// returns true, or returns false to send the whole representation. Parts
+// are copied from the cached body, or sent from the file at their offsets.
+bool Server::_setRangeBody(Response& response, const Request& request, const std::string& etag,
+                           time_t mtime, off_t size, const std::string& content_type,
+                           const std::string* body, const std::string& path) {
+	if (!request.hasHeader("Range") || !_isRangeFresh(request, etag, mtime)) {
+		return false;
+	}
+	std::vector<std::pair<off_t, off_t> > ranges;
+	int result = Utils::parseRange(request.getHeader("Range"), size, ranges);
+	if (result < 0) {
+		return false;
+	}
+
+	std::string total = "/";
+	Utils::appendNumber(total, size);
+	if (result == 0) {
+		response.setStatus(416);
+		response.setBody("<html><body><h1>416 Range Not Satisfiable</h1></body></html>");
+		response.setHeader("Content-Type", "text/html");
+		response.setHeader("Content-Range", "bytes *" + total);
+		return true;
+	}
+
+	response.setStatus(206);
+	if (ranges.size() == 1) {
+		off_t first = ranges[0].first;
+		off_t length = ranges[0].second - first + 1;
+		std::string content_range = "bytes ";
+		Utils::appendNumber(content_range, first);
+		content_range += '-';
+		Utils::appendNumber(content_range, ranges[0].second);
+		content_range += total;
+		response.setHeader("Content-Range", content_range);
+		response.setHeader("Content-Type", content_type);
+		if (body) {
+			std::string slice(*body, first, length);
+			response.swapBody(slice);
+		} else {
+			response.setFileBody(path, first, length);
+		}
+		return true;
+	}
+
+	// Several ranges: multipart/byteranges (RFC 9110 14.6)
+	static unsigned long boundary_count = 0;
+	std::string boundary = "webserv";
+	Utils::appendNumber(boundary, static_cast<unsigned long>(time(NULL)), 16);
+	Utils::appendNumber(boundary, getpid(), 16);
+	Utils::appendNumber(boundary, ++boundary_count, 16);
+
+	std::string multipart;
+	std::string part;
+	if (!body) {
+		response.setFileBody(path);
+	}
+	for (size_t i = 0; i < ranges.size(); ++i) {
+		part.assign(i ? "\r\n--" : "--");
+		part += boundary;
+		part += "\r\nContent-Type: ";
+		part += content_type;
+		part += "\r\nContent-Range: bytes ";
+		Utils::appendNumber(part, ranges[i].first);
+		part += '-';
+		Utils::appendNumber(part, ranges[i].second);
+		part += total;
+		part += "\r\n\r\n";
+		off_t length = ranges[i].second - ranges[i].first + 1;
+		if (body) {
+			multipart += part;
+			multipart.append(*body, ranges[i].first, length);
+		} else {
+			response.addFileRange(part, ranges[i].first, length);
+		}
+	}
+	std::string trailer = "\r\n--" + boundary + "--\r\n";
+	if (body) {
+		multipart += trailer;
+		response.swapBody(multipart);
+	} else {
+		response.setFileTrailer(trailer);
+	}
+	response.setHeader("Content-Type", "multipart/byteranges; boundary=" + boundary);
+	return true;
+}
+
+// If-None-Match takes precedence over If-Modified-Since (RFC 9110 13.2.2)
+bool Server::_isNotModified(const Request& request, const LocationConfig& location,
+                            const std::string& etag, time_t mtime) {
+	if (request.hasHeader("If-None-Match")) {
+		return location.etag != "off" && Utils::etagMatches(request.getHeader("If-None-Match"), etag);
+	}
+	if (request.hasHeader("If-Modified-Since")) {
+		time_t since;
+		return Utils::parseHttpDate(request.getHeader("If-Modified-Since"), since) && mtime <= since;
+	}
+	return false;
+}
+
+// Validators and caching directives, sent with both 200 and 304
+void Server::_setCacheHeaders(Response& response, const LocationConfig& location,
+                              const std::string& etag, const std::string& last_modified) {
+	response.setHeader("Last-Modified", last_modified);
+	if (location.etag == "weak") {
+		response.setHeader("ETag", "W/" + etag);
+	} else if (location.etag != "off") {
+		response.setHeader("ETag", etag);
+	}
+	if (!location.cache_control.empty()) {
+		response.setHeader("Cache-Control", location.cache_control);
+	}
+}
+
+// Stores the request body under upload_path. Spooled bodies already live
+// there and are renamed into place, small ones are written out.
+Response Server::_handleUpload(Request& request, const LocationConfig& location) {
+	if (location.upload_path.empty()) {
+		Response response(403);
+		response.setBody("<html><body><h1>403 Forbidden</h1></body></html>");
+		response.setHeader("Content-Type", "text/html");
+		return response;
+	}
+
+	// Name from the URI below the location, generated if there is none
+	std::string name = request.getPath().substr(location.path.length());
+	while (!name.empty() && name[0] == '/') {
+		name = name.substr(1);
+	}
+	if (name.empty()) {
+		static unsigned int upload_count = 0;
+		name = "upload_";
+		Utils::appendNumber(name, time(NULL));
+		name += '_';
+		Utils::appendNumber(name, getpid());
+		name += '_';
+		Utils::appendNumber(name, upload_count++);
+	}
+	std::string target = Utils::joinPath(location.upload_path, name);
+
+	bool stored;
+	if (request.hasBodyFile()) {
+		stored = rename(request.getBodyFile().c_str(), target.c_str()) == 0;
+		if (stored) {
+			request.releaseBodyFile();
+		}
+	} else {
+		stored = Utils::writeFile(target, request.getBody());
+	}
+
+	_file_cache->invalidate(target);
+
+	if (!stored) {
+		std::cerr << "Failed to store upload " << target << ": " << std::strerror(errno) << std::endl;
+		Response response(500);
+		response.setBody("<html><body><h1>500 Internal Server Error</h1></body></html>");
+		response.setHeader("Content-Type", "text/html");
+		return response;
+	}
+
+	std::string location_uri = Utils::joinPath(location.path, name);
+	Response response(201);
+	response.setBody("<html><body><h1>201 Created</h1><p>" + location_uri + "</p></body></html>");
+	response.setHeader("Content-Type", "text/html");
+	response.setHeader("Location", location_uri);
+	return response;
+}
+
+Response Server::_handleDelete(const Request& request, const LocationConfig& location) {
+	std::string file_path = location.root + request.getPath();
+
+	struct stat file_stat;
+	if (stat(file_path.c_str(), &file_stat) != 0) {
+		Response response(404);
+		response.setBody("<html><body><h1>404 Not Found</h1></body></html>");
+		response.setHeader("Content-Type", "text/html");
+		return response;
+	}
+
+	_file_cache->invalidate(file_path);
+	if (!S_ISREG(file_stat.st_mode) || unlink(file_path.c_str()) != 0) {
+		Response response(403);
+		response.setBody("<html><body><h1>403 Forbidden</h1></body></html>");
+		response.setHeader("Content-Type", "text/html");
+		return response;
+	}
+
+	return Response(204);
+}
+
+//
+/* Metrics */
+//
+
+// This worker's counters in the Prometheus text format, with the gauges
+// read from the clients, the file cache and the disk threads
+Response Server::_buildMetricsResponse(const Request& request, const LocationConfig& location) {
+	if (!(location.allowed_methods & request.getMethodBit()) ||
+	    request.getMethodBit() != METHOD_GET) {
+		Response response(405);
+		response.setBody("<html><body><h1>405 Method Not Allowed</h1></body></html>");
+		response.setHeader("Content-Type", "text/html");
+		return response;
+	}
+
+	unsigned long long sent = 0;
+	size_t idle = 0;
+	for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end(); ++it) {
+		sent += it->second->getOutput().getSent();
+		if (_isIdle(it->second) && it->second->getHandledAt() == 0) { // Not the scraper itself
+			idle++;
+		}
+	}
+
+	std::string body;
+	_metrics.write(body, sent);
+
+	Metrics::writeHeader(body, "webserv_connections", "gauge", "Open client connections");
+	Metrics::writeValue(body, "webserv_connections", "state=\"active\"", _clients.size() - idle);
+	Metrics::writeValue(body, "webserv_connections", "state=\"idle\"", idle);
+
+	Metrics::writeHeader(body, "webserv_file_cache_lookups_total", "counter",
+	                     "File cache lookups by result");
+	Metrics::writeValue(body, "webserv_file_cache_lookups_total", "result=\"hit\"",
+	                    _file_cache->getHits());
+	Metrics::writeValue(body, "webserv_file_cache_lookups_total", "result=\"miss\"",
+	                    _file_cache->getMisses());
+	Metrics::writeHeader(body, "webserv_file_cache_evictions_total", "counter",
+	                     "Files dropped from the cache to make room");
+	Metrics::writeValue(body, "webserv_file_cache_evictions_total", "", _file_cache->getEvictions());
+	Metrics::writeHeader(body, "webserv_file_cache_entries", "gauge", "Files held in memory");
+	Metrics::writeValue(body, "webserv_file_cache_entries", "", _file_cache->getEntryCount());
+	Metrics::writeHeader(body, "webserv_file_cache_bytes", "gauge", "Memory used by cached files");
+	Metrics::writeValue(body, "webserv_file_cache_bytes", "", _file_cache->getSize());
+	Metrics::writeHeader(body, "webserv_directory_cache_lookups_total", "counter",
+	                     "autoindex snapshot lookups by result");
+	Metrics::writeValue(body, "webserv_directory_cache_lookups_total", "result=\"hit\"",
+	                    _directory_cache->getHits());
+	Metrics::writeValue(body, "webserv_directory_cache_lookups_total", "result=\"miss\"",
+	                    _directory_cache->getMisses());
+	Metrics::writeHeader(body, "webserv_directory_cache_entries", "gauge",
+	                     "Directory snapshots held in memory");
+	Metrics::writeValue(body, "webserv_directory_cache_entries", "", _directory_cache->getEntryCount());
+
+	// Absent until the first aio request starts the threads
+	if (_disk_pool) {
+		Metrics::writeHeader(body, "webserv_aio_threads", "gauge", "Disk I/O threads");
+		Metrics::writeValue(body, "webserv_aio_threads", "", _disk_pool->getThreadCount());
+		Metrics::writeHeader(body, "webserv_aio_queue_depth", "gauge",
+		                     "Read-ahead jobs waiting or running");
+		Metrics::writeValue(body, "webserv_aio_queue_depth", "", _disk_pool->getQueueDepth());
+		Metrics::writeHeader(body, "webserv_aio_jobs_total", "counter", "Read-ahead jobs by outcome");
+		Metrics::writeValue(body, "webserv_aio_jobs_total", "state=\"submitted\"",
+		                    _disk_pool->getSubmitted());
+		Metrics::writeValue(body, "webserv_aio_jobs_total", "state=\"completed\"",
+		                    _disk_pool->getCompleted());
+		Metrics::writeValue(body, "webserv_aio_jobs_total", "state=\"rejected\"",
+		                    _disk_pool->getRejected());
+		Metrics::writeHeader(body, "webserv_aio_wait_seconds_total", "counter",
+		                     "Time jobs spent queued before a thread took them");
+		Metrics::writeSeconds(body, "webserv_aio_wait_seconds_total", "", _disk_pool->getWaitTotal());
+		Metrics::writeHeader(body, "webserv_aio_wait_seconds_max", "gauge",
+		                     "Longest time a job spent queued");
+		Metrics::writeSeconds(body, "webserv_aio_wait_seconds_max", "", _disk_pool->getWaitMax());
+	}
+
+	Metrics::writeHeader(body, "webserv_access_log_lines_total", "counter",
+	                     "Access log lines by outcome");
+	for (std::map<std::string, AccessLog*>::iterator it = _access_logs.begin();
+	     it != _access_logs.end(); ++it) {
+		if (!it->second) {
+			continue;
+		}
+		std::string label = "log=\"" + it->first + "\",state=";
+		Metrics::writeValue(body, "webserv_access_log_lines_total", label + "\"buffered\"",
+		                    it->second->getLines());
+		Metrics::writeValue(body, "webserv_access_log_lines_total", label + "\"dropped\"",
+		                    it->second->getDropped());
+	}
+
+	Response response(200);
+	response.setBody(body);
+	response.setHeader("Content-Type", "text/plain; version=0.0.4; charset=utf-8");
+	response.setHeader("Cache-Control", "no-store");
+	return response;
+}
+
+// A response was queued: the handler phase ends, and the send phase
+// starts unless an earlier response is still going out. bytes is the
+// body queued with the head, a streamed CGI body is not included.
+void Server::_countResponse(Client* client, int status, off_t bytes) {
+	long long now = Utils::monotonicUsec();
+	long long duration = client->getHandledAt() != 0 ? now - client->getHandledAt() : 0;
+	_metrics.countResponse(status, client->getLocationMetrics());
+	client->setLocationMetrics(NULL);
+	if (client->getHandledAt() != 0) {
+		_metrics.recordHandler(duration);
+		client->setHandledAt(0);
+	}
+
+	const ServerConfig& server_config = *client->getServer();
+	AccessLog* log = _getAccessLog(server_config);
+	if (log) {
+		if (client->getRemoteAddress().empty()) {
+			_lookupRemoteAddress(client);
+		}
+		log->log(client->getLogEntry(), client->getRemoteAddress(), status, bytes, duration,
+		         server_config.access_log_format == "json");
+	}
+	client->getLogEntry().active = false;
+	if (client->getQueuedAt() == 0) {
+		client->setQueuedAt(now);
+	}
+}
+
+// For connections io_uring accepted, which come without the address
+void Server::_lookupRemoteAddress(Client* client) {
+	struct sockaddr_in address;
+	socklen_t length = sizeof(address);
+	char text[INET_ADDRSTRLEN];
+	if (getpeername(client->getFd(), (struct sockaddr*)&address, &length) == 0 &&
+	    inet_ntop(AF_INET, &address.sin_addr, text, sizeof(text))) {
+		client->setRemoteAddress(text);
+	}
+}
+
+// The client's output queue just emptied
+void Server::_recordDrained(Client* client) {
+	if (client->getQueuedAt() != 0) {
+		_metrics.recordSend(Utils::monotonicUsec() - client->getQueuedAt());
+		client->setQueuedAt(0);
+	}
+}
+
+//
+/* Access log */
+//
+
+// Copied now because a CGI response is queued after the Request is gone.
+// The entry's strings keep their capacity, so this rarely allocates.
+void Server::_captureLogEntry(AccessLogEntry& entry, const Request& request) {
+	entry.active = true;
+	entry.method = request.getMethod();
+	entry.uri = request.getUri();
+	entry.version = request.getVersion();
+
+	const RequestHeader* referer = request.findHeader("referer");
+	if (referer) {
+		entry.referer.assign(referer->value, referer->value_length);
+	} else {
+		entry.referer.clear();
+	}
+	const RequestHeader* user_agent = request.findHeader("user-agent");
+	if (user_agent) {
+		entry.user_agent.assign(user_agent->value, user_agent->value_length);
+	} else {
+		entry.user_agent.clear();
+	}
+}
+
+// Opened on first use, after the workers are forked. A file that can't
+// be opened is reported once and retried on the next SIGUSR1.
+AccessLog* Server::_getAccessLog(const ServerConfig& server_config) {
+	if (server_config.access_log == "off") {
+		return NULL;
+	}
+	std::map<std::string, AccessLog*>::iterator it = _access_logs.find(server_config.access_log);
+	if (it != _access_logs.end()) {
+		return it->second;
+	}
+
+	AccessLog* log = NULL;
+	try {
+		log = new AccessLog(server_config.access_log == "stdout" ? "" : server_config.access_log);
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+	}
+	_access_logs[server_config.access_log] = log;
+	return log;
+}
+
+// SIGUSR1, after the files were moved away by log rotation
+void Server::_reopenAccessLogs() {
+	std::map<std::string, AccessLog*>::iterator it = _access_logs.begin();
+	while (it != _access_logs.end()) {
+		if (!it->second) {
+			_access_logs.erase(it++);
+			continue;
+		}
+		it->second->reopen();
+		++it;
+	}
+}
+
+//
+/* CGI handling */
+//
+
+// Scripts are matched by extension and obey the location's method list.
+// A fastcgi_pass location sends every request to its responder.
+bool Server::_isCgiRequest(const Request& request, const LocationConfig* location,
+                           std::string& interpreter) {
+	if (!location || (location->cgi_extensions.empty() && location->fastcgi_pass.empty()) ||
+	    request.getPath().find("..") != std::string::npos) {
+		return false;
+	}
+
+	if (!(location->allowed_methods & request.getMethodBit())) {
+		return false;
+	}
+	if (!location->fastcgi_pass.empty()) {
+		return true;
+	}
+
+	const std::string& path = request.getPath();
+	size_t dot_pos = path.find_last_of('.');
+	size_t slash_pos = path.find_last_of('/');
+	if (dot_pos == std::string::npos || (slash_pos != std::string::npos && dot_pos < slash_pos)) {
+		return false;
+	}
+
+	std::map<std::string, std::string>::const_iterator it =
+		location->cgi_extensions.find(path.substr(dot_pos));
+	if (it == location->cgi_extensions.end()) {
+		return false;
+	}
+	interpreter = it->second;
+	return true;
+}
+
+// Starts the script and registers its pipes, or queues the request on the
+// FastCGI pool. The response is produced later by _forwardCgiOutput.
+void Server::_handleCgiRequest(int client_fd, Request& request, const LocationConfig& location,
+                               const std::string& interpreter) {
+	Client* client = _clients[client_fd];
+	client->incrementRequestsServed();
+	if (!_keepAlive(client, request)) {
+		client->setCloseAfterWrite(true);
+	}
+
+	// A FastCGI responder decides for itself what a missing script means
+	std::string script_path = location.root + request.getPath();
+	if (location.fastcgi_pass.empty() && !_fileExists(script_path)) {
+		Response response(404);
+		response.setBody("<html><body><h1>404 Not Found</h1></body></html>");
+		response.setHeader("Content-Type", "text/html");
+		_setConnectionHeaders(client, response);
+		_sendResponse(client_fd, response);
+		return;
+	}
+
+	CgiHandler* cgi = new CgiHandler(interpreter, script_path, request, &location,
+	                                 *client->getServer(), client_fd);
+	_metrics.countCgi(cgi->isFastCgi());
+	if (cgi->isFastCgi()) {
+		client->setCgi(cgi);
+		_setReadInterest(client, false); // Pipelined requests stay in the socket until it is done
+		_scheduleTimeout(client); // cgi_timeout from here on
+		FastCgiPool* pool = _getFastCgiPool(location);
+		pool->enqueue(cgi);
+		_dispatchFastCgi(pool);
+		return;
+	}
+	if (!cgi->start()) {
+		std::cerr << "Failed to start CGI " << script_path << std::endl;
+		delete cgi;
+		Response response(500);
+		response.setBody("<html><body><h1>500 Internal Server Error</h1></body></html>");
+		response.setHeader("Content-Type", "text/html");
+		_setConnectionHeaders(client, response);
+		_sendResponse(client_fd, response);
+		return;
+	}
+
+	_cgi_processes[cgi->getPid()] = cgi;
+	client->setCgi(cgi);
+	_setReadInterest(client, false); // Pipelined requests stay in the socket until it is done
+	_scheduleTimeout(client); // cgi_timeout from here on
+
+	if (!_loop->add(cgi->getStdoutFd(), EVENT_READ)) {
+		_abortCgi(cgi, 500);
+		return;
+	}
+	_cgi_fds[cgi->getStdoutFd()] = cgi;
+
+	// Feed what fits now, the rest whenever the pipe drains
+	if (cgi->writeInput() == 0 && _loop->add(cgi->getStdinFd(), EVENT_WRITE)) {
+		_cgi_fds[cgi->getStdinFd()] = cgi;
+	} else {
+		cgi->closeInput();
+	}
+}
+
+void Server::_handleCgiEvent(CgiHandler* cgi, int fd) {
+	// Errors and hangups surface from the write() or read() itself
+	if (fd == cgi->getStdinFd()) {
+		if (cgi->writeInput() != 0) {
+			_closeCgiInput(cgi);
+		}
+		return;
+	}
+	_readCgiOutput(cgi);
+}
+
+void Server::_readCgiOutput(CgiHandler* cgi) {
+	// Drain until EAGAIN (edge-triggered backends) or the client falls behind
+	while (!cgi->isOutputPaused()) {
+		std::string data;
+		ssize_t result = cgi->readOutput(data);
+		if (result == -1) {
+			return;
+		}
+		if (result <= 0) {
+			_finishCgiOutput(cgi, result == -2);
+			return;
+		}
+		if (!_forwardCgiOutput(cgi, data)) {
+			return;
+		}
+	}
+}
+
+// HTTP/1.1 responses are streamed, chunked unless the script sent a
+// Content-Length. HTTP/1.0 has no chunking, so output without a length is
+// collected and sent at EOF. Returns false if the CGI was aborted.
+bool Server::_forwardCgiOutput(CgiHandler* cgi, std::string& data) {
+	int client_fd = cgi->getClientFd();
+	Client* client = _clients[client_fd];
+	Response& response = cgi->getResponse();
+	client->updateActivity();
+
+	if (!cgi->areHeadersDone()) {
+		int parsed = cgi->parseHeaders(data);
+		if (parsed == 0) {
+			return true;
+		}
+		if (parsed < 0) {
+			_abortCgi(cgi, 502);
+			return false;
+		}
+
+		if (!response.hasHeader("Content-Length")) {
+			if (cgi->getProtocol() == "HTTP/1.1") {
+				response.setChunked(true);
+			} else {
+				cgi->setOutputBuffered(true);
+			}
+		}
+		if (!cgi->isOutputBuffered()) {
+			_setConnectionHeaders(client, response);
+			_sendResponse(client_fd, response);
+		}
+	}
+
+	if (data.empty()) {
+		return true;
+	}
+	if (cgi->isOutputBuffered()) {
+		response.appendBody(data);
+		return true;
+	}
+	_sendToClient(client_fd, response.isChunked() ?
+	              Response::encodeChunk(data.data(), data.length()) : data);
+
+	// Resumed by _flushClientBuffer once the client has caught up
+	if (client->getOutput().getSize() > CGI_OUTPUT_HIGH_WATER) {
+		_pauseCgiOutput(cgi);
+	}
+	return true;
+}
+
+void Server::_finishCgiOutput(CgiHandler* cgi, bool failed) {
+	if (failed || !cgi->areHeadersDone()) {
+		_abortCgi(cgi, 502);
+		return;
+	}
+
+	int client_fd = cgi->getClientFd();
+	Client* client = _clients[client_fd];
+	Response& response = cgi->getResponse();
+	_metrics.recordCgi(Utils::monotonicUsec() - cgi->getReceivedAt());
+
+	_closeCgiInput(cgi);
+	_closeCgiOutput(cgi);
+	if (cgi->isOutputBuffered()) {
+		_setConnectionHeaders(client, response);
+		_sendResponse(client_fd, response);
+	} else if (response.isChunked()) {
+		_sendToClient(client_fd, Response::lastChunk());
+	}
+	cgi->detachClient();
+	client->setCgi(NULL);
+	_releaseCgi(cgi);
+	_resumeReading(client);
+
+	// Pipelined requests waited for this response
+	_processClientRequest(client_fd);
+	if (_clients.find(client_fd) != _clients.end()) {
+		_flushClientBuffer(client_fd);
+	}
+}
+
+// Stops a CGI and ends its response: an error page if nothing was sent
+// yet, otherwise closing the connection marks the body as truncated.
+void Server::_abortCgi(CgiHandler* cgi, int status) {
+	_stopCgi(cgi);
+	_metrics.recordCgi(Utils::monotonicUsec() - cgi->getReceivedAt());
+
+	int client_fd = cgi->getClientFd();
+	cgi->detachClient();
+	if (client_fd != -1) {
+		Client* client = _clients[client_fd];
+		client->setCgi(NULL);
+		client->setCloseAfterWrite(true);
+		if (!cgi->areHeadersDone() || cgi->isOutputBuffered()) {
+			Response response(status);
+			response.setBody("<html><body><h1>" + Utils::intToString(status) + " " +
+			                 response.getStatusMessage() + "</h1></body></html>");
+			response.setHeader("Content-Type", "text/html");
+			response.setHeader("Connection", "close");
+			_sendResponse(client_fd, response);
+		}
+		_flushClientBuffer(client_fd);
+	}
+	_releaseCgi(cgi);
+}
+
+// Kills the process, or drops the request from its FastCGI pool. Closing
+// the connection is how an in-flight FastCGI request is abandoned.
+void Server::_stopCgi(CgiHandler* cgi) {
+	if (cgi->isFastCgi()) {
+		FastCgiPool* pool = _fastcgi_pools[cgi->getFastCgiPass()];
+		if (!pool->cancel(cgi)) {
+			FastCgiConnection* connection = pool->find(cgi);
+			if (connection) {
+				connection->release();
+				_closeFastCgi(pool, connection);
+			}
+		}
+		cgi->markExited();
+	} else {
+		cgi->kill();
+	}
+	_closeCgiInput(cgi);
+	_closeCgiOutput(cgi);
+}
+
+void Server::_pauseCgiOutput(CgiHandler* cgi) {
+	cgi->setOutputPaused(true);
+	if (cgi->isFastCgi()) {
+		FastCgiConnection* connection = _fastcgi_pools[cgi->getFastCgiPass()]->find(cgi);
+		if (connection) {
+			_updateFastCgiInterest(connection);
+		}
+	} else {
+		_loop->remove(cgi->getStdoutFd());
+	}
+}
+
+void Server::_resumeCgiOutput(CgiHandler* cgi) {
+	cgi->setOutputPaused(false);
+	if (cgi->isFastCgi()) {
+		FastCgiPool* pool = _fastcgi_pools[cgi->getFastCgiPass()];
+		FastCgiConnection* connection = pool->find(cgi);
+		if (connection) {
+			_updateFastCgiInterest(connection);
+			_readFastCgi(pool, connection);
+		}
+	} else {
+		_loop->add(cgi->getStdoutFd(), EVENT_READ);
+		_readCgiOutput(cgi);
+	}
+}
+
+void Server::_closeCgiInput(CgiHandler* cgi) {
+	int fd = cgi->getStdinFd();
+	if (fd == -1) {
+		return;
+	}
+	if (_cgi_fds.erase(fd)) {
+		_loop->remove(fd);
+	}
+	cgi->closeInput();
+}
+
+void Server::_closeCgiOutput(CgiHandler* cgi) {
+	int fd = cgi->getStdoutFd();
+	if (fd == -1) {
+		return;
+	}
+	_cgi_fds.erase(fd);
+	if (!cgi->isOutputPaused()) {
+		_loop->remove(fd);
+	}
+	cgi->closeOutput();
+}
+
+// Runs after SIGCHLD. Output may still be buffered in the pipe, so a
+// handler is only released once both the process and its stdout are done.
+void Server::_reapCgiProcesses() {
+	int status;
+	pid_t pid;
+	while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+		std::map<pid_t, CgiHandler*>::iterator it = _cgi_processes.find(pid);
+		if (it == _cgi_processes.end()) {
+			continue;
+		}
+		it->second->markExited();
+		_releaseCgi(it->second);
+	}
+}
+
+void Server::_releaseCgi(CgiHandler* cgi) {
+	if (!cgi->isFinished()) {
+		return;
+	}
+	_cgi_processes.erase(cgi->getPid());
+	delete cgi;
+}
+
+//
+/* FastCGI */
+//
+
+// One pool per socket, sized by the first location that uses it
+FastCgiPool* Server::_getFastCgiPool(const LocationConfig& location) {
+	FastCgiPool*& pool = _fastcgi_pools[location.fastcgi_pass];
+	if (!pool) {
+		pool = new FastCgiPool(location.fastcgi_pass, location.fastcgi_connections);
+	}
+	return pool;
+}
+
+// Hands waiting requests to idle connections, opening new ones up to the
+// pool limit. Requests left over wait for a running one to finish.
+void Server::_dispatchFastCgi(FastCgiPool* pool) {
+	while (pool->hasPending()) {
+		bool created;
+		FastCgiConnection* connection = pool->acquire(created);
+		if (!connection) {
 			break;
 		}
+		if (created) {
+			if (!_loop->add(connection->getFd(), EVENT_READ | EVENT_WRITE)) {
+				pool->remove(connection);
+				break;
+			}
+			_fastcgi_fds[connection->getFd()] = pool;
+		}
+
+		connection->begin(pool->dequeue());
+		if (connection->isConnecting()) {
+			_updateFastCgiInterest(connection);
+		} else {
+			_flushFastCgi(pool, connection);
+		}
+	}
+
+	// Without a single connection nothing will ever serve them
+	if (pool->hasPending() && pool->getConnectionCount() == 0) {
+		std::cerr << "FastCGI: cannot connect to " << pool->getPath() << std::endl;
+		while (pool->hasPending()) {
+			CgiHandler* cgi = pool->dequeue();
+			cgi->markExited();
+			_abortCgi(cgi, 502);
+		}
+	}
+}
+
+void Server::_handleFastCgiEvent(FastCgiPool* pool, int fd, int ready) {
+	FastCgiConnection* connection = pool->getConnection(fd);
+	if (!connection) {
+		return;
+	}
+
+	if ((ready & (EVENT_WRITE | EVENT_ERROR)) && connection->hasPendingOutput()) {
+		int result = connection->flush();
+		if (result < 0) {
+			_failFastCgi(pool, connection);
+			return;
+		}
+		_updateFastCgiInterest(connection);
+	}
+	if (ready & (EVENT_READ | EVENT_ERROR)) {
+		_readFastCgi(pool, connection);
+	}
+}
+
+void Server::_flushFastCgi(FastCgiPool* pool, FastCgiConnection* connection) {
+	if (connection->flush() < 0) {
+		_failFastCgi(pool, connection);
+		return;
+	}
+	_updateFastCgiInterest(connection);
+}
+
+void Server::_readFastCgi(FastCgiPool* pool, FastCgiConnection* connection) {
+	while (true) {
+		CgiHandler* cgi = connection->getRequest();
+		if (cgi && cgi->isOutputPaused()) {
+			return;
+		}
+
+		std::string data;
+		int result = connection->receive(data);
+		if (result == -1) {
+			return;
+		}
+		if (result == -2) {
+			// Idle connections closed by the responder are simply dropped
+			_failFastCgi(pool, connection);
+			return;
+		}
+		if (!cgi) {
+			continue;
+		}
+		if (!data.empty() && !_forwardCgiOutput(cgi, data)) {
+			_dispatchFastCgi(pool);
+			return;
+		}
+
+		if (result == 1) {
+			// The connection stays open for the next request
+			connection->release();
+			_updateFastCgiInterest(connection);
+			cgi->markExited();
+			_finishCgiOutput(cgi, false);
+			_dispatchFastCgi(pool);
+			return;
+		}
+	}
+}
+
+void Server::_updateFastCgiInterest(FastCgiConnection* connection) {
+	CgiHandler* cgi = connection->getRequest();
+	int events = (cgi && cgi->isOutputPaused()) ? 0 : EVENT_READ;
+	if (connection->hasPendingOutput()) {
+		events |= EVENT_WRITE;
+	}
+	_loop->modify(connection->getFd(), events);
+}
+
+// The connection is unusable: its request (if any) gets a 502 and
+// waiting requests are redispatched, reconnecting if needed.
+void Server::_failFastCgi(FastCgiPool* pool, FastCgiConnection* connection) {
+	CgiHandler* cgi = connection->release();
+	_closeFastCgi(pool, connection);
+	if (cgi) {
+		cgi->markExited();
+		_abortCgi(cgi, 502);
+	}
+	_dispatchFastCgi(pool);
+}
+
+void Server::_closeFastCgi(FastCgiPool* pool, FastCgiConnection* connection) {
+	_loop->remove(connection->getFd());
+	_fastcgi_fds.erase(connection->getFd());
+	pool->remove(connection);
+}
+
+//
+/* Output handling */
+//
+
+void Server::_sendToClient(int client_fd, const std::string& data) {
+	std::map<int, Client*>::iterator it = _clients.find(client_fd);
+	if (it == _clients.end()) {
+		return;
+	}
+	bool was_empty = it->second->getOutput().empty();
+	it->second->getOutput().append(data);
+	_startOutput(it->second, was_empty);
+}
+
+// Queues the head and then the body: in memory (moved out of the response,
+// so writev() sends it from its own segment), the cached blob itself, or
+// the file ranges to sendfile() (file_fd is owned by the queue from here).
+void Server::_sendResponse(int client_fd, Response& response, int file_fd) {
+	std::map<int, Client*>::iterator it = _clients.find(client_fd);
+	if (it == _clients.end()) {
+		if (file_fd != -1) {
+			close(file_fd);
+		}
+		return;
+	}
+	Client* client = it->second;
+	OutputQueue& output = client->getOutput();
+	bool was_empty = output.empty();
+
+	_head.clear();
+	response.writeHead(_head);
+	output.append(_head);
+	off_t head_end = output.getSize();
+
+	const std::vector<FileRange>& ranges = response.getFileRanges();
+	if (file_fd != -1 && ranges.empty()) {
+		close(file_fd);
+	} else if (file_fd != -1 && !response.getFileEncoding().empty()) {
+		output.appendDeflate(file_fd, ranges[0].offset, ranges[0].length,
+		                     new Deflater(response.getFileEncoding(), response.getFileLevel()));
+	} else if (file_fd != -1) {
+		for (size_t i = 0; i < ranges.size(); ++i) {
+			output.append(ranges[i].prefix);
+			output.appendFile(file_fd, ranges[i].offset, ranges[i].length, i + 1 == ranges.size());
+		}
+		output.append(response.getFileTrailer());
+	} else if (response.hasListingBody()) {
+		output.appendListing(new DirectoryListing(response.getListing()));
+	} else if (response.isChunked()) {
+		output.append(Response::encodeChunk(response.getBody().data(), response.getBody().length()));
+	} else if (response.hasSharedBody()) {
+		output.appendShared(response.getSharedBody());
+	} else {
+		std::string body;
+		response.swapBody(body);
+		output.appendOwned(body);
+	}
+	_countResponse(client, response.getStatusCode(), output.getSize() - head_end);
+	_startOutput(client, was_empty);
+}
+
+// Output that is first in line goes out right away; the rest, and any
+// pending close, is left to the write handler. Reading stops while the
+// queue is over the high-water mark, and for good once the connection
+// is to be closed.
+void Server::_startOutput(Client* client, bool was_empty) {
+	OutputQueue& output = client->getOutput();
+	if (was_empty) {
+		_writeOutput(client); // Errors resurface in _flushClientBuffer
+	}
+	if (output.empty()) {
+		_recordDrained(client);
+	}
+	if ((!output.empty() || client->shouldClose()) && !output.isSending()) {
+		_setWriteInterest(client, true);
+	}
+	if (output.getSize() > OUTPUT_HIGH_WATER || client->shouldClose()) {
+		_setReadInterest(client, false);
+	}
+	_scheduleTimeout(client);
+}
+
+void Server::_flushClientBuffer(int client_fd) {
+	Client* client = _clients[client_fd];
+	OutputQueue& output = client->getOutput();
+
+	while (true) {
+		off_t queued = output.getSize();
+		int result = _writeOutput(client);
+		if (result < 0) {
+			_removeClient(client_fd);
+			return;
+		}
+		if (output.getSize() != queued) {
+			client->updateActivity(); // send_timeout runs between writes
+		}
+		if (output.getSize() > OUTPUT_LOW_WATER) {
+			_setWriteInterest(client, !output.isSending());
+			_scheduleTimeout(client);
+			return; // Would block, resume on the next write event or send completion
+		}
+
+		// Caught up: read again and answer pipelined requests held back
+		_setReadInterest(client, true);
+		if (!client->getBuffer().empty()) {
+			_processClientRequest(client_fd);
+			if (_clients.find(client_fd) == _clients.end()) {
+				return;
+			}
+		}
+		if (result == 0 || !output.empty()) {
+			if (result == 0) {
+				_setWriteInterest(client, !output.isSending());
+				_scheduleTimeout(client);
+				return;
+			}
+			continue; // New responses were queued
+		}
+		break;
+	}
+	_recordDrained(client);
+
+	// The CGI still owes output, resume reading it now the client caught up
+	if (client->getCgi()) {
+		CgiHandler* cgi = client->getCgi();
+		_setWriteInterest(client, false);
+		if (cgi->isOutputPaused()) {
+			_resumeCgiOutput(cgi);
+		}
+		_scheduleTimeout(client);
+		return;
+	}
+
+	// Everything is sent, close or stop watching for writability
+	if (client->shouldClose()) {
+		_removeClient(client_fd);
+		return;
+	}
+	_setWriteInterest(client, false);
+	_scheduleTimeout(client);
+}
+
+// Writes what the socket takes now, as OutputQueue::flush() does. With
+// io_uring the memory at the front is handed to the kernel instead, sent
+// with the next wait() and reported by EVENT_SENT; until then this
+// returns 0, as if the socket would block. Files still go out here.
+int Server::_writeOutput(Client* client) {
+	OutputQueue& output = client->getOutput();
+	if (output.isSending()) {
+		return 0;
+	}
+	if (_loop->hasCompletions()) {
+		struct iovec parts[OUTPUT_IOV_MAX];
+		int count = output.gather(parts);
+		if (count < 0) {
+			return -1;
+		}
+		if (count > 0 && _loop->send(client->getFd(), parts, count)) {
+			return 0;
+		}
+		output.sent(0);
+	}
+	return output.flush(client->getFd());
+}
+
+// A send handed to the kernel by _writeOutput is done
+void Server::_finishSend(int client_fd, int result) {
+	if (result < 0) {
+		_removeClient(client_fd);
+		return;
 	}
+	Client* client = _clients[client_fd];
+	client->getOutput().sent(result);
+	_flushClientBuffer(client_fd);
+}
+
+void Server::_setWriteInterest(Client* client, bool enabled) {
+	if (client->isWriteArmed() == enabled) {
+		return;
+	}
+	client->setWriteArmed(enabled);
+	_updateClientEvents(client);
+}
+
+void Server::_setReadInterest(Client* client, bool enabled) {
+	// Nothing is parsed while a CGI or a disk job owns the connection,
+	// _resumeReading turns reads back on once it is done. Nothing more
+	// is read at all from a connection that is to be closed.
+	if (enabled && (client->shouldClose() || client->getCgi() || client->getDiskJob())) {
+		return;
+	}
+	if (client->isReadPaused() == !enabled) {
+		return;
+	}
+	client->setReadPaused(!enabled);
+	_updateClientEvents(client);
+}
+
+// After a CGI or disk job: read again, unless the output queue is what paused reading
+void Server::_resumeReading(Client* client) {
+	if (client->getOutput().getSize() <= OUTPUT_HIGH_WATER) {
+		_setReadInterest(client, true);
+	}
+}
+
+void Server::_updateClientEvents(Client* client) {
+	int events = client->isReadPaused() ? 0 : EVENT_READ;
+	if (client->isWriteArmed()) {
+		events |= EVENT_WRITE;
+	}
+	_loop->modify(client->getFd(), events);
+}
+
+//
+/* Client management */
+//
+
+void Server::_removeClient(int client_fd) {
+	// Unregister from the event loop
+	_loop->remove(client_fd);
 
 	// Delete client and remove from map
 	if (_clients.find(client_fd) != _clients.end()) {
-		delete _clients[client_fd];
+		// Nobody is left to read the CGI's output
+		CgiHandler* cgi = _clients[client_fd]->getCgi();
+		if (cgi) {
+			cgi->detachClient();
+			_stopCgi(cgi);
+			FastCgiPool* pool = cgi->isFastCgi() ? _fastcgi_pools[cgi->getFastCgiPass()] : NULL;
+			_releaseCgi(cgi);
+			if (pool) {
+				_dispatchFastCgi(pool); // A connection may have been freed
+			}
+		}
+		_timers->cancel(_clients[client_fd]->getTimer());
+		_metrics.addBytesOut(_clients[client_fd]->getOutput().getSent());
+		_releaseSnapshot(_clients[client_fd]->getSnapshot());
+		_client_pool->release(_clients[client_fd]);
 		_clients.erase(client_fd);
 	}
 
-	// Remove output buffer
-	_output_buffers.erase(client_fd);
-
 	close(client_fd);
 }
 
+// Only clients whose deadline came up are looked at. The phase may have
+// changed since the timer was set, so the deadline is checked again.
 void Server::_cleanupTimedOutClients() {
-	const time_t timeout = 60; // 60 seconds timeout
 	time_t now = time(NULL);
+	std::vector<int> expired;
+	_timers->expire(now, expired);
 
-	std::vector<int> clients_to_remove;
+	for (size_t i = 0; i < expired.size(); ++i) {
+		std::map<int, Client*>::iterator it = _clients.find(expired[i]);
+		if (it == _clients.end()) {
+			continue;
+		}
+		if (it->second->getCgi()) {
+			_expireCgi(it->second, now);
+			continue;
+		}
+		int timeout = _getTimeout(it->second);
+		if (timeout < 0 || now - it->second->getLastActivity() <= timeout) {
+			_scheduleTimeout(it->second);
+			continue;
+		}
+		_metrics.countTimeout(false);
+		_removeClient(expired[i]);
+	}
+}
 
-	for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end(); ++it) {
-		if (now - it->second->getLastActivity() > timeout) {
-			clients_to_remove.push_back(it->first);
+// Answers 504 for a CGI past its site's cgi_timeout, counted from when it
+// started. Aborting a FastCGI request may free a pool connection.
+void Server::_expireCgi(Client* client, time_t now) {
+	CgiHandler* cgi = client->getCgi();
+	time_t timeout = client->getServer()->cgi_timeout;
+	if (timeout <= 0 || now - cgi->getStartedAt() <= timeout) {
+		_scheduleTimeout(client);
+		return;
+	}
+	_metrics.countTimeout(true);
+	FastCgiPool* pool = cgi->isFastCgi() ? _fastcgi_pools[cgi->getFastCgiPass()] : NULL;
+	_abortCgi(cgi, 504);
+	if (pool) {
+		_dispatchFastCgi(pool);
+	}
+}
+
+// Arms the timer for the client's current phase, counted from its last
+// read or write. A client waiting on a CGI has the CGI's deadline instead.
+void Server::_scheduleTimeout(Client* client) {
+	CgiHandler* cgi = client->getCgi();
+	if (cgi) {
+		time_t timeout = client->getServer()->cgi_timeout;
+		if (timeout > 0) {
+			_timers->schedule(client->getTimer(), cgi->getStartedAt() + timeout + 1);
+		} else {
+			_timers->cancel(client->getTimer());
 		}
+		return;
 	}
+	int timeout = _getTimeout(client);
+	if (timeout < 0) {
+		_timers->cancel(client->getTimer());
+		return;
+	}
+	// time() truncates, the extra second makes sure a full timeout passes
+	_timers->schedule(client->getTimer(), client->getLastActivity() + timeout + 1);
+}
 
-	for (size_t i = 0; i < clients_to_remove.size(); ++i) {
-		std::cout << "Client timeout: fd=" << clients_to_remove[i] << std::endl;
-		_removeClient(clients_to_remove[i]);
+int Server::_getTimeout(Client* client) {
+	const ServerConfig& config = *client->getServer();
+	if (client->getCgi()) {
+		return -1; // Bounded by cgi_timeout instead, see _scheduleTimeout
+	}
+	if (!client->getOutput().empty() || client->getDiskJob()) {
+		return config.send_timeout;
+	}
+	if (client->getParser().areHeadersComplete() || client->isSpoolingBody()) {
+		return config.client_body_timeout;
 	}
+	if (!client->getBuffer().empty()) {
+		return config.client_header_timeout;
+	}
+	return config.keepalive_timeout;
 }
 
 //
 /* Helper methods */
 //
 
-std::string Server::_readFile(const std::string& path) {
-	std::ifstream file(path.c_str(), std::ios::binary);
-	if (!file.is_open()) {
-		return "";
-	}
-
-	std::ostringstream contents;
-	contents << file.rdbuf();
-	return contents.str();
+// Between requests: nothing buffered in either direction
+bool Server::_isIdle(Client* client) {
+	return client->getBuffer().empty() && client->getOutput().empty() && !client->getCgi() &&
+	       !client->getDiskJob();
 }
 
 std::string Server::_getContentType(const std::string& path) {
@@ -488,14 +2501,14 @@ std::string Server::_getContentType(const std::string& path) {
 	return "application/octet-stream";
 }
 
+// Text formats shrink well, images and archives are already compressed
+bool Server::_isCompressible(const std::string& content_type) {
+	return content_type.compare(0, 5, "text/") == 0 || content_type == "application/javascript" ||
+	       content_type == "application/json" || content_type == "application/xml" ||
+	       content_type == "image/svg+xml";
+}
+
 bool Server::_fileExists(const std::string& path) {
 	struct stat buffer;
 	return (stat(path.c_str(), &buffer) == 0 && S_ISREG(buffer.st_mode));
 }
-
-void Server::_handleCgiRequest(int client_fd, const Request& request) {
-	// TODO: Implement CGI handling
-	(void)client_fd;
-	(void)request;
-}
-
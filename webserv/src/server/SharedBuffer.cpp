@@ -0,0 +1,50 @@
+#include "SharedBuffer.hpp"
+
+SharedBuffer::SharedBuffer() : _block(NULL) {}
+
+SharedBuffer::SharedBuffer(std::string& data) : _block(new Block()) {
+	_block->data.swap(data);
+	_block->references = 1;
+}
+
+SharedBuffer::SharedBuffer(const SharedBuffer& other) : _block(other._block) {
+	if (_block) {
+		_block->references++;
+	}
+}
+
+SharedBuffer& SharedBuffer::operator=(const SharedBuffer& other) {
+	if (_block != other._block) {
+		_release();
+		_block = other._block;
+		if (_block) {
+			_block->references++;
+		}
+	}
+	return *this;
+}
+
+SharedBuffer::~SharedBuffer() {
+	_release();
+}
+
+// Getters
+bool SharedBuffer::isNull() const {
+	return _block == NULL;
+}
+
+const std::string& SharedBuffer::getData() const {
+	static const std::string empty;
+	return _block ? _block->data : empty;
+}
+
+size_t SharedBuffer::getLength() const {
+	return _block ? _block->data.length() : 0;
+}
+
+void SharedBuffer::_release() {
+	if (_block && --_block->references == 0) {
+		delete _block;
+	}
+	_block = NULL;
+}
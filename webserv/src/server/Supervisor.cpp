@@ -0,0 +1,183 @@
+#include "Supervisor.hpp"
+#include "Server.hpp"
+
+#include <iostream>
+#include <csignal>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define RESPAWN_BACKOFF 1 // Seconds, avoids fork storms on startup failures
+
+static volatile sig_atomic_t g_child_exited = 0;
+static volatile sig_atomic_t g_reload_requested = 0;
+static volatile sig_atomic_t g_reopen_requested = 0;
+static volatile sig_atomic_t g_stop_requested = 0; // Signal to forward to the workers
+
+static void _onSignal(int sig) {
+	if (sig == SIGCHLD) g_child_exited = 1;
+	else if (sig == SIGHUP) g_reload_requested = 1;
+	else if (sig == SIGUSR1) g_reopen_requested = 1;
+	else g_stop_requested = (sig == SIGQUIT) ? SIGQUIT : SIGTERM;
+}
+
+Supervisor::Supervisor(const std::string& config_file, int worker_count)
+	: _config_file(config_file), _worker_count(worker_count),
+	  _workers(worker_count, -1), _started_at(worker_count, 0) {}
+
+Supervisor::~Supervisor() {}
+
+int Supervisor::run() {
+	_installSignalHandlers();
+
+	// Block our signals outside of sigsuspend() so none are lost
+	sigset_t blocked, previous;
+	sigemptyset(&blocked);
+	sigaddset(&blocked, SIGCHLD);
+	sigaddset(&blocked, SIGHUP);
+	sigaddset(&blocked, SIGUSR1);
+	sigaddset(&blocked, SIGTERM);
+	sigaddset(&blocked, SIGINT);
+	sigaddset(&blocked, SIGQUIT);
+	sigprocmask(SIG_BLOCK, &blocked, &previous);
+
+	for (size_t i = 0; i < _workers.size(); ++i) {
+		_spawnWorker(i);
+	}
+	std::cout << "Supervisor started " << _worker_count << " workers" << std::endl;
+
+	while (!g_stop_requested) {
+		sigsuspend(&previous);
+
+		if (g_child_exited) {
+			g_child_exited = 0;
+			_reapWorkers(true);
+		}
+		if (g_reload_requested) {
+			g_reload_requested = 0;
+			std::cout << "Supervisor: forwarding SIGHUP to workers" << std::endl;
+			_broadcast(SIGHUP);
+		}
+		if (g_reopen_requested) {
+			g_reopen_requested = 0;
+			_broadcast(SIGUSR1);
+		}
+	}
+
+	// SIGQUIT lets workers finish their connections first
+	std::cout << "Supervisor: stopping workers" << std::endl;
+	_broadcast(g_stop_requested);
+	while (_hasLiveWorkers()) {
+		_reapWorkers(false);
+		if (_hasLiveWorkers())
+			sigsuspend(&previous);
+	}
+
+	sigprocmask(SIG_SETMASK, &previous, NULL);
+	return 0;
+}
+
+void Supervisor::_installSignalHandlers() {
+	struct sigaction sa;
+	std::memset(&sa, 0, sizeof(sa));
+	sigemptyset(&sa.sa_mask);
+	sa.sa_handler = _onSignal;
+	sigaction(SIGCHLD, &sa, NULL);
+	sigaction(SIGHUP, &sa, NULL);
+	sigaction(SIGUSR1, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGQUIT, &sa, NULL);
+}
+
+void Supervisor::_spawnWorker(size_t slot) {
+	// Back off if this slot keeps dying right after startup
+	if (_started_at[slot] != 0 && time(NULL) - _started_at[slot] < RESPAWN_BACKOFF) {
+		sleep(RESPAWN_BACKOFF);
+	}
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		std::cerr << "Supervisor: fork failed: " << std::strerror(errno) << std::endl;
+		return;
+	}
+
+	if (pid == 0) {
+		// Worker: restore default dispositions and an empty mask
+		struct sigaction sa;
+		std::memset(&sa, 0, sizeof(sa));
+		sigemptyset(&sa.sa_mask);
+		sa.sa_handler = SIG_DFL;
+		sigaction(SIGCHLD, &sa, NULL);
+		sigaction(SIGTERM, &sa, NULL);
+		sigaction(SIGINT, &sa, NULL);
+		sigaction(SIGQUIT, &sa, NULL);
+
+		// Until the Server installs its own handlers, a reload or log
+		// reopen must not kill us
+		sa.sa_handler = SIG_IGN;
+		sigaction(SIGHUP, &sa, NULL);
+		sigaction(SIGUSR1, &sa, NULL);
+
+		sigset_t empty;
+		sigemptyset(&empty);
+		sigprocmask(SIG_SETMASK, &empty, NULL);
+
+		int status = 0;
+		try {
+			Server server(_config_file);
+			server.run();
+		} catch (const std::exception& e) {
+			std::cerr << "Worker " << getpid() << " error: " << e.what() << std::endl;
+			status = 1;
+		}
+		std::exit(status);
+	}
+
+	_workers[slot] = pid;
+	_started_at[slot] = time(NULL);
+}
+
+void Supervisor::_reapWorkers(bool respawn) {
+	int status;
+	pid_t pid;
+
+	while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+		for (size_t i = 0; i < _workers.size(); ++i) {
+			if (_workers[i] != pid) {
+				continue;
+			}
+			_workers[i] = -1;
+
+			if (WIFSIGNALED(status)) {
+				std::cerr << "Worker " << pid << " killed by signal " << WTERMSIG(status) << std::endl;
+			} else {
+				std::cout << "Worker " << pid << " exited with status " << WEXITSTATUS(status) << std::endl;
+			}
+
+			if (respawn && !g_stop_requested) {
+				_spawnWorker(i);
+			}
+			break;
+		}
+	}
+}
+
+void Supervisor::_broadcast(int sig) {
+	for (size_t i = 0; i < _workers.size(); ++i) {
+		if (_workers[i] > 0) {
+			kill(_workers[i], sig);
+		}
+	}
+}
+
+bool Supervisor::_hasLiveWorkers() const {
+	for (size_t i = 0; i < _workers.size(); ++i) {
+		if (_workers[i] > 0) {
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,67 @@
+#include "TimerWheel.hpp"
+
+TimerWheel::TimerWheel() : _slots(TIMER_WHEEL_SLOTS), _current(time(NULL)) {
+	for (size_t i = 0; i < _slots.size(); ++i) {
+		_slots[i].prev = &_slots[i];
+		_slots[i].next = &_slots[i];
+	}
+}
+
+// Nodes belong to their owners, which may already be gone
+TimerWheel::~TimerWheel() {}
+
+void TimerWheel::schedule(TimerNode* node, time_t deadline) {
+	if (node->isScheduled()) {
+		if (node->deadline == deadline) {
+			return; // Same slot, common when activity repeats within a second
+		}
+		_unlink(node);
+	}
+
+	// Already due: the next expire() picks it up
+	time_t slot_time = deadline > _current ? deadline : _current + 1;
+	TimerNode* head = &_slots[static_cast<size_t>(slot_time) % _slots.size()];
+
+	node->deadline = deadline;
+	node->prev = head->prev;
+	node->next = head;
+	head->prev->next = node;
+	head->prev = node;
+}
+
+void TimerWheel::cancel(TimerNode* node) {
+	if (node->isScheduled()) {
+		_unlink(node);
+	}
+}
+
+void TimerWheel::expire(time_t now, std::vector<int>& expired) {
+	if (now <= _current) {
+		return;
+	}
+
+	// After a long stall every slot is due at most once
+	time_t elapsed = now - _current;
+	size_t steps = elapsed < static_cast<time_t>(_slots.size()) ? static_cast<size_t>(elapsed)
+	                                                            : _slots.size();
+	for (size_t i = 1; i <= steps; ++i) {
+		TimerNode* head = &_slots[static_cast<size_t>(_current + i) % _slots.size()];
+		TimerNode* node = head->next;
+		while (node != head) {
+			TimerNode* next = node->next;
+			if (node->deadline <= now) { // Later ones are a full turn away
+				_unlink(node);
+				expired.push_back(node->id);
+			}
+			node = next;
+		}
+	}
+	_current = now;
+}
+
+void TimerWheel::_unlink(TimerNode* node) {
+	node->prev->next = node->next;
+	node->next->prev = node->prev;
+	node->prev = NULL;
+	node->next = NULL;
+}
@@ -0,0 +1,614 @@
+#include "UringEventLoop.hpp"
+
+#ifdef __linux__
+
+#include <sys/mman.h>
+#include <sys/poll.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#define URING_SQ_ENTRIES 256  // Submissions batched before a forced flush
+#define URING_CQ_ENTRIES 4096 // Room for a burst of wakeups between waits
+#define URING_BUFFER_GROUP 0
+
+UringEventLoop::UringEventLoop() : _ring_fd(-1), _multishot(true), _completions(true),
+                                   _sq_ring(NULL), _sq_ring_size(0), _sq_head(NULL), _sq_tail(NULL),
+                                   _sq_mask(0), _sq_array(NULL), _sqes(NULL), _sqes_size(0),
+                                   _sq_pending(0), _cq_ring(NULL), _cq_ring_size(0), _cq_head(NULL),
+                                   _cq_tail(NULL), _cq_mask(0), _cqes(NULL), _buffer_ring(NULL),
+                                   _buffers(NULL), _buffer_tail(0), _batch(NULL), _sequence(0) {
+	// Only this thread submits. Kernels that know the flag (6.0+) also
+	// have multishot accept and recv, older ones get readiness only.
+	struct io_uring_params params;
+	std::memset(&params, 0, sizeof(params));
+	params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER;
+	params.cq_entries = URING_CQ_ENTRIES;
+	_ring_fd = syscall(__NR_io_uring_setup, URING_SQ_ENTRIES, &params);
+	if (_ring_fd < 0 && errno == EINVAL) {
+		_completions = false;
+		std::memset(&params, 0, sizeof(params));
+		params.flags = IORING_SETUP_CQSIZE;
+		params.cq_entries = URING_CQ_ENTRIES;
+		_ring_fd = syscall(__NR_io_uring_setup, URING_SQ_ENTRIES, &params);
+	}
+	if (_ring_fd < 0) {
+		throw std::runtime_error("io_uring is not available");
+	}
+	if (!(params.features & IORING_FEAT_EXT_ARG)) {
+		close(_ring_fd);
+		throw std::runtime_error("io_uring lacks wait timeouts (Linux 5.11+)");
+	}
+
+	// Both rings in one mapping when the kernel supports it (5.4+)
+	_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+	if (single_mmap && _cq_ring_size > _sq_ring_size) {
+		_sq_ring_size = _cq_ring_size;
+	}
+	_sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+	void* sq_ring = mmap(NULL, _sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+	                     _ring_fd, IORING_OFF_SQ_RING);
+	_sq_ring = sq_ring == MAP_FAILED ? NULL : sq_ring;
+	void* cq_ring = single_mmap ? _sq_ring :
+		mmap(NULL, _cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		     _ring_fd, IORING_OFF_CQ_RING);
+	_cq_ring = cq_ring == MAP_FAILED ? NULL : cq_ring;
+	void* sqes = mmap(NULL, _sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+	                  _ring_fd, IORING_OFF_SQES);
+	_sqes = sqes == MAP_FAILED ? NULL : static_cast<struct io_uring_sqe*>(sqes);
+	if (!_sq_ring || !_cq_ring || !_sqes) {
+		_unmap();
+		close(_ring_fd);
+		throw std::runtime_error("Failed to map io_uring queues");
+	}
+
+	char* sq = static_cast<char*>(_sq_ring);
+	_sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+	_sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+	_sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+	_sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+	char* cq = static_cast<char*>(_cq_ring);
+	_cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+	_cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+	_cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+	_cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+	if (_completions && !_setupBuffers()) {
+		_completions = false;
+	}
+}
+
+UringEventLoop::~UringEventLoop() {
+	for (size_t i = 0; i < _registrations.size(); ++i) {
+		delete _registrations[i].send;
+	}
+	_unmap();
+	close(_ring_fd);
+}
+
+bool UringEventLoop::add(int fd, int events) {
+	return _register(fd, events);
+}
+
+bool UringEventLoop::modify(int fd, int events) {
+	if (!_isRegistered(fd)) {
+		return false;
+	}
+	_registrations[fd].events = events;
+	_markDirty(fd);
+	return true;
+}
+
+// Submitted right away: an armed request keeps the file open, and callers
+// close the fd next, expecting the peer to see it closed. A send still in
+// flight is cancelled before this returns, so its bytes can be freed.
+void UringEventLoop::remove(int fd) {
+	if (!_isRegistered(fd)) {
+		return;
+	}
+	Registration& registration = _registrations[fd];
+	registration.registered = false;
+	bool cancelled = false;
+	if (registration.user_data != 0) {
+		if (registration.acceptor) {
+			_cancelRequest(registration.user_data);
+		} else {
+			_cancel(registration.user_data);
+		}
+		cancelled = true;
+	}
+	if (registration.receive_data != 0 && !registration.receive_cancelled) {
+		_cancelRequest(registration.receive_data);
+		cancelled = true;
+	}
+	if (registration.send_data != 0) {
+		_cancelRequest(registration.send_data);
+		cancelled = true;
+	}
+	registration.user_data = 0;
+	registration.receive_data = 0;
+	registration.send_data = 0;
+	if (cancelled) {
+		_enter(_sq_pending, 0, 0);
+	}
+
+	// Whatever the last batch still holds for it would reach the next
+	// connection given the same fd number
+	if (_batch && registration.first_event >= 0) {
+		for (size_t i = registration.first_event; i < _batch->size(); ++i) {
+			if ((*_batch)[i].fd == fd) {
+				(*_batch)[i].events = 0;
+			}
+		}
+	}
+	registration.first_event = -1;
+}
+
+int UringEventLoop::wait(std::vector<IoEvent>& events, int timeout_ms) {
+	for (size_t i = 0; i < events.size(); ++i) {
+		if (static_cast<size_t>(events[i].fd) < _registrations.size()) {
+			_registrations[events[i].fd].first_event = -1;
+		}
+	}
+	events.clear();
+	_batch = &events;
+
+	// The last batch's data has been handled, its buffers can be reused
+	if (!_used_buffers.empty()) {
+		for (size_t i = 0; i < _used_buffers.size(); ++i) {
+			_provideBuffer(_used_buffers[i]);
+		}
+		__atomic_store_n(&_buffer_ring->tail, _buffer_tail, __ATOMIC_RELEASE);
+		_used_buffers.clear();
+	}
+
+	for (size_t i = 0; i < _dirty.size(); ++i) {
+		Registration& registration = _registrations[_dirty[i]];
+		registration.dirty = false;
+		if (registration.registered) {
+			_sync(_dirty[i]);
+		}
+	}
+	_dirty.clear();
+
+	bool ready = *_cq_head != __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+	if (_sq_pending > 0 || !ready) {
+		int result = _enter(_sq_pending, ready ? 0 : 1, ready ? 0 : timeout_ms);
+		if (result < 0 && errno != ETIME && errno != EBUSY) {
+			return -1;
+		}
+	}
+
+	unsigned head = *_cq_head;
+	unsigned tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+	for (; head != tail; ++head) {
+		_complete(events, _cqes[head & _cq_mask]);
+	}
+	__atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+
+	for (size_t i = 0; i < events.size(); ++i) {
+		_registrations[events[i].fd].reported = -1;
+	}
+	return events.size();
+}
+
+const char* UringEventLoop::getName() const {
+	return "io_uring";
+}
+
+bool UringEventLoop::hasCompletions() const {
+	return _completions;
+}
+
+bool UringEventLoop::addAcceptor(int listen_fd) {
+	if (!_completions || !_register(listen_fd, EVENT_READ)) {
+		return false;
+	}
+	_registrations[listen_fd].acceptor = true;
+	return true;
+}
+
+bool UringEventLoop::addReceiver(int fd, int events) {
+	if (!_completions || !_register(fd, events)) {
+		return false;
+	}
+	_registrations[fd].receiver = true;
+	return true;
+}
+
+// Queued with the next wait(), which is when the kernel copies the
+// message; MSG_WAITALL has it retry a short send itself
+bool UringEventLoop::send(int fd, const struct iovec* parts, int count) {
+	if (!_completions || !_isRegistered(fd) || _registrations[fd].send_data != 0 || count <= 0) {
+		return false;
+	}
+	Registration& registration = _registrations[fd];
+	if (!registration.send) {
+		registration.send = new SendState();
+	}
+	if (count > URING_SEND_PARTS) {
+		count = URING_SEND_PARTS;
+	}
+	SendState& state = *registration.send;
+	std::memcpy(state.parts, parts, count * sizeof(struct iovec));
+	std::memset(&state.message, 0, sizeof(state.message));
+	state.message.msg_iov = state.parts;
+	state.message.msg_iovlen = count;
+	registration.send_data = _nextUserData(fd, SEND);
+
+	struct io_uring_sqe* sqe = _getSqe();
+	sqe->opcode = IORING_OP_SENDMSG;
+	sqe->fd = fd;
+	sqe->addr = reinterpret_cast<unsigned long long>(&state.message);
+	sqe->len = 1;
+	sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+	sqe->user_data = registration.send_data;
+	return true;
+}
+
+bool UringEventLoop::_register(int fd, int events) {
+	if (fd < 0) {
+		return false;
+	}
+	if (static_cast<size_t>(fd) >= _registrations.size()) {
+		Registration empty;
+		std::memset(&empty, 0, sizeof(empty));
+		empty.reported = -1;
+		empty.first_event = -1;
+		_registrations.resize(fd + 1, empty);
+	}
+	Registration& registration = _registrations[fd];
+	if (registration.registered) {
+		return false; // Like EPOLL_CTL_ADD
+	}
+	registration.registered = true;
+	registration.acceptor = false;
+	registration.receiver = false;
+	registration.events = events;
+	_markDirty(fd);
+	return true;
+}
+
+// Brings the requests armed for fd in line with its interest. The poll
+// is replaced rather than updated in place, so readiness is checked
+// again and an fd that is already ready reports at once. A receiver's
+// recv stays armed across changes; when reading is off it gets a poll
+// anyway, for errors and hangups.
+void UringEventLoop::_sync(int fd) {
+	Registration& registration = _registrations[fd];
+	if (registration.acceptor) {
+		if (registration.user_data == 0) {
+			_armAccept(fd);
+		}
+		return;
+	}
+
+	if (registration.user_data != 0) {
+		_cancel(registration.user_data);
+		registration.user_data = 0;
+	}
+	bool reading = registration.events & EVENT_READ;
+	if (!registration.receiver) {
+		_arm(fd, registration.events);
+		return;
+	}
+	if (registration.events != EVENT_READ) {
+		_arm(fd, registration.events & ~EVENT_READ);
+	}
+	if (reading && registration.receive_data == 0) {
+		_armReceive(fd);
+	} else if (!reading && registration.receive_data != 0 && !registration.receive_cancelled) {
+		_cancelRequest(registration.receive_data);
+		registration.receive_cancelled = true;
+	}
+}
+
+void UringEventLoop::_arm(int fd, int events) {
+	Registration& registration = _registrations[fd];
+	registration.user_data = _nextUserData(fd, POLL);
+
+	struct io_uring_sqe* sqe = _getSqe();
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+	sqe->poll32_events = _toPoll(events); // Little-endian layout
+	sqe->len = _multishot ? IORING_POLL_ADD_MULTI : 0;
+	sqe->user_data = registration.user_data;
+}
+
+// Sockets come out non-blocking and close-on-exec, without the peer's address
+void UringEventLoop::_armAccept(int fd) {
+	Registration& registration = _registrations[fd];
+	registration.user_data = _nextUserData(fd, ACCEPT);
+
+	struct io_uring_sqe* sqe = _getSqe();
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = fd;
+	sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+	sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+	sqe->user_data = registration.user_data;
+}
+
+// Each completion carries what one recv() would have read, in a buffer
+// the kernel picks from the provided ring
+void UringEventLoop::_armReceive(int fd) {
+	Registration& registration = _registrations[fd];
+	registration.receive_data = _nextUserData(fd, RECEIVE);
+	registration.receive_cancelled = false;
+
+	struct io_uring_sqe* sqe = _getSqe();
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = fd;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = URING_BUFFER_GROUP;
+	sqe->user_data = registration.receive_data;
+}
+
+void UringEventLoop::_markDirty(int fd) {
+	if (!_registrations[fd].dirty) {
+		_registrations[fd].dirty = true;
+		_dirty.push_back(fd);
+	}
+}
+
+bool UringEventLoop::_isRegistered(int fd) const {
+	return fd >= 0 && static_cast<size_t>(fd) < _registrations.size() &&
+	       _registrations[fd].registered;
+}
+
+void UringEventLoop::_cancel(unsigned long long user_data) {
+	struct io_uring_sqe* sqe = _getSqe();
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = user_data;
+	sqe->user_data = 0;
+}
+
+// Any other request; it still completes, with -ECANCELED if it was pending
+void UringEventLoop::_cancelRequest(unsigned long long user_data) {
+	struct io_uring_sqe* sqe = _getSqe();
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = user_data;
+	sqe->user_data = 0;
+}
+
+// Sequence number, kind and fd, so a completion finds its registration
+// and one for a request since replaced is told apart
+unsigned long long UringEventLoop::_nextUserData(int fd, RequestKind kind) {
+	_sequence = (_sequence + 1) & 0x3fffffffu;
+	if (_sequence == 0) {
+		_sequence = 1;
+	}
+	return (static_cast<unsigned long long>(_sequence) << 34) |
+	       (static_cast<unsigned long long>(kind) << 32) | static_cast<unsigned>(fd);
+}
+
+// Next free submission slot, zeroed. Queued work is flushed first if
+// the ring is full.
+struct io_uring_sqe* UringEventLoop::_getSqe() {
+	if (_sq_pending > _sq_mask) {
+		_enter(_sq_pending, 0, 0);
+	}
+	unsigned tail = *_sq_tail;
+	unsigned index = tail & _sq_mask;
+	struct io_uring_sqe* sqe = &_sqes[index];
+	std::memset(sqe, 0, sizeof(*sqe));
+	_sq_array[index] = index;
+	__atomic_store_n(_sq_tail, tail + 1, __ATOMIC_RELEASE);
+	_sq_pending++;
+	return sqe;
+}
+
+// Submits and, with min_complete, waits up to timeout_ms (-1: forever)
+int UringEventLoop::_enter(unsigned to_submit, unsigned min_complete, int timeout_ms) {
+	int result;
+	if (min_complete == 0) {
+		result = syscall(__NR_io_uring_enter, _ring_fd, to_submit, 0, 0, NULL, 0);
+	} else {
+		struct __kernel_timespec timeout;
+		timeout.tv_sec = timeout_ms / 1000;
+		timeout.tv_nsec = (timeout_ms % 1000) * 1000000LL;
+
+		struct io_uring_getevents_arg arg;
+		std::memset(&arg, 0, sizeof(arg));
+		arg.ts = timeout_ms >= 0 ? reinterpret_cast<unsigned long long>(&timeout) : 0;
+		result = syscall(__NR_io_uring_enter, _ring_fd, to_submit, min_complete,
+		                 IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+	}
+
+	// The kernel consumed whatever it accepted, even if the wait failed
+	_sq_pending = *_sq_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+	return result;
+}
+
+void UringEventLoop::_complete(std::vector<IoEvent>& events, const struct io_uring_cqe& cqe) {
+	const char* data = NULL;
+	if (cqe.flags & IORING_CQE_F_BUFFER) {
+		unsigned short id = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+		data = _buffers + static_cast<size_t>(id) * URING_BUFFER_SIZE;
+		_used_buffers.push_back(id);
+	}
+	unsigned long long user_data = cqe.user_data;
+	if (user_data == 0) {
+		return; // Completion of a cancellation
+	}
+	int fd = static_cast<int>(user_data & 0xffffffffu);
+	RequestKind kind = static_cast<RequestKind>((user_data >> 32) & 0x3);
+	bool more = cqe.flags & IORING_CQE_F_MORE;
+
+	Registration* registration = NULL;
+	if (static_cast<size_t>(fd) < _registrations.size()) {
+		registration = &_registrations[fd];
+	}
+	unsigned long long current = 0;
+	if (registration) {
+		current = kind == RECEIVE ? registration->receive_data :
+		          kind == SEND ? registration->send_data : registration->user_data;
+	}
+	if (current != user_data) {
+		// Removed or re-armed since, including its cancellation. A
+		// connection accepted for a listener that is gone is closed.
+		if (kind == ACCEPT && cqe.res >= 0) {
+			close(cqe.res);
+		}
+		return;
+	}
+
+	switch (kind) {
+		case POLL:
+			// Kernels before 5.13 take poll requests as one-shot only
+			if (cqe.res == -EINVAL && _multishot) {
+				_multishot = false;
+				_markDirty(fd);
+				registration->user_data = 0;
+				return;
+			}
+			_report(events, fd, cqe.res < 0 ? POLLERR : cqe.res);
+			if (cqe.res >= 0 && !more) {
+				registration->user_data = 0;
+				_markDirty(fd); // One-shot, or a multishot poll the kernel ended
+			}
+			return;
+
+		case ACCEPT:
+			if (!more) {
+				registration->user_data = 0;
+				_markDirty(fd);
+			}
+			_push(events, fd, EVENT_ACCEPT, cqe.res, NULL);
+			return;
+
+		case RECEIVE:
+			// Out of buffers, cancelled by a pause, or ended by the kernel:
+			// armed again by the next wait() if reading is still wanted
+			if (!more) {
+				registration->receive_data = 0;
+				registration->receive_cancelled = false;
+				if (cqe.res > 0 || cqe.res == -ENOBUFS || cqe.res == -ECANCELED) {
+					_markDirty(fd);
+				}
+			}
+			if (cqe.res == -ENOBUFS || cqe.res == -ECANCELED) {
+				return;
+			}
+			_push(events, fd, EVENT_DATA, cqe.res, data);
+			return;
+
+		case SEND:
+			registration->send_data = 0;
+			_push(events, fd, EVENT_SENT, cqe.res, NULL);
+			return;
+	}
+}
+
+void UringEventLoop::_report(std::vector<IoEvent>& events, int fd, int ready) {
+	int flags = 0;
+	if (ready & POLLIN) flags |= EVENT_READ;
+	if (ready & POLLOUT) flags |= EVENT_WRITE;
+	if (ready & (POLLERR | POLLHUP)) flags |= EVENT_ERROR;
+
+	// One entry per fd, as the other backends report them
+	Registration& registration = _registrations[fd];
+	if (registration.reported >= 0) {
+		events[registration.reported].events |= flags;
+		return;
+	}
+	registration.reported = events.size();
+	_push(events, fd, flags, 0, NULL);
+}
+
+// Completions are never merged, each carries its own result
+void UringEventLoop::_push(std::vector<IoEvent>& events, int fd, int flags, int result,
+                           const char* data) {
+	Registration& registration = _registrations[fd];
+	if (registration.first_event < 0) {
+		registration.first_event = events.size();
+	}
+	IoEvent event;
+	event.fd = fd;
+	event.events = flags;
+	event.result = result;
+	event.data = data;
+	events.push_back(event);
+}
+
+// The ring and the buffers are anonymous memory, touched only as the
+// kernel fills them; registering needs 5.19+
+bool UringEventLoop::_setupBuffers() {
+	size_t ring_size = URING_BUFFER_COUNT * sizeof(struct io_uring_buf);
+	void* ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	void* buffers = mmap(NULL, URING_BUFFER_COUNT * URING_BUFFER_SIZE, PROT_READ | PROT_WRITE,
+	                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	_buffer_ring = ring == MAP_FAILED ? NULL : static_cast<struct io_uring_buf_ring*>(ring);
+	_buffers = buffers == MAP_FAILED ? NULL : static_cast<char*>(buffers);
+
+	struct io_uring_buf_reg registration;
+	std::memset(&registration, 0, sizeof(registration));
+	registration.ring_addr = reinterpret_cast<unsigned long long>(_buffer_ring);
+	registration.ring_entries = URING_BUFFER_COUNT;
+	registration.bgid = URING_BUFFER_GROUP;
+	if (!_buffer_ring || !_buffers ||
+	    syscall(__NR_io_uring_register, _ring_fd, IORING_REGISTER_PBUF_RING, &registration, 1) < 0) {
+		if (_buffer_ring) {
+			munmap(_buffer_ring, ring_size);
+		}
+		if (_buffers) {
+			munmap(_buffers, URING_BUFFER_COUNT * URING_BUFFER_SIZE);
+		}
+		_buffer_ring = NULL;
+		_buffers = NULL;
+		return false;
+	}
+	for (unsigned i = 0; i < URING_BUFFER_COUNT; ++i) {
+		_provideBuffer(i);
+	}
+	__atomic_store_n(&_buffer_ring->tail, _buffer_tail, __ATOMIC_RELEASE);
+	return true;
+}
+
+// Published by storing _buffer_tail in the ring's tail. The first entry's
+// last field is that tail, so entries are filled field by field. They are
+// indexed from the start of the ring: compiled as C++, the header's empty
+// struct in front of bufs moves it 8 bytes off.
+void UringEventLoop::_provideBuffer(unsigned short id) {
+	struct io_uring_buf* entries = reinterpret_cast<struct io_uring_buf*>(_buffer_ring);
+	struct io_uring_buf& entry = entries[_buffer_tail & (URING_BUFFER_COUNT - 1)];
+	entry.addr = reinterpret_cast<unsigned long long>(_buffers + static_cast<size_t>(id) * URING_BUFFER_SIZE);
+	entry.len = URING_BUFFER_SIZE;
+	entry.bid = id;
+	_buffer_tail++;
+}
+
+void UringEventLoop::_unmap() {
+	if (_buffer_ring) {
+		munmap(_buffer_ring, URING_BUFFER_COUNT * sizeof(struct io_uring_buf));
+	}
+	if (_buffers) {
+		munmap(_buffers, URING_BUFFER_COUNT * URING_BUFFER_SIZE);
+	}
+	if (_sqes) {
+		munmap(_sqes, _sqes_size);
+	}
+	if (_cq_ring && _cq_ring != _sq_ring) {
+		munmap(_cq_ring, _cq_ring_size);
+	}
+	if (_sq_ring) {
+		munmap(_sq_ring, _sq_ring_size);
+	}
+}
+
+unsigned UringEventLoop::_toPoll(int events) {
+	unsigned result = 0;
+	if (events & EVENT_READ) result |= POLLIN;
+	if (events & EVENT_WRITE) result |= POLLOUT;
+	return result; // POLLERR and POLLHUP are always reported
+}
+
+#endif // __linux__
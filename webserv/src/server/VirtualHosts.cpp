@@ -0,0 +1,109 @@
+#include "VirtualHosts.hpp"
+#include "Config.hpp"
+#include <cctype>
+
+VirtualHosts::VirtualHosts(const std::string& host, int port)
+	: _buckets(16), _count(0), _default(NULL), _host(host), _port(port) {}
+
+VirtualHosts::~VirtualHosts() {}
+
+void VirtualHosts::add(const ServerConfig* server) {
+	if (!_default) {
+		_default = server;
+	}
+	for (size_t i = 0; i < server->server_names.size(); ++i) {
+		std::string name = server->server_names[i];
+		for (size_t j = 0; j < name.length(); ++j) {
+			name[j] = std::tolower(name[j]);
+		}
+		_insert(name, server);
+	}
+}
+
+// Getters
+const ServerConfig* VirtualHosts::find(const char* host, size_t length) const {
+	// Drop the port, IPv6 literals keep their brackets
+	size_t end = 0;
+	if (length > 0 && host[0] == '[') {
+		while (end < length && host[end] != ']') {
+			end++;
+		}
+		if (end < length) {
+			end++;
+		}
+	} else {
+		while (end < length && host[end] != ':') {
+			end++;
+		}
+	}
+	if (end > 0 && host[end - 1] == '.') {
+		end--; // Fully qualified "example.com."
+	}
+
+	const std::vector<Entry>& bucket = _buckets[_hash(host, end) & (_buckets.size() - 1)];
+	for (size_t i = 0; i < bucket.size(); ++i) {
+		const std::string& name = bucket[i].name;
+		if (name.length() != end) {
+			continue;
+		}
+		size_t j = 0;
+		while (j < end && std::tolower(static_cast<unsigned char>(host[j])) == name[j]) {
+			j++;
+		}
+		if (j == end) {
+			return bucket[i].server;
+		}
+	}
+	return _default;
+}
+
+const ServerConfig* VirtualHosts::getDefault() const {
+	return _default;
+}
+
+const std::string& VirtualHosts::getHost() const {
+	return _host;
+}
+
+int VirtualHosts::getPort() const {
+	return _port;
+}
+
+void VirtualHosts::_insert(const std::string& name, const ServerConfig* server) {
+	std::vector<Entry>& bucket = _buckets[_hash(name.data(), name.length()) & (_buckets.size() - 1)];
+	for (size_t i = 0; i < bucket.size(); ++i) {
+		if (bucket[i].name == name) {
+			return; // Like nginx, the first block claiming a name keeps it
+		}
+	}
+	Entry entry;
+	entry.name = name;
+	entry.server = server;
+	bucket.push_back(entry);
+
+	// Keep chains short, the bucket count stays a power of two
+	if (++_count > _buckets.size()) {
+		_grow();
+	}
+}
+
+void VirtualHosts::_grow() {
+	std::vector<std::vector<Entry> > buckets(_buckets.size() * 2);
+	for (size_t i = 0; i < _buckets.size(); ++i) {
+		for (size_t j = 0; j < _buckets[i].size(); ++j) {
+			const Entry& entry = _buckets[i][j];
+			buckets[_hash(entry.name.data(), entry.name.length()) & (buckets.size() - 1)].push_back(entry);
+		}
+	}
+	_buckets.swap(buckets);
+}
+
+// FNV-1a over the lowercased name
+size_t VirtualHosts::_hash(const char* data, size_t length) {
+	size_t hash = 2166136261u;
+	for (size_t i = 0; i < length; ++i) {
+		hash ^= static_cast<size_t>(std::tolower(static_cast<unsigned char>(data[i])));
+		hash *= 16777619u;
+	}
+	return hash;
+}
@@ -1,4 +1,6 @@
 #include "Server.hpp"
+#include "Config.hpp"
+#include "Supervisor.hpp"
 #include <iostream>
 #include <cstdlib>
 
@@ -10,6 +12,13 @@ int main(int argc, char** argv) {
 	}
 
 	try {
+		// Multi-core: a supervisor forks one event loop per worker
+		Config config(config_file);
+		if (config.parse() && config.getWorkers() > 1) {
+			Supervisor supervisor(config_file, config.getWorkers());
+			return supervisor.run();
+		}
+
 		Server server(config_file);
 		server.run();
 	} catch (const std::exception& e) {
@@ -19,4 +28,3 @@ int main(int argc, char** argv) {
 
 	return 0;
 }
-
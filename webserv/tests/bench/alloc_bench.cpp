@@ -0,0 +1,164 @@
+// Allocation count and time for per-connection and per-request state.
+// Build with `make bench`, run ./bench_alloc [iterations]
+
+#include "Client.hpp"
+#include "ClientPool.hpp"
+#include "HttpParser.hpp"
+#include "Request.hpp"
+
+#include <iostream>
+#include <string>
+#include <map>
+#include <algorithm>
+#include <new>
+#include <cstdlib>
+#include <sys/time.h>
+
+static size_t g_allocations = 0;
+
+// Every allocation in the process goes through here. Kept out of line,
+// GCC otherwise pairs the inlined free() with std::allocator and warns.
+void* operator new(size_t size) throw(std::bad_alloc) {
+	g_allocations++;
+	void* ptr = std::malloc(size ? size : 1);
+	if (!ptr)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+__attribute__((noinline)) void operator delete(void* ptr) throw() {
+	std::free(ptr);
+}
+
+static const char* SAMPLE_REQUEST =
+	"GET /static/js/app.min.js?v=20240101 HTTP/1.1\r\n"
+	"Host: www.example.com\r\n"
+	"User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:120.0) Gecko/20100101 Firefox/120.0\r\n"
+	"Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+	"Accept-Language: en-US,en;q=0.5\r\n"
+	"Accept-Encoding: gzip, deflate, br\r\n"
+	"Referer: https://www.example.com/index.html\r\n"
+	"Connection: keep-alive\r\n"
+	"Cookie: session=0123456789abcdef; theme=dark; lang=en\r\n"
+	"Cache-Control: max-age=0\r\n"
+	"\r\n";
+
+// Headers the server looks up while answering a static file request
+static const char* LOOKUPS[] = { "Connection", "Accept-Encoding", "Range", "If-None-Match",
+                                 "If-Modified-Since" };
+static const size_t LOOKUP_COUNT = sizeof(LOOKUPS) / sizeof(LOOKUPS[0]);
+
+static double nowUsec() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1e6 + tv.tv_usec;
+}
+
+static void report(const char* name, double elapsed_usec, size_t allocations, size_t iterations) {
+	std::cout << name << ": " << elapsed_usec * 1000.0 / iterations << " ns, "
+	          << static_cast<double>(allocations) / iterations << " allocations" << std::endl;
+}
+
+// The previous Request state, kept as a baseline: a std::map of lowercased
+// copies, and a lowercased copy of the key for every lookup
+static std::string toLower(const std::string& str) {
+	std::string result = str;
+	std::transform(result.begin(), result.end(), result.begin(), ::tolower);
+	return result;
+}
+
+static size_t buildLegacy(const std::string& buffer, const HttpParser& parser) {
+	std::string uri = HttpParser::toString(buffer, parser.getUri());
+	size_t query = uri.find('?');
+	std::string path = uri.substr(0, query);
+	std::string query_string = uri.substr(query + 1);
+	std::map<std::string, std::string> headers;
+	const std::vector<HeaderRef>& refs = parser.getHeaders();
+	for (size_t i = 0; i < refs.size(); ++i) {
+		headers[toLower(HttpParser::toString(buffer, refs[i].name))] =
+			HttpParser::toString(buffer, refs[i].value);
+	}
+
+	size_t found = 0;
+	for (size_t i = 0; i < LOOKUP_COUNT; ++i) {
+		std::map<std::string, std::string>::const_iterator it = headers.find(toLower(LOOKUPS[i]));
+		if (it != headers.end())
+			found += std::string(it->second).length();
+	}
+	return found + path.length() + query_string.length();
+}
+
+static size_t buildArena(const std::string& buffer, const HttpParser& parser, Arena& arena) {
+	Request request(arena);
+	request.build(buffer, parser);
+	size_t found = 0;
+	for (size_t i = 0; i < LOOKUP_COUNT; ++i) {
+		if (request.hasHeader(LOOKUPS[i]))
+			found += request.getHeader(LOOKUPS[i]).length();
+	}
+	arena.reset();
+	return found + request.getPath().length() + request.getQuery().length();
+}
+
+// A short connection: accept, read and parse one request, close
+static size_t serveConnection(Client* client, const std::string& request) {
+	client->addToBuffer(request.data(), request.length());
+	HttpParser& parser = client->getParser();
+	if (parser.parse(client->getBuffer()) != HttpParser::COMPLETE)
+		std::exit(1);
+	size_t sink = buildArena(client->getBuffer(), parser, client->getArena());
+	client->consume(parser.getMessageLength());
+	return sink;
+}
+
+int main(int argc, char** argv) {
+	size_t iterations = argc > 1 ? std::strtoul(argv[1], NULL, 10) : 1000000;
+	std::string request(SAMPLE_REQUEST);
+	HttpParser parser;
+	if (parser.parse(request) != HttpParser::COMPLETE)
+		return 1;
+	size_t sink = 0;
+
+	// Per request on a keep-alive connection
+	size_t allocations = g_allocations;
+	double start = nowUsec();
+	for (size_t i = 0; i < iterations; ++i) {
+		sink += buildLegacy(request, parser);
+	}
+	report("request: std::map headers    ", nowUsec() - start, g_allocations - allocations, iterations);
+
+	Arena arena;
+	Request warmup(arena);
+	warmup.build(request, parser);
+	arena.reset();
+	allocations = g_allocations;
+	start = nowUsec();
+	for (size_t i = 0; i < iterations; ++i) {
+		sink += buildArena(request, parser, arena);
+	}
+	report("request: arena headers       ", nowUsec() - start, g_allocations - allocations, iterations);
+
+	// Per connection, one request each
+	size_t connections = iterations / 10;
+	allocations = g_allocations;
+	start = nowUsec();
+	for (size_t i = 0; i < connections; ++i) {
+		Client* client = new Client(static_cast<int>(i));
+		sink += serveConnection(client, request);
+		delete client;
+	}
+	report("connection: new/delete Client", nowUsec() - start, g_allocations - allocations, connections);
+
+	ClientPool pool(1024);
+	pool.release(pool.acquire(0));
+	allocations = g_allocations;
+	start = nowUsec();
+	for (size_t i = 0; i < connections; ++i) {
+		Client* client = pool.acquire(static_cast<int>(i));
+		sink += serveConnection(client, request);
+		pool.release(client);
+	}
+	report("connection: ClientPool       ", nowUsec() - start, g_allocations - allocations, connections);
+
+	return sink == 0 ? 1 : 0;
+}
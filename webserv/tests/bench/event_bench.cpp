@@ -0,0 +1,192 @@
+// Microbenchmark for the event loop backends over many socket pairs.
+// Build with `make bench`, run ./bench_event [rounds] [connections]
+
+#include "EventLoop.hpp"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+static double nowUsec() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1e6 + tv.tv_usec;
+}
+
+// Each round wakes `active` of the connections with one byte and handles
+// them. With `toggle`, every handled fd is also paused and resumed, as the
+// server does when a client's output backs up: two interest changes per event.
+static double run(const char* backend, size_t rounds, size_t connections, size_t active,
+                  bool toggle) {
+	EventLoop* loop = EventLoop::create(backend);
+	std::vector<int> server_fds(connections);
+	std::vector<int> peer_fds(connections);
+	for (size_t i = 0; i < connections; ++i) {
+		int pair[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0) {
+			std::exit(1);
+		}
+		fcntl(pair[0], F_SETFL, O_NONBLOCK);
+		server_fds[i] = pair[0];
+		peer_fds[i] = pair[1];
+		loop->add(pair[0], EVENT_READ);
+	}
+
+	std::vector<IoEvent> events;
+	char byte = 'x';
+	size_t handled = 0;
+	double start = nowUsec();
+	for (size_t round = 0; round < rounds; ++round) {
+		for (size_t i = 0; i < active; ++i) {
+			if (write(peer_fds[(round * 7919 + i * 31) % connections], &byte, 1) != 1) {
+				std::exit(1);
+			}
+		}
+		size_t pending = active;
+		while (pending > 0) {
+			int count = loop->wait(events, 1000);
+			if (count <= 0) {
+				std::exit(1);
+			}
+			for (int i = 0; i < count; ++i) {
+				char buffer[64];
+				while (read(events[i].fd, buffer, sizeof(buffer)) > 0) {
+					pending--; // Drained until EAGAIN, edge-triggered backends need it
+				}
+				if (toggle) {
+					loop->modify(events[i].fd, 0);
+					loop->modify(events[i].fd, EVENT_READ);
+				}
+				handled++;
+			}
+		}
+	}
+	double elapsed = nowUsec() - start;
+
+	const char* name = loop->getName();
+	for (size_t i = 0; i < connections; ++i) {
+		loop->remove(server_fds[i]);
+		close(server_fds[i]);
+		close(peer_fds[i]);
+	}
+	std::cout << "  " << name << (toggle ? " + interest changes" : "") << ": "
+	          << elapsed * 1000.0 / handled << " ns/event" << std::endl;
+	delete loop;
+	return elapsed;
+}
+
+// Each round `active` peers send a request and read back the response.
+// poll and epoll answer with recv() and send() on readiness; io_uring,
+// when it has completions, receives into its provided buffers and queues
+// the sends, so the loop side makes no syscall but wait()'s own. Only
+// the loop side is timed, the peers' writes and reads are left out.
+static double runRequests(const char* backend, size_t rounds, size_t connections, size_t active) {
+	static const char request[] = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+	static const std::string response = "HTTP/1.1 200 OK\r\nContent-Length: 512\r\n\r\n" +
+	                                    std::string(512, 'x');
+
+	EventLoop* loop = EventLoop::create(backend);
+	bool completions = loop->hasCompletions();
+	std::vector<int> server_fds(connections);
+	std::vector<int> peer_fds(connections);
+	for (size_t i = 0; i < connections; ++i) {
+		int pair[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0) {
+			std::exit(1);
+		}
+		fcntl(pair[0], F_SETFL, O_NONBLOCK);
+		server_fds[i] = pair[0];
+		peer_fds[i] = pair[1];
+		if (completions) {
+			loop->addReceiver(pair[0], EVENT_READ);
+		} else {
+			loop->add(pair[0], EVENT_READ);
+		}
+	}
+
+	struct iovec part;
+	part.iov_base = const_cast<char*>(response.data());
+	part.iov_len = response.length();
+	std::vector<IoEvent> events;
+	std::vector<char> reply(response.length());
+	size_t handled = 0;
+	double elapsed = 0;
+	for (size_t round = 0; round < rounds; ++round) {
+		std::vector<int> peers;
+		for (size_t i = 0; i < active; ++i) {
+			peers.push_back(peer_fds[(round * 7919 + i * 31) % connections]);
+			if (write(peers.back(), request, sizeof(request) - 1) != sizeof(request) - 1) {
+				std::exit(1);
+			}
+		}
+		double start = nowUsec();
+		size_t pending = active;
+		while (pending > 0) {
+			int count = loop->wait(events, 1000);
+			if (count <= 0) {
+				std::exit(1);
+			}
+			for (int i = 0; i < count; ++i) {
+				int fd = events[i].fd;
+				if (events[i].events & EVENT_DATA) {
+					if (events[i].result <= 0 || !loop->send(fd, &part, 1)) {
+						std::exit(1);
+					}
+				}
+				if (events[i].events & EVENT_SENT) {
+					pending--;
+				}
+				if (events[i].events & EVENT_READ) {
+					char buffer[4096];
+					while (recv(fd, buffer, sizeof(buffer), 0) > 0) {}
+					if (send(fd, response.data(), response.length(), 0) != (ssize_t)response.length()) {
+						std::exit(1);
+					}
+					pending--;
+				}
+			}
+		}
+		elapsed += nowUsec() - start;
+		for (size_t i = 0; i < peers.size(); ++i) {
+			if (read(peers[i], &reply[0], reply.size()) != (ssize_t)reply.size()) {
+				std::exit(1);
+			}
+			handled++;
+		}
+	}
+
+	const char* name = loop->getName();
+	for (size_t i = 0; i < connections; ++i) {
+		loop->remove(server_fds[i]);
+		close(server_fds[i]);
+		close(peer_fds[i]);
+	}
+	std::cout << "  " << name << (completions ? " (completions)" : "") << ": "
+	          << elapsed * 1000.0 / handled << " ns/request" << std::endl;
+	delete loop;
+	return elapsed;
+}
+
+int main(int argc, char** argv) {
+	size_t rounds = argc > 1 ? std::strtoul(argv[1], NULL, 10) : 2000;
+	size_t connections = argc > 2 ? std::strtoul(argv[2], NULL, 10) : 1000;
+	size_t active = connections / 10 > 0 ? connections / 10 : 1;
+
+	const char* backends[] = { "poll", "epoll", "uring" };
+	std::cout << connections << " connections, " << active << " active per round" << std::endl;
+	for (size_t toggle = 0; toggle < 2; ++toggle) {
+		for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); ++i) {
+			run(backends[i], rounds, connections, active, toggle != 0);
+		}
+	}
+	std::cout << "request/response, " << active << " per round" << std::endl;
+	for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); ++i) {
+		runRequests(backends[i], rounds, connections, active);
+	}
+	return 0;
+}
@@ -0,0 +1,120 @@
+// Benchmark for autoindex listings of a large directory.
+// Build with `make bench`, run ./bench_listing [files]
+
+#include "DirectoryCache.hpp"
+#include "DirectoryListing.hpp"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+static double nowUsec() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1e6 + tv.tv_usec;
+}
+
+static void report(const char* name, double elapsed_usec, size_t files) {
+	std::cout << name << ": " << elapsed_usec / 1000.0 << " ms ("
+	          << elapsed_usec * 1000.0 / files << " ns/entry)" << std::endl;
+}
+
+// The straightforward scan, kept as a baseline: readdir() and a stat()
+// by full path for every entry
+static size_t scanWithReaddir(const std::string& path) {
+	DIR* dir = opendir(path.c_str());
+	size_t count = 0;
+	while (struct dirent* entry = readdir(dir)) {
+		struct stat info;
+		if (entry->d_name[0] != '.' && stat((path + "/" + entry->d_name).c_str(), &info) == 0) {
+			count++;
+		}
+	}
+	closedir(dir);
+	return count;
+}
+
+static size_t drain(const ListingOptions& options) {
+	DirectoryListing listing(options);
+	std::string chunk;
+	size_t bytes = 0;
+	bool done = false;
+	while (!done) {
+		chunk.clear();
+		done = listing.next(chunk);
+		bytes += chunk.length();
+	}
+	return bytes;
+}
+
+int main(int argc, char** argv) {
+	size_t files = argc > 1 ? std::strtoul(argv[1], NULL, 10) : 200000;
+	char dir_template[] = "/tmp/webserv_listing_XXXXXX";
+	std::string dir = mkdtemp(dir_template);
+	for (size_t i = 0; i < files; ++i) {
+		char name[64];
+		std::snprintf(name, sizeof(name), "%s/upload-%07lu.bin", dir.c_str(),
+		              static_cast<unsigned long>((i * 7919) % files));
+		close(open(name, O_WRONLY | O_CREAT, 0644));
+	}
+	struct stat info;
+	stat(dir.c_str(), &info);
+	size_t sink = 0;
+
+	double start = nowUsec();
+	sink += scanWithReaddir(dir);
+	report("readdir + stat           ", nowUsec() - start, files);
+
+	start = nowUsec();
+	std::vector<DirectoryEntry> entries;
+	DirectoryCache::scan(dir, entries);
+	sink += entries.size();
+	report("getdents64 + fstatat     ", nowUsec() - start, files);
+
+	DirectoryCache cache(DIRECTORY_CACHE_ENTRIES);
+	ListingOptions options;
+	cache.lookup(dir, info, options.snapshot);
+	options.uri = "/uploads/";
+	start = nowUsec();
+	options.snapshot.getOrder(SORT_NAME);
+	report("first sort by name       ", nowUsec() - start, files);
+
+	start = nowUsec();
+	sink += drain(options);
+	report("full HTML listing        ", nowUsec() - start, files);
+
+	options.json = true;
+	start = nowUsec();
+	sink += drain(options);
+	report("full JSON listing        ", nowUsec() - start, files);
+
+	// What a repeated request costs: a cache hit and one page
+	options.json = false;
+	options.offset = files / 2;
+	options.limit = 100;
+	size_t repeats = 1000;
+	start = nowUsec();
+	for (size_t i = 0; i < repeats; ++i) {
+		ListingOptions page = options;
+		cache.lookup(dir, info, page.snapshot);
+		sink += drain(page);
+	}
+	std::cout << "cached page of 100       : " << (nowUsec() - start) / repeats << " us/request"
+	          << std::endl;
+
+	for (size_t i = 0; i < files; ++i) {
+		char name[64];
+		std::snprintf(name, sizeof(name), "%s/upload-%07lu.bin", dir.c_str(),
+		              static_cast<unsigned long>(i));
+		unlink(name);
+	}
+	rmdir(dir.c_str());
+	return sink == 0;
+}
@@ -0,0 +1,115 @@
+// Microbenchmark for location routing over a large generated config.
+// Build with `make bench`, run ./bench_location [iterations] [locations]
+
+#include "Config.hpp"
+#include "Utils.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstdio>
+#include <unistd.h>
+#include <sys/time.h>
+
+static double nowUsec() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1e6 + tv.tv_usec;
+}
+
+static void report(const char* name, double elapsed_usec, size_t iterations) {
+	std::cout << name << ": " << elapsed_usec * 1000.0 / iterations << " ns/lookup" << std::endl;
+}
+
+// The previous lookup, kept as a baseline: every location tested with
+// find(), which scans the whole URI when the prefix doesn't match
+static const LocationConfig* findLinear(const std::string& uri, const ServerConfig& server) {
+	const LocationConfig* best_match = NULL;
+	size_t best_match_len = 0;
+	for (size_t i = 0; i < server.locations.size(); ++i) {
+		const LocationConfig& loc = server.locations[i];
+		if (uri.find(loc.path) == 0 && loc.path.length() > best_match_len) {
+			best_match = &loc;
+			best_match_len = loc.path.length();
+		}
+	}
+	return best_match;
+}
+
+static bool methodAllowedLinear(const LocationConfig& location, const std::string& method) {
+	for (size_t i = 0; i < location.methods.size(); ++i) {
+		if (location.methods[i] == method)
+			return true;
+	}
+	return false;
+}
+
+// Sites with a few API versions and many services, like our generated config
+static std::string generateConfig(size_t count) {
+	std::ostringstream config;
+	config << "server {\n    listen 8080;\n";
+	config << "    location / {\n        root ./www;\n        methods GET;\n    }\n";
+	for (size_t i = 1; i < count; ++i) {
+		config << "    location /api/v" << (i % 4) << "/service" << i << " {\n"
+		       << "        root ./www;\n"
+		       << "        methods GET HEAD POST PUT DELETE;\n"
+		       << "    }\n";
+	}
+	config << "}\n";
+	return config.str();
+}
+
+int main(int argc, char** argv) {
+	size_t iterations = argc > 1 ? std::strtoul(argv[1], NULL, 10) : 1000000;
+	size_t count = argc > 2 ? std::strtoul(argv[2], NULL, 10) : 400;
+
+	char path[] = "/tmp/webserv-bench-XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0)
+		return 1;
+	close(fd);
+	std::ofstream file(path);
+	file << generateConfig(count);
+	file.close();
+	Config config(path);
+	bool parsed = config.parse();
+	unlink(path);
+	if (!parsed)
+		return 1;
+	const ServerConfig& server = config.getServerConfig(0);
+	std::cout << server.locations.size() << " locations" << std::endl;
+
+	// A hit deep in the table, one near the start and a miss to "/"
+	std::vector<std::string> uris;
+	std::ostringstream uri;
+	uri << "/api/v" << ((count - 1) % 4) << "/service" << (count - 1) << "/items/42";
+	uris.push_back(uri.str());
+	uris.push_back("/api/v1/service1/users?page=2");
+	uris.push_back("/static/css/site.css");
+	const std::string method = "DELETE";
+	size_t sink = 0;
+
+	for (size_t u = 0; u < uris.size(); ++u) {
+		if (findLinear(uris[u], server) != config.findLocation(uris[u], server))
+			return 1;
+	}
+
+	double start = nowUsec();
+	for (size_t i = 0; i < iterations; ++i) {
+		const LocationConfig* location = findLinear(uris[i % uris.size()], server);
+		sink += methodAllowedLinear(*location, method);
+	}
+	report("linear scan + method strings", nowUsec() - start, iterations);
+
+	start = nowUsec();
+	for (size_t i = 0; i < iterations; ++i) {
+		const LocationConfig* location = config.findLocation(uris[i % uris.size()], server);
+		sink += (location->allowed_methods & Utils::methodBit(method)) != 0;
+	}
+	report("trie + method bitmask       ", nowUsec() - start, iterations);
+
+	return sink == 0 ? 1 : 0;
+}
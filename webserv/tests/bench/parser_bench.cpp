@@ -0,0 +1,85 @@
+// Microbenchmark for the incremental request parser.
+// Build with `make bench`, run ./bench_parser [iterations]
+
+#include "HttpParser.hpp"
+#include "Request.hpp"
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <sys/time.h>
+
+static const char* SAMPLE_REQUEST =
+	"GET /static/js/app.min.js?v=20240101 HTTP/1.1\r\n"
+	"Host: www.example.com\r\n"
+	"User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:120.0) Gecko/20100101 Firefox/120.0\r\n"
+	"Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+	"Accept-Language: en-US,en;q=0.5\r\n"
+	"Accept-Encoding: gzip, deflate, br\r\n"
+	"Referer: https://www.example.com/index.html\r\n"
+	"Connection: keep-alive\r\n"
+	"Cookie: session=0123456789abcdef; theme=dark; lang=en\r\n"
+	"Cache-Control: max-age=0\r\n"
+	"\r\n";
+
+static double nowUsec() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1e6 + tv.tv_usec;
+}
+
+static void report(const char* name, double elapsed_usec, size_t iterations, size_t bytes) {
+	double ns = elapsed_usec * 1000.0 / iterations;
+	std::cout << name << ": " << ns << " ns/request, "
+	          << (bytes * iterations) / elapsed_usec << " MB/s" << std::endl;
+}
+
+int main(int argc, char** argv) {
+	size_t iterations = argc > 1 ? std::strtoul(argv[1], NULL, 10) : 1000000;
+	std::string request(SAMPLE_REQUEST);
+	HttpParser parser;
+	size_t sink = 0;
+
+	// Whole request available in one read
+	double start = nowUsec();
+	for (size_t i = 0; i < iterations; ++i) {
+		parser.reset();
+		if (parser.parse(request) != HttpParser::COMPLETE)
+			return 1;
+		sink += parser.getHeaders().size();
+	}
+	report("parse (single read)      ", nowUsec() - start, iterations, request.size());
+
+	// Same request trickling in 16 bytes at a time, resumed after each read
+	size_t fragmented = iterations / 10;
+	std::string buffer;
+	start = nowUsec();
+	for (size_t i = 0; i < fragmented; ++i) {
+		parser.reset();
+		buffer.clear();
+		HttpParser::Result result = HttpParser::INCOMPLETE;
+		for (size_t pos = 0; result == HttpParser::INCOMPLETE && pos < request.size(); pos += 16) {
+			buffer.append(request, pos, 16);
+			result = parser.parse(buffer);
+		}
+		if (result != HttpParser::COMPLETE)
+			return 1;
+		sink += parser.getHeaders().size();
+	}
+	report("parse (16-byte reads)    ", nowUsec() - start, fragmented, request.size());
+
+	// Parse plus materializing the Request object, headers in a reused arena
+	Arena arena;
+	start = nowUsec();
+	for (size_t i = 0; i < fragmented; ++i) {
+		parser.reset();
+		parser.parse(request);
+		arena.reset();
+		Request req(arena);
+		req.build(request, parser);
+		sink += req.getHeaderCount();
+	}
+	report("parse + Request::build   ", nowUsec() - start, fragmented, request.size());
+
+	return sink == 0;
+}
@@ -0,0 +1,92 @@
+// Microbenchmark for response serialization.
+// Build with `make bench`, run ./bench_response [iterations]
+
+#include "Response.hpp"
+
+#include <iostream>
+#include <string>
+#include <map>
+#include <sstream>
+#include <cstdlib>
+#include <sys/time.h>
+
+static double nowUsec() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1e6 + tv.tv_usec;
+}
+
+static void report(const char* name, double elapsed_usec, size_t iterations) {
+	std::cout << name << ": " << elapsed_usec * 1000.0 / iterations << " ns/response" << std::endl;
+}
+
+// The previous serializer, kept as a baseline: headers in a std::map and
+// everything formatted through ostringstreams
+static std::string buildWithStreams(const std::map<std::string, std::string>& headers,
+                                    const std::string& body) {
+	std::ostringstream response;
+	response << "HTTP/1.1 " << 200 << " " << "OK" << "\r\n";
+	for (std::map<std::string, std::string>::const_iterator it = headers.begin();
+	     it != headers.end(); ++it) {
+		response << it->first << ": " << it->second << "\r\n";
+	}
+	std::ostringstream len;
+	len << body.length();
+	response << "Content-Length: " << len.str() << "\r\n";
+	response << "\r\n";
+	response << body;
+	return response.str();
+}
+
+int main(int argc, char** argv) {
+	size_t iterations = argc > 1 ? std::strtoul(argv[1], NULL, 10) : 1000000;
+	std::string body(1600, 'x'); // Size of the default index.html
+	size_t sink = 0;
+
+	// Headers of a typical cached static file on a keep-alive connection
+	const char* headers[][2] = {
+		{ "Content-Type", "text/html" },
+		{ "Accept-Ranges", "bytes" },
+		{ "Last-Modified", "Tue, 15 Oct 2024 08:12:31 GMT" },
+		{ "ETag", "\"11e0d0-640-6978fcf0\"" },
+		{ "Cache-Control", "public, max-age=3600" },
+		{ "Connection", "keep-alive" },
+		{ "Keep-Alive", "timeout=75, max=100" },
+	};
+	size_t header_count = sizeof(headers) / sizeof(headers[0]);
+
+	double start = nowUsec();
+	for (size_t i = 0; i < iterations; ++i) {
+		std::map<std::string, std::string> map;
+		for (size_t h = 0; h < header_count; ++h)
+			map[headers[h][0]] = headers[h][1];
+		sink += buildWithStreams(map, body).length();
+	}
+	report("ostringstream + std::map ", nowUsec() - start, iterations);
+
+	start = nowUsec();
+	for (size_t i = 0; i < iterations; ++i) {
+		Response response(200);
+		response.setBody(body);
+		for (size_t h = 0; h < header_count; ++h)
+			response.setHeader(headers[h][0], headers[h][1]);
+		sink += response.build().length();
+	}
+	report("Response::build          ", nowUsec() - start, iterations);
+
+	// What the server does: head into a reused buffer, body left for writev()
+	std::string buffer;
+	start = nowUsec();
+	for (size_t i = 0; i < iterations; ++i) {
+		Response response(200);
+		response.setBody(body);
+		for (size_t h = 0; h < header_count; ++h)
+			response.setHeader(headers[h][0], headers[h][1]);
+		buffer.clear();
+		response.writeHead(buffer);
+		sink += buffer.length() + response.getBody().length();
+	}
+	report("Response::writeHead      ", nowUsec() - start, iterations);
+
+	return sink == 0;
+}
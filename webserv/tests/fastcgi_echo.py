@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+"""Minimal FastCGI responder for tests: echoes the request back.
+
+Usage: fastcgi_echo.py <socket path>
+
+Each connection is served by its own thread and kept open when the server
+asks for it (FCGI_KEEP_CONN), so the response reports how many requests
+the connection has carried.
+"""
+import os
+import socket
+import socketserver
+import struct
+import sys
+
+BEGIN_REQUEST, END_REQUEST, PARAMS, STDIN, STDOUT = 1, 3, 4, 5, 6
+KEEP_CONN = 1
+
+
+def read_exact(stream, length):
+    data = b""
+    while len(data) < length:
+        chunk = stream.recv(length - len(data))
+        if not chunk:
+            raise EOFError
+        data += chunk
+    return data
+
+
+def read_record(stream):
+    header = read_exact(stream, 8)
+    _, kind, request_id, length, padding = struct.unpack(">BBHHBx", header)
+    content = read_exact(stream, length)
+    read_exact(stream, padding)
+    return kind, request_id, content
+
+
+def write_record(stream, kind, request_id, content):
+    for offset in range(0, max(len(content), 1), 65535):
+        part = content[offset:offset + 65535]
+        padding = (8 - len(part) % 8) % 8
+        stream.sendall(struct.pack(">BBHHBx", 1, kind, request_id, len(part), padding)
+                       + part + b"\0" * padding)
+
+
+def parse_params(data):
+    params = {}
+    offset = 0
+    while offset < len(data):
+        lengths = []
+        for _ in range(2):
+            if data[offset] < 128:
+                lengths.append(data[offset])
+                offset += 1
+            else:
+                lengths.append(struct.unpack(">I", data[offset:offset + 4])[0] & 0x7fffffff)
+                offset += 4
+        name = data[offset:offset + lengths[0]].decode()
+        offset += lengths[0]
+        params[name] = data[offset:offset + lengths[1]].decode()
+        offset += lengths[1]
+    return params
+
+
+class Responder(socketserver.BaseRequestHandler):
+    def handle(self):
+        served = 0
+        try:
+            while True:
+                kind, request_id, content = read_record(self.request)
+                if kind != BEGIN_REQUEST:
+                    continue
+                keep_conn = content[2] & KEEP_CONN
+                params, body = b"", b""
+                while True:
+                    kind, _, content = read_record(self.request)
+                    if kind == PARAMS:
+                        params += content
+                    elif kind == STDIN:
+                        if not content:
+                            break
+                        body += content
+                served += 1
+                env = parse_params(params)
+                reply = ("Content-Type: text/plain\r\n\r\n"
+                         "method=%s\nquery=%s\nlength=%d\npid=%d\nconnection_requests=%d\n"
+                         % (env.get("REQUEST_METHOD", ""), env.get("QUERY_STRING", ""),
+                            len(body), os.getpid(), served))
+                write_record(self.request, STDOUT, request_id, reply.encode())
+                write_record(self.request, STDOUT, request_id, b"")
+                write_record(self.request, END_REQUEST, request_id, b"\0" * 8)
+                if not keep_conn:
+                    return
+        except EOFError:
+            return
+
+
+class Server(socketserver.ThreadingMixIn, socketserver.UnixStreamServer):
+    daemon_threads = True
+
+
+if __name__ == "__main__":
+    path = sys.argv[1] if len(sys.argv) > 1 else "/tmp/webserv-fastcgi.sock"
+    if os.path.exists(path):
+        os.unlink(path)
+    Server(path, Responder).serve_forever()
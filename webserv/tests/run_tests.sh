@@ -82,6 +82,235 @@ else
     echo -e "${RED}✗ FAIL${NC} - Content-Type: $CONTENT_TYPE (expected text/html)"
 fi
 
+# Test 6: Persistent connections
+echo "Test 6: Keep-alive connection reuse"
+REUSED=$(curl -sv -o /dev/null -o /dev/null http://localhost:8080/ http://localhost:8080/ 2>&1 | grep -c "Re-using existing connection")
+if [ "$REUSED" -ge 1 ]; then
+    echo -e "${GREEN}✓ PASS${NC} - Second request reused the connection"
+else
+    echo -e "${RED}✗ FAIL${NC} - Connection was not reused"
+fi
+
+# Test 7: Upload (spooled to disk) and delete
+echo "Test 7: POST upload then DELETE"
+head -c 100000 /dev/urandom > /tmp/webserv_upload.bin
+POST_CODE=$(curl -s -o /dev/null -w "%{http_code}" --data-binary @/tmp/webserv_upload.bin http://localhost:8080/uploads/test_upload.bin)
+if cmp -s /tmp/webserv_upload.bin www/uploads/test_upload.bin; then STORED=1; else STORED=0; fi
+DELETE_CODE=$(curl -s -o /dev/null -w "%{http_code}" -X DELETE http://localhost:8080/uploads/test_upload.bin)
+if [ "$POST_CODE" -eq 201 ] && [ "$STORED" -eq 1 ] && [ "$DELETE_CODE" -eq 204 ]; then
+    echo -e "${GREEN}✓ PASS${NC} - POST $POST_CODE, DELETE $DELETE_CODE"
+else
+    echo -e "${RED}✗ FAIL${NC} - POST $POST_CODE (stored=$STORED), DELETE $DELETE_CODE"
+fi
+rm -f /tmp/webserv_upload.bin
+
+# Test 8: Body larger than max_body_size
+echo "Test 8: Oversized body (expect 413)"
+RESPONSE=$(head -c 2000000 /dev/zero | curl -s -o /dev/null -w "%{http_code}" --data-binary @- http://localhost:8080/uploads/too_big.bin)
+if [ "$RESPONSE" -eq 413 ]; then
+    echo -e "${GREEN}✓ PASS${NC} - HTTP $RESPONSE"
+else
+    echo -e "${RED}✗ FAIL${NC} - HTTP $RESPONSE (expected 413)"
+fi
+
+# Test 9: Chunked request body
+echo "Test 9: Chunked upload"
+RESPONSE=$(echo "chunked body" | curl -s -o /dev/null -w "%{http_code}" -H "Transfer-Encoding: chunked" --data-binary @- http://localhost:8080/uploads/chunked.txt)
+CONTENT=$(cat www/uploads/chunked.txt 2>/dev/null)
+if [ "$RESPONSE" -eq 201 ] && [ "$CONTENT" == "chunked body" ]; then
+    echo -e "${GREEN}✓ PASS${NC} - HTTP $RESPONSE, body decoded"
+else
+    echo -e "${RED}✗ FAIL${NC} - HTTP $RESPONSE, stored '$CONTENT'"
+fi
+rm -f www/uploads/chunked.txt
+
+# Test 10: CGI with query string and request body
+echo "Test 10: CGI POST"
+RESPONSE=$(echo -n "hello" | curl -s --data-binary @- "http://localhost:8080/cgi-bin/echo.py?name=test")
+if echo "$RESPONSE" | grep -q "query=name=test" && echo "$RESPONSE" | grep -q "length=5"; then
+    echo -e "${GREEN}✓ PASS${NC} - Script saw the query and body"
+else
+    echo -e "${RED}✗ FAIL${NC} - Got '$RESPONSE'"
+fi
+
+# Test 11: FastCGI connection reuse (tests/fastcgi_echo.py responder)
+echo "Test 11: FastCGI keep-alive pool"
+python3 tests/fastcgi_echo.py /tmp/webserv-fastcgi.sock > /dev/null 2>&1 &
+FASTCGI_PID=$!
+sleep 1
+RESPONSE=$(curl -s "http://localhost:8080/fastcgi/echo?n=1" "http://localhost:8080/fastcgi/echo?n=2")
+kill $FASTCGI_PID 2>/dev/null
+if echo "$RESPONSE" | grep -q "query=n=2" && echo "$RESPONSE" | grep -q "connection_requests=2"; then
+    echo -e "${GREEN}✓ PASS${NC} - Second request reused the FastCGI connection"
+else
+    echo -e "${RED}✗ FAIL${NC} - Got '$RESPONSE'"
+fi
+
+# Test 12: Cached files are revalidated (file_cache_valid defaults to 1s)
+echo "Test 12: File cache revalidation"
+echo "first" > www/cache_test.txt
+FIRST=$(curl -s http://localhost:8080/cache_test.txt)
+sleep 1
+echo "second" > www/cache_test.txt
+sleep 1.1
+SECOND=$(curl -s http://localhost:8080/cache_test.txt)
+rm -f www/cache_test.txt
+if [ "$FIRST" == "first" ] && [ "$SECOND" == "second" ]; then
+    echo -e "${GREEN}✓ PASS${NC} - Modified file was picked up"
+else
+    echo -e "${RED}✗ FAIL${NC} - Got '$FIRST' then '$SECOND'"
+fi
+
+# Test 13: Conditional GET
+echo "Test 13: If-None-Match (expect 304)"
+ETAG=$(curl -s -D - -o /dev/null http://localhost:8080/ | grep -i "^etag:" | cut -d' ' -f2 | tr -d '\r')
+RESPONSE=$(curl -s -o /dev/null -w "%{http_code}" -H "If-None-Match: $ETAG" http://localhost:8080/)
+if [ -n "$ETAG" ] && [ "$RESPONSE" -eq 304 ]; then
+    echo -e "${GREEN}✓ PASS${NC} - HTTP $RESPONSE for $ETAG"
+else
+    echo -e "${RED}✗ FAIL${NC} - HTTP $RESPONSE (etag '$ETAG')"
+fi
+
+# Test 14: Range request
+echo "Test 14: Range bytes=0-4 (expect 206)"
+RESPONSE=$(curl -s -o /dev/null -w "%{http_code} %{size_download}" -r 0-4 http://localhost:8080/)
+if [ "$RESPONSE" = "206 5" ]; then
+    echo -e "${GREEN}✓ PASS${NC} - $RESPONSE"
+else
+    echo -e "${RED}✗ FAIL${NC} - Got '$RESPONSE'"
+fi
+
+# Test 15: gzip content encoding
+echo "Test 15: Accept-Encoding gzip (expect gzip body)"
+ENCODING=$(curl -s -D - -o /dev/null -H "Accept-Encoding: gzip" http://localhost:8080/ | grep -i "^content-encoding:" | cut -d' ' -f2 | tr -d '\r')
+if [ "$ENCODING" = "gzip" ] && curl -s -H "Accept-Encoding: gzip" http://localhost:8080/ | gunzip -c | cmp -s - <(curl -s http://localhost:8080/); then
+    echo -e "${GREEN}✓ PASS${NC} - Content-Encoding: $ENCODING"
+else
+    echo -e "${RED}✗ FAIL${NC} - Content-Encoding: '$ENCODING'"
+fi
+
+# Test 16: Pipelined requests queued behind a file response
+echo "Test 16: Pipelined GETs (expect 3 responses in order)"
+exec 3<>/dev/tcp/localhost/8080
+printf 'GET / HTTP/1.1\r\nHost: localhost\r\n\r\nGET /nonexistent HTTP/1.1\r\nHost: localhost\r\n\r\nGET / HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n' >&3
+STATUSES=$(timeout 5 cat <&3 | grep -ao "HTTP/1.1 [0-9][0-9][0-9]" | cut -d' ' -f2 | tr '\n' ' ')
+exec 3<&-
+if [ "$STATUSES" = "200 404 200 " ]; then
+    echo -e "${GREEN}✓ PASS${NC} - $STATUSES"
+else
+    echo -e "${RED}✗ FAIL${NC} - Got '$STATUSES'"
+fi
+
+# Test 17: Virtual host selected by the Host header
+echo "Test 17: Host: vhost.local (expect the vhost.local site)"
+TITLE=$(curl -s -H "Host: vhost.local" http://localhost:8080/ | grep -o "<title>[^<]*" | cut -d'>' -f2)
+if [ "$TITLE" = "vhost.local" ]; then
+    echo -e "${GREEN}✓ PASS${NC} - $TITLE"
+else
+    echo -e "${RED}✗ FAIL${NC} - Got '$TITLE'"
+fi
+
+# Test 18: Method outside the location's list
+echo "Test 18: PUT / (expect 405)"
+RESPONSE=$(curl -s -o /dev/null -w "%{http_code}" -X PUT http://localhost:8080/)
+if [ "$RESPONSE" -eq 405 ]; then
+    echo -e "${GREEN}✓ PASS${NC} - HTTP $RESPONSE"
+else
+    echo -e "${RED}✗ FAIL${NC} - Expected 405, got $RESPONSE"
+fi
+
+# Test 19: SIGHUP reloads the configuration without dropping connections
+echo "Test 19: Keep-alive connection survives SIGHUP reload"
+exec 3<>/dev/tcp/localhost/8080
+printf 'GET / HTTP/1.1\r\nHost: localhost\r\n\r\n' >&3
+sleep 0.5
+pkill -HUP -x webserv
+sleep 0.5
+printf 'GET / HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n' >&3
+STATUSES=$(timeout 5 cat <&3 | grep -ao "HTTP/1.1 [0-9][0-9][0-9]" | cut -d' ' -f2 | tr '\n' ' ')
+exec 3<&-
+if [ "$STATUSES" = "200 200 " ]; then
+    echo -e "${GREEN}✓ PASS${NC} - $STATUSES"
+else
+    echo -e "${RED}✗ FAIL${NC} - Got '$STATUSES'"
+fi
+
+# Test 20: Files read ahead on the disk threads keep pipelined order
+echo "Test 20: Pipelined GETs of an uncached 2MB file with aio (expect 200 200, full size)"
+head -c 2097152 /dev/urandom > www/aio_test.bin
+exec 3<>/dev/tcp/localhost/8080
+printf 'GET /aio_test.bin HTTP/1.1\r\nHost: localhost\r\n\r\nGET /aio_test.bin HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n' >&3
+BYTES=$(timeout 5 cat <&3 | wc -c)
+exec 3<&-
+STATUS=$(curl -s -o /dev/null -w "%{http_code} %{size_download}" http://localhost:8080/aio_test.bin)
+rm -f www/aio_test.bin
+if [ "$STATUS" = "200 2097152" ] && [ "$BYTES" -gt 4194304 ]; then
+    echo -e "${GREEN}✓ PASS${NC} - $STATUS, $BYTES bytes pipelined"
+else
+    echo -e "${RED}✗ FAIL${NC} - Got '$STATUS', $BYTES bytes pipelined"
+fi
+
+# Test 21: Prometheus metrics
+echo "Test 21: GET /metrics (expect 200 counts and latency histograms)"
+METRICS=$(curl -s http://localhost:8080/metrics)
+if echo "$METRICS" | grep -q '^webserv_responses_total{code="200"} [1-9]' && \
+   echo "$METRICS" | grep -q '^webserv_request_phase_seconds_count{phase="send"} [1-9]'; then
+    echo -e "${GREEN}✓ PASS${NC} - $(echo "$METRICS" | grep -c '^webserv_') series"
+else
+    echo -e "${RED}✗ FAIL${NC} - Missing response counts or latency histograms"
+fi
+
+# Test 22: Access log written in the background, reopened on SIGUSR1
+echo "Test 22: JSON access log on :8081 survives rotation (expect a line in the new file)"
+rm -f /tmp/webserv_access.log /tmp/webserv_access.log.1
+curl -s -o /dev/null http://localhost:8081/
+sleep 1.5
+mv /tmp/webserv_access.log /tmp/webserv_access.log.1 2>/dev/null
+pkill -USR1 -x webserv
+sleep 0.5
+curl -s -o /dev/null -A "rotated" http://localhost:8081/
+sleep 1.5
+if grep -q '"status":200' /tmp/webserv_access.log.1 2>/dev/null && \
+   grep -q '"user_agent":"rotated"' /tmp/webserv_access.log 2>/dev/null; then
+    echo -e "${GREEN}✓ PASS${NC} - $(cat /tmp/webserv_access.log)"
+else
+    echo -e "${RED}✗ FAIL${NC} - Rotated log missing the expected lines"
+fi
+rm -f /tmp/webserv_access.log /tmp/webserv_access.log.1
+
+# Test 23: autoindex listing, streamed chunked, JSON on request
+echo "Test 23: GET /uploads/ autoindex as HTML and paged JSON (expect chunked 200s)"
+printf 'a' > www/uploads/listing_small.txt
+printf 'abcdef' > www/uploads/listing_large.txt
+HEADERS=$(curl -s -D - -o /tmp/webserv_listing.html http://localhost:8080/uploads/)
+JSON=$(curl -s -H "Accept: application/json" "http://localhost:8080/uploads/?sort=size&order=desc&limit=1")
+rm -f www/uploads/listing_small.txt www/uploads/listing_large.txt
+if echo "$HEADERS" | grep -qi "^Transfer-Encoding: chunked" && \
+   grep -q 'href="/uploads/listing_small.txt"' /tmp/webserv_listing.html && \
+   echo "$JSON" | grep -q '"total":2,' && \
+   echo "$JSON" | grep -q '"name":"listing_large.txt"' && \
+   ! echo "$JSON" | grep -q 'listing_small'; then
+    echo -e "${GREEN}✓ PASS${NC} - $(echo $JSON)"
+else
+    echo -e "${RED}✗ FAIL${NC} - Listing missing entries or not chunked: $(echo $JSON)"
+fi
+rm -f /tmp/webserv_listing.html
+
+# Test 24: A rejected body is left unread, not buffered
+echo "Test 24: 413 then 256MB more body in one write (expect server peak RSS under 16MB)"
+timeout 10 python3 - > /dev/null 2>&1 <<'EOF'
+import socket
+client = socket.create_connection(("localhost", 8080))
+client.sendall(b"POST /uploads/too_big.bin HTTP/1.1\r\nHost: localhost\r\n"
+               b"Content-Length: 100000000000\r\n\r\n" + b"\0" * (256 << 20))
+EOF
+PEAK=$(for pid in $(pgrep -x webserv); do grep VmHWM /proc/$pid/status; done | awk '{ if ($2 > kb) kb = $2 } END { print kb + 0 }')
+if [ "$PEAK" -gt 0 ] && [ "$PEAK" -lt 16384 ]; then
+    echo -e "${GREEN}✓ PASS${NC} - Peak RSS ${PEAK}kB"
+else
+    echo -e "${RED}✗ FAIL${NC} - Peak RSS ${PEAK}kB"
+fi
+
 echo ""
 echo "======================================"
 echo "    Testing Complete"
@@ -0,0 +1,11 @@
+#!/usr/bin/env python3
+# Echoes the request back, used by tests/run_tests.sh
+import os
+import sys
+
+body = sys.stdin.buffer.read()
+sys.stdout.write("Content-Type: text/plain\r\n\r\n")
+sys.stdout.write("method=%s\n" % os.environ.get("REQUEST_METHOD", ""))
+sys.stdout.write("query=%s\n" % os.environ.get("QUERY_STRING", ""))
+sys.stdout.write("length=%d\n" % len(body))
+sys.stdout.flush()